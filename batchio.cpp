@@ -0,0 +1,562 @@
+#include "batchio.h"
+#include "logger.h"
+
+#include <poll.h>
+#include <linux/errqueue.h>
+
+BatchIO::BatchIO() : sockFileDescriptor(-1), sendPayloadBytes(0), sendCount(0), zeroCopy(false),
+    zeroCopyIssued(0), zeroCopyCompleted(0), zeroCopyFallbacks(0), gso(false), gro(false),
+    recvSlots(0), recvSlotSize(0), recvCount(0), recvIndex(0), recvOffset(0), recvBatchFromUring(false),
+    ioCalls(0), datagramsSent(0), datagramsReceived(0){
+    memset(&destination, 0, sizeof(destination));
+
+    resizeReceiveRing(IO_BATCH_SIZE, MAX_DATAGRAM_SIZE);
+}
+
+void BatchIO::resizeReceiveRing(int slots, size_t slotSize){
+    /*
+    (Re)aloca o anel de recepção. Só acontece na construção e ao habilitar o GRO;
+    depois disso o anel é reaproveitado em todas as chamadas.
+    */
+    recvSlots = slots;
+    recvSlotSize = slotSize;
+    recvRing.assign((size_t)slots * slotSize, 0);
+    for(int i = 0; i < slots; i++){
+        recvIov[i].iov_base = &recvRing[(size_t)i * slotSize];
+        recvIov[i].iov_len = slotSize;
+    }
+    recvCount = 0;
+    recvIndex = 0;
+    recvOffset = 0;
+    recvBatchFromUring = false;
+}
+
+void BatchIO::attach(int fd, const struct sockaddr_in & dest){
+    /*
+    Associa a camada ao socket e ao endereço de destino dos envios.
+    Descarta qualquer envio pendente ou datagrama ainda não lido do socket anterior.
+    */
+    sockFileDescriptor = fd;
+    destination = dest;
+    sendCount = 0;
+    sendPayloadBytes = 0;
+    zeroCopy = false;
+    zeroCopyIssued = zeroCopyCompleted = zeroCopyFallbacks = 0;
+    gso = false;
+    uring.teardown();
+    if(gro){
+        gro = false;
+        resizeReceiveRing(IO_BATCH_SIZE, MAX_DATAGRAM_SIZE);
+    }
+    recvCount = 0;
+    recvIndex = 0;
+    recvOffset = 0;
+    recvBatchFromUring = false;
+}
+
+bool BatchIO::queueSend(const uint8_t * header, size_t headerSize, const uint8_t * payload, size_t payloadSize){
+    /*
+    Enfileira um datagrama para o destino padrão (ver attach()).
+    */
+    return queueSendTo(destination, header, headerSize, payload, payloadSize);
+}
+
+bool BatchIO::queueSendTo(const struct sockaddr_in & to, const uint8_t * header, size_t headerSize,
+                          const uint8_t * payload, size_t payloadSize){
+    /*
+    Enfileira um datagrama (cabeçalho seguido de uma fatia de dados) para o próximo flushSends().
+    Nenhum dos dois buffers é copiado, então precisam continuar válidos até lá
+    (ou até a conclusão do MSG_ZEROCOPY). Se o lote encher, é submetido na hora.
+
+    return  false se um envio automático do lote falhar.
+    */
+    if(sendCount == IO_BATCH_SIZE && !flushSends()){
+        return false;
+    }
+
+    struct iovec * iov = &sendIov[2 * sendCount];
+    iov[0].iov_base = const_cast<uint8_t *>(header);
+    iov[0].iov_len = headerSize;
+    iov[1].iov_base = const_cast<uint8_t *>(payload);
+    iov[1].iov_len = payloadSize;
+
+    sendTo[sendCount] = to;
+
+    struct msghdr & hdr = sendMsgs[sendCount].msg_hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_name = &sendTo[sendCount];
+    hdr.msg_namelen = sizeof(sendTo[sendCount]);
+    hdr.msg_iov = iov;
+    hdr.msg_iovlen = payloadSize > 0 ? 2 : 1;
+
+    sendBytes[sendCount] = headerSize + payloadSize;
+    sendPayloadBytes += payloadSize;
+    sendCount++;
+    return true;
+}
+
+bool BatchIO::flushSends(){
+    /*
+    Submete todos os datagramas enfileirados com sendmmsg(), repetindo a chamada
+    enquanto o kernel aceitar só parte do lote. Com GSO, os trens de datagramas
+    completos saem como uma mensagem segmentada cada.
+
+    return  true se todos foram enviados por inteiro;
+            false em caso de erro (os pendentes são descartados).
+    */
+    int flags = (zeroCopy && sendPayloadBytes >= ZEROCOPY_MIN_BYTES) ? MSG_ZEROCOPY : 0;
+
+    bool ok = (gso && sendCount > 1) ? flushSegmented(flags) : flushRange(0, flags);
+
+    sendCount = 0;
+    sendPayloadBytes = 0;
+    return ok;
+}
+
+bool BatchIO::flushRange(int first, int flags){
+    /*
+    Envia os datagramas do lote a partir de first, um por mensagem do sendmmsg().
+    */
+    int sent = first;
+
+    while(sent < sendCount){
+        int ret = sendMessages(&sendMsgs[sent], sendCount - sent, flags);
+        if(ret < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            if(errno == ENOBUFS && flags){ // limite de optmem para o zerocopy: tenta com cópia
+                flags = 0;
+                continue;
+            }
+            perror("sendmmsg");
+            return false;
+        }
+
+        for(int i = sent; i < sent + ret; i++){
+            if(sendMsgs[i].msg_len != sendBytes[i]){
+                SLOW_LOG_WARN("AVISO: Nem todos os bytes do datagrama foram enviados (",
+                              sendMsgs[i].msg_len, "/", sendBytes[i], ").");
+                return false;
+            }
+        }
+        if(flags){
+            zeroCopyIssued += ret; // cada mensagem do sendmmsg gera uma notificação
+        }
+        sent += ret;
+    }
+
+    return true;
+}
+
+bool BatchIO::flushSegmented(int flags){
+    /*
+    Reagrupa o lote em trens para o GSO: uma sequência de datagramas de exatamente
+    MAX_DATAGRAM_SIZE bytes para o mesmo destino (o último do trem pode ser menor) vira uma única mensagem
+    com o cmsg UDP_SEGMENT. O iovec do trem é a própria sequência de iovecs
+    cabeçalho/dados do lote, então nada é copiado. Se o kernel recusar a mensagem
+    segmentada, o GSO é desligado e o restante do lote sai datagrama a datagrama.
+    */
+    int groups = 0;
+
+    for(int i = 0; i < sendCount; ){
+        int j = i;
+        size_t total = 0;
+        while(j < sendCount && j - i < GSO_MAX_SEGMENTS && total + sendBytes[j] <= (size_t)GSO_MAX_SEGMENTS * MAX_DATAGRAM_SIZE &&
+              memcmp(&sendTo[j], &sendTo[i], sizeof(sendTo[i])) == 0){
+            total += sendBytes[j];
+            j++;
+            if(sendBytes[j - 1] != (size_t)MAX_DATAGRAM_SIZE){ // segmento curto só pode ser o último
+                break;
+            }
+        }
+
+        struct msghdr & hdr = gsoMsgs[groups].msg_hdr;
+        if(j - i == 1){
+            hdr = sendMsgs[i].msg_hdr;
+        }else{
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_name = &sendTo[i];
+            hdr.msg_namelen = sizeof(sendTo[i]);
+            hdr.msg_iov = &sendIov[2 * i];
+            hdr.msg_iovlen = 2 * (j - i);
+            hdr.msg_control = gsoControl[groups];
+            hdr.msg_controllen = sizeof(gsoControl[groups]);
+
+            struct cmsghdr * cm = CMSG_FIRSTHDR(&hdr);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segmentSize = MAX_DATAGRAM_SIZE;
+            memcpy(CMSG_DATA(cm), &segmentSize, sizeof(segmentSize));
+        }
+
+        gsoFirst[groups] = i;
+        gsoBytes[groups] = total;
+        groups++;
+        i = j;
+    }
+
+    int sent = 0;
+    while(sent < groups){
+        int ret = sendMessages(&gsoMsgs[sent], groups - sent, flags);
+        if(ret < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            if(errno == ENOBUFS && flags){
+                flags = 0;
+                continue;
+            }
+            if(errno == EIO || errno == EINVAL || errno == EOPNOTSUPP || errno == ENOPROTOOPT){
+                // a interface de saída não suporta a segmentação (ex.: sem checksum offload)
+                SLOW_LOG_WARN("WARNING: GSO recusado pelo kernel, voltando a um datagrama por mensagem");
+                gso = false;
+                return flushRange(gsoFirst[sent], flags);
+            }
+            perror("sendmmsg (GSO)");
+            return false;
+        }
+
+        for(int g = sent; g < sent + ret; g++){
+            if(gsoMsgs[g].msg_len != gsoBytes[g]){
+                SLOW_LOG_WARN("AVISO: Nem todos os bytes do trem foram enviados (",
+                              gsoMsgs[g].msg_len, "/", gsoBytes[g], ").");
+                return false;
+            }
+        }
+        if(flags){
+            zeroCopyIssued += ret;
+        }
+        sent += ret;
+    }
+
+    return true;
+}
+
+int BatchIO::sendMessages(struct mmsghdr * messages, unsigned count, int flags){
+    /*
+    Submete mensagens com a semântica do sendmmsg(): pelo io_uring quando habilitado,
+    senão pelo próprio sendmmsg().
+    */
+    int ret;
+    if(uring.active()){
+        ret = uring.sendMessages(messages, count, flags);
+    }else{
+        ioCalls++;
+        ret = sendmmsg(sockFileDescriptor, messages, count, flags);
+    }
+    if(ret > 0){
+        for(int i = 0; i < ret; i++){
+            // um trem do GSO conta como os datagramas em que o kernel o corta
+            datagramsSent += (messages[i].msg_len + MAX_DATAGRAM_SIZE - 1) / MAX_DATAGRAM_SIZE;
+        }
+    }
+    return ret;
+}
+
+void BatchIO::discardSends(){
+    /*
+    Descarta os envios enfileirados (usado quando os buffers deixam de ser válidos).
+    */
+    sendCount = 0;
+    sendPayloadBytes = 0;
+}
+
+int BatchIO::fillReceiveRing(){
+    /*
+    Drena o socket para o anel de recepção com um único recvmmsg() não bloqueante.
+
+    return  quantidade de datagramas lidos; 0 se não havia nada; -1 em caso de erro.
+    */
+    if(uring.active()){
+        return fillReceiveRingUring();
+    }
+
+    for(int i = 0; i < recvSlots; i++){
+        struct msghdr & hdr = recvMsgs[i].msg_hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = &recvFrom[i];
+        hdr.msg_namelen = sizeof(recvFrom[i]);
+        hdr.msg_iov = &recvIov[i];
+        hdr.msg_iovlen = 1;
+        if(gro){
+            hdr.msg_control = recvControl[i];
+            hdr.msg_controllen = sizeof(recvControl[i]);
+        }
+    }
+
+    int ret;
+    do{
+        ioCalls++;
+        ret = recvmmsg(sockFileDescriptor, recvMsgs, recvSlots, MSG_DONTWAIT, NULL);
+    }while(ret < 0 && errno == EINTR);
+
+    recvIndex = 0;
+    recvOffset = 0;
+    if(ret < 0){
+        recvCount = 0;
+        if(errno == EAGAIN || errno == EWOULDBLOCK){
+            return 0;
+        }
+        perror("recvmmsg");
+        return -1;
+    }
+
+    for(int i = 0; i < ret; i++){
+        // sem o cmsg do GRO, o datagrama não foi coalescido e é um segmento só
+        recvData[i] = static_cast<uint8_t *>(recvIov[i].iov_base);
+        recvLength[i] = recvMsgs[i].msg_len;
+        recvSegmentSize[i] = recvMsgs[i].msg_len;
+        if(!gro){
+            continue;
+        }
+        struct msghdr & hdr = recvMsgs[i].msg_hdr;
+        for(struct cmsghdr * cm = CMSG_FIRSTHDR(&hdr); cm != NULL; cm = CMSG_NXTHDR(&hdr, cm)){
+            if(cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO){
+                int segmentSize;
+                memcpy(&segmentSize, CMSG_DATA(cm), sizeof(segmentSize));
+                if(segmentSize > 0){
+                    recvSegmentSize[i] = segmentSize;
+                }
+            }
+        }
+    }
+
+    recvCount = ret;
+    return ret;
+}
+
+int BatchIO::fillReceiveRingUring(){
+    /*
+    Versão io_uring de fillReceiveRing(): devolve ao anel os buffers do lote anterior e
+    pega as recepções já concluídas pelo recvmsg multishot, sem syscall.
+    */
+    if(recvBatchFromUring){
+        for(int i = 0; i < recvCount; i++){
+            uring.releaseBuffer(uringReceived[i].bufferId);
+        }
+        recvBatchFromUring = false;
+    }
+    recvCount = 0;
+    recvIndex = 0;
+    recvOffset = 0;
+    if(!uring.active()){
+        return 0;
+    }
+
+    int ret = uring.receive(uringReceived, IO_BATCH_SIZE);
+    if(ret < 0){
+        perror("io_uring recvmsg");
+        return -1;
+    }
+
+    for(int i = 0; i < ret; i++){
+        recvData[i] = uringReceived[i].payload;
+        recvLength[i] = uringReceived[i].size;
+        recvSegmentSize[i] = uringReceived[i].segmentSize;
+        recvFrom[i] = uringReceived[i].from;
+    }
+
+    recvBatchFromUring = ret > 0;
+    recvCount = ret;
+    return ret;
+}
+
+bool BatchIO::nextDatagram(Datagram & out){
+    /*
+    Entrega o próximo datagrama do anel de recepção, drenando o socket se o anel estiver vazio.
+    Datagramas coalescidos pelo GRO são entregues segmento a segmento.
+    Não bloqueia: use poll() antes para esperar por dados.
+
+    return  true se um datagrama foi entregue;
+            false se não há nada para ler ou ocorreu um erro (errno indica qual).
+    */
+    if(recvIndex >= recvCount){ // lote atual consumido (hasReceived() também olha o anel do io_uring)
+        int ret = fillReceiveRing();
+        if(ret <= 0){
+            if(ret == 0){
+                errno = EAGAIN;
+            }
+            return false;
+        }
+    }
+
+    size_t length = recvLength[recvIndex];
+    size_t segmentSize = recvSegmentSize[recvIndex];
+
+    out.data = recvData[recvIndex] + recvOffset;
+    out.size = min(segmentSize, length - recvOffset);
+    out.from = recvFrom[recvIndex];
+
+    datagramsReceived++;
+    recvOffset += out.size;
+    if(recvOffset >= length){
+        recvIndex++;
+        recvOffset = 0;
+    }
+    return true;
+}
+
+bool BatchIO::enableZeroCopy(){
+    /*
+    Habilita SO_ZEROCOPY no socket. Daí em diante, lotes com pelo menos ZEROCOPY_MIN_BYTES
+    de dados saem com MSG_ZEROCOPY. Se o kernel recusar a opção, continua com cópia.
+
+    return  true se o zerocopy foi habilitado.
+    */
+    int one = 1;
+    if(setsockopt(sockFileDescriptor, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0){
+        SLOW_LOG_WARN("WARNING: SO_ZEROCOPY não suportado, envios continuam com cópia");
+        zeroCopy = false;
+        return false;
+    }
+
+    zeroCopy = true;
+    return true;
+}
+
+int BatchIO::reapCompletions(){
+    /*
+    Lê as notificações de conclusão do MSG_ZEROCOPY da fila de erros do socket, sem bloquear.
+    Cada notificação cobre um intervalo [ee_info, ee_data] de envios concluídos.
+
+    return  quantidade de envios concluídos nesta chamada.
+    */
+    int reaped = 0;
+
+    while(true){
+        uint8_t control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if(recvmsg(sockFileDescriptor, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0){
+            break;
+        }
+
+        for(struct cmsghdr * cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)){
+            if(cm->cmsg_level != SOL_IP || cm->cmsg_type != IP_RECVERR){
+                continue;
+            }
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            if(err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY){
+                continue;
+            }
+
+            uint32_t completed = err.ee_data - err.ee_info + 1;
+            zeroCopyCompleted += completed;
+            reaped += completed;
+            if(err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED){
+                zeroCopyFallbacks += completed;
+            }
+        }
+    }
+
+    return reaped;
+}
+
+bool BatchIO::waitZeroCopyCompletions(chrono::milliseconds timeout){
+    /*
+    Espera até que o kernel tenha liberado todos os buffers enviados com MSG_ZEROCOPY,
+    para que o chamador possa reutilizar ou liberar a memória dos dados.
+
+    return  true se não há mais envios pendentes;
+            false se o prazo expirou antes.
+    */
+    chrono::steady_clock::time_point limit = chrono::steady_clock::now() + timeout;
+
+    reapCompletions();
+    while(zeroCopyPending() > 0){
+        chrono::milliseconds remaining = chrono::ceil<chrono::milliseconds>(limit - chrono::steady_clock::now());
+        if(remaining.count() <= 0){
+            return false;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = sockFileDescriptor;
+        pfd.events = 0; // POLLERR é sempre reportado
+        pfd.revents = 0;
+        if(poll(&pfd, 1, (int)remaining.count()) < 0 && errno != EINTR){
+            return false;
+        }
+        reapCompletions();
+    }
+
+    return true;
+}
+
+bool BatchIO::enableSegmentationOffload(){
+    /*
+    Verifica se o kernel aceita UDP_SEGMENT neste socket e, se aceitar, passa a enviar
+    trens de fragmentos com GSO. O tamanho do segmento vai por mensagem (cmsg), então
+    o padrão do socket é mantido em 0 (sem segmentação) depois do teste.
+
+    return  true se o GSO foi habilitado.
+    */
+    int segmentSize = MAX_DATAGRAM_SIZE;
+    if(setsockopt(sockFileDescriptor, SOL_UDP, UDP_SEGMENT, &segmentSize, sizeof(segmentSize)) < 0){
+        SLOW_LOG_WARN("WARNING: UDP_SEGMENT (GSO) não suportado, trens de fragmentos saem datagrama a datagrama");
+        gso = false;
+        return false;
+    }
+    segmentSize = 0;
+    setsockopt(sockFileDescriptor, SOL_UDP, UDP_SEGMENT, &segmentSize, sizeof(segmentSize));
+
+    gso = true;
+    return true;
+}
+
+bool BatchIO::enableReceiveOffload(){
+    /*
+    Habilita UDP_GRO no socket. Como um datagrama coalescido pode ter até 64KB,
+    o anel de recepção passa a ter menos slots, porém maiores.
+
+    return  true se o GRO foi habilitado.
+    */
+    int one = 1;
+    if(setsockopt(sockFileDescriptor, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0){
+        SLOW_LOG_WARN("WARNING: UDP_GRO não suportado, recepção continua datagrama a datagrama");
+        gro = false;
+        return false;
+    }
+
+    gro = true;
+    resizeReceiveRing(GRO_BATCH_SIZE, GRO_SLOT_SIZE);
+    if(uring.active() && !setupUring()){
+        // os buffers fornecidos precisam comportar um datagrama coalescido: sem isso, volta ao recvmmsg
+        SLOW_LOG_WARN("WARNING: io_uring não pôde ser refeito para o GRO, E/S continua com sendmmsg/recvmmsg");
+    }
+    return true;
+}
+
+bool BatchIO::setupUring(){
+    /*
+    (Re)cria o anel com buffers do tamanho que a recepção atual exige (com GRO, poucos e grandes).
+    */
+    if(gro){
+        return uring.setup(sockFileDescriptor, URING_GRO_RECV_BUFFERS, GRO_SLOT_SIZE, CMSG_SPACE(sizeof(int)));
+    }
+    return uring.setup(sockFileDescriptor, URING_RECV_BUFFERS, MAX_DATAGRAM_SIZE, 0);
+}
+
+bool BatchIO::enableUring(){
+    /*
+    Passa o socket para o backend io_uring, se o kernel suportar (io_uring habilitado,
+    anel de buffers fornecidos e recvmsg multishot). Sem suporte, continua com
+    sendmmsg/recvmmsg. Quem espera pelo socket num epoll deve passar a esperar por
+    eventFileDescriptor().
+
+    return  true se o io_uring foi habilitado.
+    */
+    if(sockFileDescriptor < 0){
+        return false;
+    }
+    if(!setupUring()){
+        SLOW_LOG_WARN("WARNING: io_uring não suportado (", strerror(errno), "), E/S continua com sendmmsg/recvmmsg");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,135 @@
+#ifndef BATCHIO_H
+#define BATCHIO_H
+
+#include "slow.h"
+#include "uring.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h> // UDP_SEGMENT, UDP_GRO
+
+const int IO_BATCH_SIZE = 64; // datagramas por chamada de sendmmsg/recvmmsg
+const int MAX_DATAGRAM_SIZE = SLOW_HEADER_SIZE + MAX_DATA_SIZE;
+const size_t ZEROCOPY_MIN_BYTES = 16 * 1024; // abaixo disso o MSG_ZEROCOPY custa mais do que a cópia
+const int GSO_MAX_SEGMENTS = 44;        // 44 * 1472 = 64768 bytes, dentro do máximo de um datagrama UDP (65507)
+const int GRO_BATCH_SIZE = 8;           // com GRO cada slot do anel recebe um datagrama coalescido inteiro
+const int GRO_SLOT_SIZE = 65535;
+
+struct Datagram {
+    uint8_t * data = nullptr; // aponta para o anel de recepção; válido até a próxima recepção em lote
+    size_t size = 0;
+    struct sockaddr_in from;
+};
+
+class BatchIO{
+    /*
+    Camada de E/S em lote para o socket UDP.
+
+    Os envios são enfileirados (sem cópia: apenas os ponteiros do cabeçalho e da fatia de dados
+    são guardados, como um iovec de dois elementos) e submetidos juntos com um único sendmmsg()
+    em flushSends(). Opcionalmente, lotes grandes saem com MSG_ZEROCOPY; nesse caso os buffers
+    só podem ser liberados depois que o kernel confirmar a conclusão (waitZeroCopyCompletions()).
+    As recepções drenam o socket com recvmmsg() para um anel de buffers reutilizável, e nextDatagram()
+    entrega os datagramas um a um a partir dele, só voltando ao kernel quando o anel esvazia.
+
+    Com o offload de segmentação (GSO) habilitado, sequências de datagramas completos (1472 bytes)
+    viram uma única mensagem com UDP_SEGMENT: o iovec intercala cabeçalho e dados de cada
+    fragmento, e o kernel corta o trem em datagramas de 1472 bytes, cada um começando pelo seu
+    cabeçalho SLOW. Com GRO, o kernel entrega datagramas coalescidos, que nextDatagram() divide
+    de volta pelo tamanho de segmento informado no cmsg. Se o kernel recusar qualquer uma das
+    opções, a camada continua no modo de um datagrama por mensagem.
+
+    Com o backend io_uring (enableUring()), os mesmos lotes saem como SENDMSG encadeados e a
+    recepção vem de um recvmsg multishot com buffers fornecidos: receber não custa syscall, e
+    o epoll passa a esperar pelo descritor do anel (eventFileDescriptor()).
+    */
+    public:
+        BatchIO();
+
+        void attach(int fd, const struct sockaddr_in & destination);
+
+        bool queueSend(const uint8_t * header, size_t headerSize, const uint8_t * payload = nullptr, size_t payloadSize = 0);
+        bool queueSendTo(const struct sockaddr_in & to, const uint8_t * header, size_t headerSize,
+                         const uint8_t * payload = nullptr, size_t payloadSize = 0);
+        bool flushSends();
+        void discardSends();
+        int pendingSends() const { return sendCount; }
+
+        bool hasReceived() const { return recvIndex < recvCount || (uring.active() && uring.completionsReady()); }
+        bool nextDatagram(Datagram & out);
+
+        bool enableZeroCopy();
+        bool zeroCopyEnabled() const { return zeroCopy; }
+        uint32_t zeroCopyPending() const { return zeroCopyIssued - zeroCopyCompleted; }
+        uint32_t zeroCopyCopied() const { return zeroCopyFallbacks; }
+        int reapCompletions();
+        bool waitZeroCopyCompletions(chrono::milliseconds timeout);
+
+        bool enableSegmentationOffload();
+        bool enableReceiveOffload();
+        bool segmentationOffloadEnabled() const { return gso; }
+        bool receiveOffloadEnabled() const { return gro; }
+
+        bool enableUring();
+        bool uringEnabled() const { return uring.active(); }
+        int eventFileDescriptor() const { return uring.active() ? uring.fileDescriptor() : sockFileDescriptor; }
+
+        // syscalls de E/S feitas e datagramas que passaram por elas, para medir syscalls por pacote
+        uint64_t systemCalls() const { return ioCalls + uring.systemCalls(); }
+        uint64_t datagrams() const { return datagramsSent + datagramsReceived; }
+    private:
+        int sockFileDescriptor;
+        struct sockaddr_in destination;
+
+        struct mmsghdr sendMsgs[IO_BATCH_SIZE];
+        struct iovec sendIov[2 * IO_BATCH_SIZE]; // cabeçalho + dados de cada datagrama
+        struct sockaddr_in sendTo[IO_BATCH_SIZE];
+        size_t sendBytes[IO_BATCH_SIZE];
+        size_t sendPayloadBytes; // dados no lote atual, para decidir pelo MSG_ZEROCOPY
+        int sendCount;
+
+        bool zeroCopy;
+        uint32_t zeroCopyIssued;    // envios feitos com MSG_ZEROCOPY
+        uint32_t zeroCopyCompleted; // conclusões já lidas da fila de erros
+        uint32_t zeroCopyFallbacks; // conclusões em que o kernel acabou copiando
+
+        bool gso;
+        struct mmsghdr gsoMsgs[IO_BATCH_SIZE]; // lote reagrupado em trens com UDP_SEGMENT
+        alignas(struct cmsghdr) uint8_t gsoControl[IO_BATCH_SIZE][CMSG_SPACE(sizeof(uint16_t))];
+        int gsoFirst[IO_BATCH_SIZE];           // primeiro datagrama do lote original em cada trem
+        size_t gsoBytes[IO_BATCH_SIZE];
+
+        bool gro;
+        vector<uint8_t> recvRing;
+        int recvSlots;
+        size_t recvSlotSize;
+        struct mmsghdr recvMsgs[IO_BATCH_SIZE];
+        struct iovec recvIov[IO_BATCH_SIZE];
+        struct sockaddr_in recvFrom[IO_BATCH_SIZE];
+        alignas(struct cmsghdr) uint8_t recvControl[IO_BATCH_SIZE][CMSG_SPACE(sizeof(int))];
+        size_t recvSegmentSize[IO_BATCH_SIZE]; // tamanho dos segmentos de um datagrama coalescido
+        uint8_t * recvData[IO_BATCH_SIZE];
+        size_t recvLength[IO_BATCH_SIZE];
+        int recvCount;
+        int recvIndex;
+        size_t recvOffset; // posição dentro do datagrama coalescido atual
+
+        UringIO uring;
+        UringReceive uringReceived[IO_BATCH_SIZE];
+        bool recvBatchFromUring; // o lote atual ocupa buffers do io_uring, devolvidos na próxima recepção
+
+        uint64_t ioCalls;
+        uint64_t datagramsSent;
+        uint64_t datagramsReceived;
+
+        void resizeReceiveRing(int slots, size_t slotSize);
+        int fillReceiveRing();
+        int fillReceiveRingUring();
+        bool setupUring();
+        int sendMessages(struct mmsghdr * messages, unsigned count, int flags);
+        bool flushRange(int first, int flags);
+        bool flushSegmented(int flags);
+};
+
+#endif
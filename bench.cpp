@@ -0,0 +1,565 @@
+#include "peripheral.h"
+#include "coperipheral.h"
+#include "central.h"
+#include "multiplexer.h"
+#include "logger.h"
+
+/*
+Benchmarks do SLOW (make bench).
+
+Antes de medir, confere que o codec rápido gera os mesmos bytes que o escalar.
+Parte 1: micro-benchmarks do codec do cabeçalho e dos helpers de SlowHeader/Flags/SID,
+em lotes de tamanhos diferentes (ns/op e pacotes/s).
+Parte 2: ponta a ponta, Peripheral contra uma Central rodando numa thread do mesmo
+processo via loopback: latência do handshake, latência por mensagem (percentis) e vazão.
+Também confere que, depois do aquecimento, enviar mensagens não aloca nada no heap
+(operator new contado por thread, abaixo): o benchmark falha se alocar.
+Antes da parte 2, confere que um envio abortado não estraga as mensagens seguintes da
+sessão na central, nem quando o fid dele volta a ser usado.
+*/
+
+using BenchClock = chrono::steady_clock;
+
+const size_t BENCH_BATCH_SIZES[] = {1, 16, 64, 256, 4096};
+const size_t BENCH_OPS_PER_CASE = 2000000;
+const int BENCH_FIRST_PORT = 17033;
+
+static volatile uint64_t benchSink; // impede que o compilador elimine o trabalho medido
+
+// gancho de teste: conta as alocações feitas por cada thread. Todo operator new do processo
+// passa por aqui; a Central do benchmark roda em outra thread e não entra na conta da medida.
+static thread_local uint64_t threadAllocations = 0;
+
+void * operator new(size_t size){
+    threadAllocations++;
+    if(void * memory = malloc(size > 0 ? size : 1)){
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void * memory) noexcept{
+    free(memory);
+}
+
+void operator delete(void * memory, size_t) noexcept{
+    free(memory);
+}
+
+static void printResult(const char * name, size_t batch, double nsPerOp){
+    printf("  %-34s lote %5zu  %8.2f ns/op  %12.0f pacotes/s\n", name, batch, nsPerOp, 1e9 / nsPerOp);
+}
+
+template<typename Body>
+static double measure(size_t batch, Body body){
+    /*
+    Roda body(i) para cada elemento do lote, repetindo o lote até completar
+    BENCH_OPS_PER_CASE operações.
+
+    return  nanossegundos por operação.
+    */
+    size_t rounds = max((size_t)1, BENCH_OPS_PER_CASE / batch);
+
+    // aquecimento (caches e preditor de desvios)
+    for(size_t i = 0; i < batch; i++){
+        body(i);
+    }
+
+    BenchClock::time_point start = BenchClock::now();
+    for(size_t r = 0; r < rounds; r++){
+        for(size_t i = 0; i < batch; i++){
+            body(i);
+        }
+    }
+    chrono::duration<double, nano> elapsed = BenchClock::now() - start;
+    return elapsed.count() / (double)(rounds * batch);
+}
+
+template<typename Body>
+static double measureBatch(size_t batch, Body body){
+    /*
+    Como measure(), mas body() processa o lote inteiro de uma vez (APIs de lote).
+
+    return  nanossegundos por cabeçalho.
+    */
+    size_t rounds = max((size_t)1, BENCH_OPS_PER_CASE / batch);
+    body();
+
+    BenchClock::time_point start = BenchClock::now();
+    for(size_t r = 0; r < rounds; r++){
+        body();
+    }
+    chrono::duration<double, nano> elapsed = BenchClock::now() - start;
+    return elapsed.count() / (double)(rounds * batch);
+}
+
+static void fillHeaders(vector<SlowHeader> & headers, mt19937 & rng){
+    for(size_t i = 0; i < headers.size(); i++){
+        SlowHeader & header = headers[i];
+        for(int b = 0; b < 16; b++){
+            header.sid.byte[b] = (uint8_t)rng();
+        }
+        header.setSttl(rng());
+        header.setFlags(Flags::fromByte(rng() & 0x1f));
+        header.seqNum = rng();
+        header.ackNum = rng();
+        header.window = (uint16_t)rng();
+        header.fid = (uint8_t)rng();
+        header.fo = (uint8_t)rng();
+    }
+}
+
+static bool verifyCodec(){
+    /*
+    Confere que os codecs rápidos (único, em lote e com stride de datagrama) produzem
+    exatamente os mesmos bytes que a versão escalar, e que a ida e volta preserva os campos.
+
+    return  true se tudo for idêntico.
+    */
+    const size_t count = 100000;
+    mt19937 rng(1472);
+    vector<SlowHeader> headers(count), decoded(count), batchDecoded(count);
+    fillHeaders(headers, rng);
+
+    vector<uint8_t> scalar(count * SLOW_HEADER_SIZE), fast(count * SLOW_HEADER_SIZE);
+    vector<uint8_t> strided(count * MAX_DATAGRAM_SIZE);
+    for(size_t i = 0; i < count; i++){
+        serializationOfSlowHeaderScalar(headers[i], &scalar[i * SLOW_HEADER_SIZE]);
+        serializationOfSlowHeader(headers[i], &fast[i * SLOW_HEADER_SIZE]);
+    }
+    bool ok = scalar == fast;
+
+    serializationOfSlowHeaders(headers.data(), fast.data(), SLOW_HEADER_SIZE, count);
+    ok = ok && scalar == fast;
+
+    serializationOfSlowHeaders(headers.data(), strided.data(), MAX_DATAGRAM_SIZE, count);
+    for(size_t i = 0; i < count && ok; i++){
+        ok = memcmp(&strided[i * MAX_DATAGRAM_SIZE], &scalar[i * SLOW_HEADER_SIZE], SLOW_HEADER_SIZE) == 0;
+    }
+
+    deserializationForSlowHeaders(batchDecoded.data(), strided.data(), MAX_DATAGRAM_SIZE, count);
+    for(size_t i = 0; i < count && ok; i++){
+        SlowHeader reference;
+        deserializationForSlowHeaderScalar(reference, &scalar[i * SLOW_HEADER_SIZE]);
+        deserializationForSlowHeader(decoded[i], &scalar[i * SLOW_HEADER_SIZE]);
+        for(const SlowHeader * h : {&decoded[i], &batchDecoded[i], &headers[i]}){
+            ok = ok && h->sid.isEqual(reference.sid) && h->sttlAndFlags == reference.sttlAndFlags
+                 && h->seqNum == reference.seqNum && h->ackNum == reference.ackNum
+                 && h->window == reference.window && h->fid == reference.fid && h->fo == reference.fo;
+        }
+    }
+
+    printf("Codec %s: %s à versão escalar em %zu cabeçalhos\n", slowHeaderCodecName(),
+           ok ? "saída idêntica" : "FALHA, saída diferente", count);
+    return ok;
+}
+
+static void runCodecBenchmarks(){
+    printf("\nCodec do cabeçalho\n");
+    mt19937 rng(7033);
+
+    for(size_t batch : BENCH_BATCH_SIZES){
+        vector<SlowHeader> headers(batch), decoded(batch);
+        vector<uint8_t> buffers(batch * SLOW_HEADER_SIZE);
+        vector<uint8_t> flagBytes(batch);
+        vector<SID> sids(batch);
+        fillHeaders(headers, rng);
+        for(size_t i = 0; i < batch; i++){
+            flagBytes[i] = rng() & 0x1f;
+            sids[i] = headers[i].sid;
+            serializationOfSlowHeader(headers[i], &buffers[i * SLOW_HEADER_SIZE]);
+        }
+
+        printResult("serializationOfSlowHeader", batch, measure(batch, [&](size_t i){
+            serializationOfSlowHeader(headers[i], &buffers[i * SLOW_HEADER_SIZE]);
+        }));
+        benchSink = benchSink + buffers[0];
+
+        printResult("deserializationForSlowHeader", batch, measure(batch, [&](size_t i){
+            deserializationForSlowHeader(decoded[i], &buffers[i * SLOW_HEADER_SIZE]);
+        }));
+        benchSink = benchSink + decoded[0].seqNum;
+
+        printResult("serializationOfSlowHeaderScalar", batch, measure(batch, [&](size_t i){
+            serializationOfSlowHeaderScalar(headers[i], &buffers[i * SLOW_HEADER_SIZE]);
+        }));
+        benchSink = benchSink + buffers[0];
+
+        printResult("deserializationForSlowHeaderScalar", batch, measure(batch, [&](size_t i){
+            deserializationForSlowHeaderScalar(decoded[i], &buffers[i * SLOW_HEADER_SIZE]);
+        }));
+        benchSink = benchSink + decoded[0].seqNum;
+
+        printResult("serializationOfSlowHeaders", batch, measureBatch(batch, [&]{
+            serializationOfSlowHeaders(headers.data(), buffers.data(), SLOW_HEADER_SIZE, batch);
+        }));
+        benchSink = benchSink + buffers[0];
+
+        printResult("deserializationForSlowHeaders", batch, measureBatch(batch, [&]{
+            deserializationForSlowHeaders(decoded.data(), buffers.data(), SLOW_HEADER_SIZE, batch);
+        }));
+        benchSink = benchSink + decoded[0].seqNum;
+
+        uint64_t acc = 0;
+        printResult("Flags::fromByte + toByte", batch, measure(batch, [&](size_t i){
+            acc += Flags::fromByte(flagBytes[i]).toByte();
+        }));
+        benchSink = benchSink + acc;
+
+        printResult("getSttl + setSttl", batch, measure(batch, [&](size_t i){
+            headers[i].setSttl(headers[i].getSttl() + 32);
+        }));
+        benchSink = benchSink + headers[0].sttlAndFlags;
+
+        size_t equal = 0;
+        printResult("SID::isEqual", batch, measure(batch, [&](size_t i){
+            equal += sids[i].isEqual(headers[batch - 1 - i].sid);
+        }));
+        benchSink = benchSink + equal;
+    }
+}
+
+static double percentile(vector<double> & samples, double p){
+    if(samples.empty()){
+        return 0;
+    }
+    size_t index = min(samples.size() - 1, (size_t)(p * samples.size()));
+    nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+static bool verifyFidReuse(){
+    /*
+    Confere, ponta a ponta, que um envio abortado não deixa lixo na central: um repetidor
+    UDP entre o Peripheral e a Central deixa passar só os 3 primeiros fragmentos de uma
+    mensagem de 5, e o envio desiste. Depois de 255 mensagens fragmentadas o fid volta ao
+    da abortada, e a mensagem com ele precisa chegar com os próprios bytes. Em seguida,
+    4 envios abortados ocupam todos os slots da sessão; passados REASSEMBLY_STALE_SPAN
+    seqNums, uma mensagem fragmentada tem que voltar a ser aceita.
+
+    return  true se as mensagens chegaram como enviadas.
+    */
+    LogLevel originalLevel = slowLogger().getLevel();
+    slowLogger().setLevel(LogLevel::OFF);
+
+    Central central;
+    int port = BENCH_FIRST_PORT + 100;
+    while(port < BENCH_FIRST_PORT + 200 && !central.initNetwork(port, "127.0.0.1")){
+        port++;
+    }
+    mutex deliveredLock;
+    string lastMessage;
+    central.setMessageHandler([&](const SID &, string_view message){
+        lock_guard<mutex> lock(deliveredLock);
+        lastMessage.assign(message);
+    });
+    thread centralThread([&]{ central.run(); });
+
+    // repetidor: passLimit < 0 deixa tudo passar; senão, só mais passLimit datagramas do peripheral
+    int relay = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in relayAddress = {}, centralAddress = {}, peripheralAddress = {};
+    relayAddress.sin_family = centralAddress.sin_family = AF_INET;
+    relayAddress.sin_addr.s_addr = centralAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    centralAddress.sin_port = htons(port);
+    socklen_t length = sizeof(relayAddress);
+    bool ok = relay >= 0 && bind(relay, (struct sockaddr *)&relayAddress, sizeof(relayAddress)) == 0 &&
+              getsockname(relay, (struct sockaddr *)&relayAddress, &length) == 0;
+    struct timeval relayTimeout = {0, 10000}; // recvfrom volta a cada 10 ms para ver relayRunning
+    ok = ok && setsockopt(relay, SOL_SOCKET, SO_RCVTIMEO, &relayTimeout, sizeof(relayTimeout)) == 0;
+    atomic<bool> relayRunning{ok};
+    atomic<int> passLimit{-1};
+    thread relayThread([&]{
+        uint8_t datagram[MAX_DATAGRAM_SIZE];
+        while(relayRunning){
+            struct sockaddr_in from;
+            socklen_t fromLength = sizeof(from);
+            ssize_t size = recvfrom(relay, datagram, sizeof(datagram), 0, (struct sockaddr *)&from, &fromLength);
+            if(size < 0){
+                continue;
+            }
+            if(from.sin_port == centralAddress.sin_port){
+                sendto(relay, datagram, size, 0, (struct sockaddr *)&peripheralAddress, sizeof(peripheralAddress));
+                continue;
+            }
+            peripheralAddress = from;
+            int limit = passLimit;
+            if(limit == 0 || (limit > 0 && !passLimit.compare_exchange_strong(limit, limit - 1))){
+                continue;
+            }
+            sendto(relay, datagram, size, 0, (struct sockaddr *)&centralAddress, sizeof(centralAddress));
+        }
+    });
+
+    auto delivered = [&](const string & message){
+        lock_guard<mutex> lock(deliveredLock);
+        return lastMessage == message;
+    };
+    Peripheral peripheral;
+    ok = ok && peripheral.initNetwork("127.0.0.1", ntohs(relayAddress.sin_port)) && peripheral.connect();
+
+    RetransmissionPolicy policy;
+    policy.maxRetries = 1;
+    policy.initialRto = policy.minRto = chrono::milliseconds(10);
+    policy.maxRto = chrono::milliseconds(40);
+    peripheral.setRetransmissionPolicy(policy);
+
+    string aborted(5 * MAX_DATA_SIZE, 'a');
+    auto abortSend = [&](){
+        passLimit = 3;
+        bool sent = peripheral.sendData(aborted);
+        passLimit = -1;
+        return !sent;
+    };
+
+    // 1. o fid da mensagem abortada volta depois de 255 outros segmentos
+    ok = ok && abortSend();
+    string filler(2 * MAX_DATA_SIZE, 'f');
+    for(int i = 0; i < 255 && ok; i++){
+        ok = peripheral.sendData(filler) && delivered(filler);
+    }
+    string reused(3 * MAX_DATA_SIZE - 7, 'r');
+    bool reuseOk = ok && peripheral.sendData(reused) && delivered(reused);
+
+    // 2. todos os slots da sessão presos em mensagens abortadas
+    for(int i = 0; i < MAX_REASSEMBLY_SLOTS_PER_SESSION && reuseOk; i++){
+        reuseOk = abortSend();
+    }
+    string single(64, 's');
+    for(uint32_t i = 0; i <= REASSEMBLY_STALE_SPAN && reuseOk; i++){
+        reuseOk = peripheral.sendData(single);
+    }
+    string afterAborts(4 * MAX_DATA_SIZE, 'n');
+    bool staleOk = reuseOk && peripheral.sendData(afterAborts) && delivered(afterAborts);
+    peripheral.disconnect();
+
+    relayRunning = false;
+    relayThread.join();
+    if(relay >= 0){
+        close(relay);
+    }
+    central.stop();
+    centralThread.join();
+    slowLogger().setLevel(originalLevel);
+
+    printf("Envio abortado + fid reutilizado: %s; slots de mensagens abortadas: %s\n",
+           reuseOk ? "mensagem nova íntegra" : "FALHA, mensagem perdida ou com bytes da abortada",
+           staleOk ? "reaproveitados" : "FALHA, mensagem fragmentada recusada");
+    return ok && reuseOk && staleOk;
+}
+
+static SlowTask concurrentSession(CoPeripheral & peripheral, string_view payload, int & completed){
+    // o resultado de cada co_await vai para uma variável antes do if (ver CoPeripheral)
+    bool ok = co_await peripheral.connect();
+    ok = ok && co_await peripheral.send(payload);
+    ok = ok && co_await peripheral.disconnect();
+    if(ok){
+        completed++;
+    }
+}
+
+static bool runEndToEndBenchmarks(){
+    printf("\nPonta a ponta (Peripheral <-> Central local, loopback)\n");
+
+    const int handshakes = 200;
+    const int messages = 2000;
+    const size_t smallMessageSize = 64;
+    const size_t bulkMessageSize = 256 * 1024;
+    const int bulkMessages = 40;
+    const int concurrentSessions = 256;
+    const size_t concurrentMessageSize = 16 * 1024;
+    const int muxSessions = 4096;
+    const size_t muxMessageSize = 1024;
+    const size_t steadyMessageSize = 16 * 1024;
+
+    // o Peripheral e a Central registram cada sessão: desliga o log durante as medidas
+    LogLevel originalLevel = slowLogger().getLevel();
+    slowLogger().setLevel(LogLevel::OFF);
+
+    Central central;
+    int port = BENCH_FIRST_PORT;
+    while(port < BENCH_FIRST_PORT + 100 && !central.initNetwork(port, "127.0.0.1")){
+        port++;
+    }
+    atomic<uint64_t> deliveredBytes{0};
+    central.setMessageHandler([&](const SID &, string_view message){
+        deliveredBytes += message.size();
+    });
+    thread centralThread([&]{ central.run(); });
+
+    vector<double> handshakeUs, messageUs;
+    uint64_t steadyAllocations = 0, steadyCopyAllocations = 0;
+    double bulkSeconds = 0;
+    bool ok = true;
+
+    // mesma carga de vazão com os dois backends de E/S; conta as syscalls de E/S por datagrama
+    auto runBulk = [&](bool uring, double & seconds, uint64_t & bytes, double & callsPerDatagram){
+        Peripheral peripheral;
+        bool done = peripheral.initNetwork("127.0.0.1", port) && peripheral.connect();
+        peripheral.enableOffload();
+        if(uring && !peripheral.enableUring()){
+            return false;
+        }
+
+        string bulkMessage(bulkMessageSize, 'b');
+        uint64_t bytesBefore = deliveredBytes;
+        uint64_t callsBefore = peripheral.getTransport().systemCalls();
+        uint64_t datagramsBefore = peripheral.getTransport().datagrams();
+        BenchClock::time_point bulkStart = BenchClock::now();
+        for(int i = 0; i < bulkMessages && done; i++){
+            done = peripheral.sendData(bulkMessage);
+        }
+        seconds = chrono::duration<double>(BenchClock::now() - bulkStart).count();
+        bytes = deliveredBytes - bytesBefore;
+        callsPerDatagram = (peripheral.getTransport().systemCalls() - callsBefore) /
+                           (double)max<uint64_t>(1, peripheral.getTransport().datagrams() - datagramsBefore);
+        return done && peripheral.disconnect();
+    };
+
+    for(int i = 0; i < handshakes && ok; i++){
+        Peripheral peripheral;
+        ok = peripheral.initNetwork("127.0.0.1", port);
+        BenchClock::time_point start = BenchClock::now();
+        ok = ok && peripheral.connect();
+        handshakeUs.push_back(chrono::duration<double, micro>(BenchClock::now() - start).count());
+        ok = ok && peripheral.disconnect();
+    }
+
+    {
+        Peripheral peripheral;
+        ok = ok && peripheral.initNetwork("127.0.0.1", port) && peripheral.connect();
+        peripheral.enableOffload();
+
+        string smallMessage(smallMessageSize, 's');
+        for(int i = 0; i < messages && ok; i++){
+            BenchClock::time_point start = BenchClock::now();
+            ok = peripheral.sendData(smallMessage);
+            messageUs.push_back(chrono::duration<double, micro>(BenchClock::now() - start).count());
+        }
+
+        // regime: com a sessão aquecida, enviar (com ou sem cópia para o pool) não pode alocar
+        string steadyMessage(steadyMessageSize, 'r');
+        bool done = false, success = false;
+        CompletionCallback onSent = [&](OperationId, bool sent){ done = true; success = sent; };
+        ok = ok && peripheral.sendData(steadyMessage);
+        peripheral.sendDataCopyAsync(steadyMessage, onSent);
+        while(ok && !done){
+            ok = peripheral.runOnce(chrono::milliseconds(1000)) >= 0;
+        }
+
+        uint64_t allocationsBefore = threadAllocations;
+        for(int i = 0; i < messages && ok; i++){
+            ok = peripheral.sendData(i % 2 == 0 ? smallMessage : steadyMessage);
+        }
+        steadyAllocations = threadAllocations - allocationsBefore;
+
+        allocationsBefore = threadAllocations;
+        for(int i = 0; i < messages && ok; i++){
+            done = false;
+            peripheral.sendDataCopyAsync(i % 2 == 0 ? smallMessage : steadyMessage, onSent);
+            while(ok && !done){
+                ok = peripheral.runOnce(chrono::milliseconds(1000)) >= 0;
+            }
+            ok = ok && success;
+        }
+        steadyCopyAllocations = threadAllocations - allocationsBefore;
+        ok = ok && peripheral.disconnect();
+    }
+
+    uint64_t bulkBytes = 0, uringBytes = 0;
+    double bulkCalls = 0, uringSeconds = 0, uringCalls = 0;
+    ok = ok && runBulk(false, bulkSeconds, bulkBytes, bulkCalls);
+    bool uringOk = ok && runBulk(true, uringSeconds, uringBytes, uringCalls);
+
+    // muitas sessões ao mesmo tempo numa única thread: corrotinas sobre um SlowScheduler
+    double concurrentSeconds = 0;
+    int concurrentCompleted = 0;
+    if(ok){
+        SlowScheduler scheduler;
+        vector<unique_ptr<CoPeripheral>> peripherals;
+        string payload(concurrentMessageSize, 'c');
+        for(int i = 0; i < concurrentSessions && ok; i++){
+            peripherals.push_back(make_unique<CoPeripheral>(scheduler));
+            ok = peripherals.back()->initNetwork("127.0.0.1", port);
+        }
+
+        BenchClock::time_point start = BenchClock::now();
+        for(size_t i = 0; i < peripherals.size() && ok; i++){
+            scheduler.spawn(concurrentSession(*peripherals[i], payload, concurrentCompleted));
+        }
+        ok = ok && scheduler.run();
+        concurrentSeconds = chrono::duration<double>(BenchClock::now() - start).count();
+        ok = ok && concurrentCompleted == concurrentSessions;
+    }
+
+    // as mesmas sessões curtas, agora milhares delas num único socket (SessionMultiplexer)
+    double muxSeconds = 0;
+    int muxCompleted = 0;
+    if(ok){
+        SessionMultiplexer mux;
+        ok = mux.initNetwork("127.0.0.1", port);
+        string payload(muxMessageSize, 'm');
+        int finished = 0;
+
+        BenchClock::time_point start = BenchClock::now();
+        for(int i = 0; i < muxSessions && ok; i++){
+            MuxSessionId session = mux.openSession();
+            mux.connectAsync(session);
+            mux.sendDataAsync(session, payload);
+            mux.disconnectAsync(session, [&, session](OperationId, bool success){
+                finished++;
+                muxCompleted += success;
+                mux.closeSession(session);
+            });
+        }
+        while(ok && finished < muxSessions){
+            ok = mux.runOnce(chrono::milliseconds(1000)) >= 0;
+        }
+        muxSeconds = chrono::duration<double>(BenchClock::now() - start).count();
+        ok = ok && muxCompleted == muxSessions;
+    }
+
+    central.stop();
+    centralThread.join();
+    slowLogger().setLevel(originalLevel);
+
+    if(!ok){
+        printf("  falha durante o benchmark ponta a ponta (porta %d)\n", port);
+        return false;
+    }
+
+    printf("  handshake (connect)   p50 %8.1f us  p99 %8.1f us  (%d conexões)\n",
+           percentile(handshakeUs, 0.50), percentile(handshakeUs, 0.99), handshakes);
+    printf("  mensagem de %zu bytes  p50 %8.1f us  p90 %8.1f us  p99 %8.1f us  p99.9 %8.1f us\n", smallMessageSize,
+           percentile(messageUs, 0.50), percentile(messageUs, 0.90), percentile(messageUs, 0.99), percentile(messageUs, 0.999));
+    printf("  vazão (%d x %zu KB)   %8.1f MB/s  %10.0f pacotes/s  %6.3f syscalls de E/S/pacote (sendmmsg/recvmmsg)\n",
+           bulkMessages, bulkMessageSize / 1024, bulkBytes / bulkSeconds / 1e6, bulkBytes / (double)MAX_DATA_SIZE / bulkSeconds, bulkCalls);
+    printf("  %d sessões concorrentes (corrotinas, 1 thread: connect + %zu KB + disconnect)  %8.1f ms  %8.0f sessões/s\n",
+           concurrentSessions, concurrentMessageSize / 1024, concurrentSeconds * 1e3, concurrentSessions / concurrentSeconds);
+    printf("  %d sessões multiplexadas (1 socket: connect + %zu KB + disconnect)  %8.1f ms  %8.0f sessões/s  %zu bytes/sessão\n",
+           muxSessions, muxMessageSize / 1024, muxSeconds * 1e3, muxSessions / muxSeconds, SessionMultiplexer::sessionFootprint());
+    if(uringOk){
+        printf("  vazão (%d x %zu KB)   %8.1f MB/s  %10.0f pacotes/s  %6.3f syscalls de E/S/pacote (io_uring)\n",
+               bulkMessages, bulkMessageSize / 1024, uringBytes / uringSeconds / 1e6, uringBytes / (double)MAX_DATA_SIZE / uringSeconds, uringCalls);
+    }else{
+        printf("  io_uring indisponível neste kernel\n");
+    }
+    printf("  envio em regime (%d mensagens de %zu B e %zu KB)  %llu alocações (sendData)  %llu alocações (sendDataCopyAsync)\n",
+           messages, smallMessageSize, steadyMessageSize / 1024,
+           (unsigned long long)steadyAllocations, (unsigned long long)steadyCopyAllocations);
+    if(steadyAllocations + steadyCopyAllocations > 0){
+        printf("  ERRO: o caminho de envio alocou no heap em regime\n");
+        return false;
+    }
+    return true;
+}
+
+int main(){
+    if(!verifyCodec()){
+        return 1;
+    }
+    runCodecBenchmarks();
+    if(!verifyFidReuse()){
+        return 1;
+    }
+    return runEndToEndBenchmarks() ? 0 : 1;
+}
@@ -0,0 +1,596 @@
+#include "central.h"
+#include "logger.h"
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <linux/filter.h>
+#include <pthread.h>
+
+Central::Central(int shardIndex, int shardCount) : shardIndex(shardIndex), shardCount(shardCount), sockFileDescriptor(-1), epollFileDescriptor(-1), timerFileDescriptor(-1), stopFileDescriptor(-1),
+    rng(random_device{}()), sessionTtlMs(DEFAULT_SESSION_TTL_MS), maxSessions(DEFAULT_MAX_SESSIONS), verbose(false),
+    reassembler(DEFAULT_REASSEMBLY_SLOTS), replyHeaders(IO_BATCH_SIZE), replyCount(0){
+    /*
+    Inicializa a central sem socket; a rede é configurada em initNetwork().
+    */
+}
+
+Central::~Central(){
+    /*
+    Fecha todos os descritores abertos por initNetwork().
+    */
+    for(int fd : {sockFileDescriptor, epollFileDescriptor, timerFileDescriptor, stopFileDescriptor}){
+        if(fd >= 0){
+            close(fd);
+        }
+    }
+}
+
+bool Central::initNetwork(int port, const char * bindAddress, bool reusePort){
+    /*
+    Abre o socket UDP da central, faz o bind na porta pedida e monta o epoll com:
+        - o socket (datagramas dos peripherals)
+        - um timerfd de 1 segundo (expiração de sessões pelo STTL)
+        - um eventfd para interromper run() a partir de outra thread ou de um signal handler
+
+    param   port         Porta UDP em que a central escuta (7033 pelo protocolo).
+    param   bindAddress  Endereço local do bind.
+    param   reusePort    Habilita SO_REUSEPORT, para vários workers na mesma porta.
+    return  true se tudo foi configurado; false caso contrário.
+    */
+
+    sockFileDescriptor = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if(sockFileDescriptor < 0){
+        perror("socket");
+        return false;
+    }
+
+    // buffers maiores para aguentar rajadas de fragmentos de muitos peripherals
+    int bufferSize = 4 * 1024 * 1024;
+    setsockopt(sockFileDescriptor, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    setsockopt(sockFileDescriptor, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+
+    if(reusePort){
+        int one = 1;
+        if(setsockopt(sockFileDescriptor, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0){
+            perror("SO_REUSEPORT");
+            return false;
+        }
+    }
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    if(inet_pton(AF_INET, bindAddress, &local.sin_addr) != 1){
+        SLOW_LOG_WARN("Endereço de bind inválido: ", bindAddress);
+        return false;
+    }
+
+    if(bind(sockFileDescriptor, (const struct sockaddr *)&local, sizeof(local)) < 0){
+        perror("bind");
+        return false;
+    }
+
+    io.attach(sockFileDescriptor, local);
+
+    epollFileDescriptor = epoll_create1(0);
+    timerFileDescriptor = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    stopFileDescriptor = eventfd(0, EFD_NONBLOCK);
+    if(epollFileDescriptor < 0 || timerFileDescriptor < 0 || stopFileDescriptor < 0){
+        perror("epoll/timerfd/eventfd");
+        return false;
+    }
+
+    struct itimerspec sweep;
+    memset(&sweep, 0, sizeof(sweep));
+    sweep.it_interval.tv_sec = 1;
+    sweep.it_value.tv_sec = 1;
+    timerfd_settime(timerFileDescriptor, 0, &sweep, NULL);
+
+    for(int fd : {sockFileDescriptor, timerFileDescriptor, stopFileDescriptor}){
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if(epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, fd, &ev) < 0){
+            perror("epoll_ctl");
+            return false;
+        }
+    }
+
+    if(shardCount == 1){
+        SLOW_LOG_INFO("Central escutando em ", bindAddress, ":", port);
+    }
+    return true;
+}
+
+bool Central::attachShardSteering(){
+    /*
+    Anexa ao grupo SO_REUSEPORT o programa cBPF que escolhe o socket pelo shard do SID.
+    Os offsets são relativos ao início do payload UDP, ou seja, ao cabeçalho SLOW:
+
+        A = sid.byte[SID_SHARD_OCTET]
+        se A == 0 (SID Nil, ex.: Connect): retorna índice inválido -> kernel usa o hash padrão
+        senão: retorna (A - 1) % shardCount
+
+    O índice corresponde à ordem em que os sockets entraram no grupo (ordem dos bind()).
+    Basta anexar em um dos sockets do grupo.
+    */
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SID_SHARD_OCTET),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 3, 0),
+        BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, 1),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)shardCount),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+    };
+    struct sock_fprog program;
+    program.len = sizeof(code) / sizeof(code[0]);
+    program.filter = code;
+
+    if(setsockopt(sockFileDescriptor, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0){
+        perror("SO_ATTACH_REUSEPORT_CBPF");
+        SLOW_LOG_WARN("WARNING: sem direcionamento por SID; pacotes seguem o hash de 4-tupla do kernel");
+        return false;
+    }
+    return true;
+}
+
+int Central::shardOfSID(const SID & sid, int shardCount){
+    /*
+    Shard dono de um SID gerado por generateSID(), ou -1 para o SID Nil.
+    Mesma conta do programa de attachShardSteering().
+    */
+    uint8_t octet = sid.byte[SID_SHARD_OCTET];
+    if(octet == 0){
+        return -1;
+    }
+    return (octet - 1) % shardCount;
+}
+
+void Central::run(){
+    /*
+    Laço de eventos da central. Retorna quando stop() é chamado.
+    */
+    struct epoll_event events[8];
+    bool running = true;
+
+    while(running){
+        int n = epoll_wait(epollFileDescriptor, events, 8, -1);
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+
+        for(int i = 0; i < n; i++){
+            int fd = events[i].data.fd;
+            uint64_t counter;
+
+            if(fd == sockFileDescriptor){
+                drainSocket();
+            }else if(fd == timerFileDescriptor){
+                if(read(timerFileDescriptor, &counter, sizeof(counter)) > 0){
+                    expireSessions();
+                }
+            }else if(fd == stopFileDescriptor){
+                if(read(stopFileDescriptor, &counter, sizeof(counter)) > 0){
+                    running = false;
+                }
+            }
+        }
+    }
+}
+
+void Central::stop(){
+    /*
+    Pede para run() terminar. Pode ser chamado de outra thread ou de um signal handler
+    (só faz um write() no eventfd).
+    */
+    uint64_t one = 1;
+    if(stopFileDescriptor >= 0){
+        ssize_t ignored = write(stopFileDescriptor, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+void Central::drainSocket(){
+    /*
+    Processa tudo o que está no socket: os datagramas chegam em lote pelo anel de recepção
+    e as respostas são acumuladas e enviadas juntas no final.
+    */
+    Datagram datagram;
+
+    while(io.nextDatagram(datagram)){
+        stats.packetsReceived++;
+        handleDatagram(datagram);
+    }
+
+    io.flushSends();
+    replyCount = 0;
+}
+
+void Central::handleDatagram(const Datagram & datagram){
+    /*
+    Classifica o datagrama pelas flags e encaminha para o tratamento correspondente.
+
+    Disconnect é reconhecido de duas formas: C+R+ACK (como na especificação) e um pacote
+    sem flags, sem dados e com janela 0, que é o que o peripheral deste repositório envia
+    (um Data dele nunca anuncia janela 0: ver dataWindow()).
+    Um ACK puro do peripheral (flag ACK, sem dados) não ocupa seqNum: só renova o STTL.
+    */
+    if(datagram.size < (size_t)SLOW_HEADER_SIZE){
+        return;
+    }
+
+    SlowHeader header;
+    deserializationForSlowHeader(header, datagram.data);
+    uint8_t flags = datagram.data[WIRE_STTL_FLAGS_OFFSET] & FLAG_ALL;
+
+    const uint8_t * payload = datagram.data + SLOW_HEADER_SIZE;
+    size_t payloadSize = datagram.size - SLOW_HEADER_SIZE;
+
+    const uint8_t specDisconnect = FLAG_C | FLAG_R | FLAG_ACK;
+    bool disconnect = (flags & specDisconnect) == specDisconnect ||
+                      (DisconnectMessage::matches(flags) && header.window == 0 && payloadSize == 0);
+
+    if((flags & FLAG_C) && !disconnect){
+        handleConnect(header, datagram.from);
+        return;
+    }
+    if((flags & FLAG_R) && !disconnect){
+        handleRevive(header, payload, payloadSize, datagram.from);
+        return;
+    }
+
+    auto it = sessions.find(header.sid);
+    if(it == sessions.end() || !it->second.active){
+        // sessão desconhecida, expirada ou encerrada
+        sendFailed(header.seqNum, datagram.from);
+        return;
+    }
+
+    CentralSession & session = it->second;
+    session.peer = datagram.from;
+
+    if(disconnect){
+        handleDisconnect(session, header);
+    }else if(AckMessage::matches(flags) && payloadSize == 0){
+        refreshTtl(session); // a central não manda dados, então não há o que confirmar aqui
+    }else{
+        handleData(session, header, payload, payloadSize);
+    }
+}
+
+void Central::handleConnect(const SlowHeader & header, const struct sockaddr_in & from){
+    /*
+    Connect: cria uma sessão com um SID novo e responde com Setup (AR = 1).
+    Se a tabela estiver cheia, responde com Setup rejeitado (SID Nil, AR = 0).
+    */
+    if(sessions.size() >= maxSessions){
+        CentralSession rejected;
+        rejected.sid = SID::Nil();
+        sendSetup(rejected, false, from);
+        return;
+    }
+
+    CentralSession session;
+    session.sid = generateSID();
+    session.peer = from;
+    session.seqNum = (uint32_t)rng();
+    session.highestPeerSeq = header.seqNum;
+    session.recentSeqs = 1;
+    session.ackImage.build<AckMessage>(session.sid, sessionTtlMs << 5, CENTRAL_WINDOW_SIZE);
+    refreshTtl(session);
+
+    auto inserted = sessions.emplace(session.sid, session);
+    stats.sessionsCreated++;
+
+    if(verbose){
+        SLOW_LOG_INFO("Nova sessão (", sessions.size(), " ativas) de ",
+                      inet_ntoa(from.sin_addr), ":", ntohs(from.sin_port));
+    }
+
+    sendSetup(inserted.first->second, true, from);
+}
+
+void Central::handleRevive(const SlowHeader & header, const uint8_t * payload, size_t payloadSize, const struct sockaddr_in & from){
+    /*
+    Revive (0-way connect): se o SID ainda estiver dentro do STTL, reativa a sessão,
+    aceita os dados que vieram junto e responde com ACK + AR. Caso contrário, Failed.
+    */
+    auto it = sessions.find(header.sid);
+    if(it == sessions.end() || CentralClock::now() >= it->second.expiresAt){
+        stats.revivesFailed++;
+        sendFailed(header.seqNum, from);
+        return;
+    }
+
+    CentralSession & session = it->second;
+    if(!session.active){
+        // nova época de seqNums: o peripheral pode ter reiniciado a contagem
+        session.active = true;
+        session.highestPeerSeq = header.seqNum - 1;
+        session.recentSeqs = 0;
+        reassembler.dropSession(session.reassembly);
+        stats.revivesAccepted++;
+    }
+    session.peer = from;
+    refreshTtl(session);
+
+    if(acceptPayload(session, header, payload, payloadSize)){
+        sendAck(session, header.seqNum, true);
+    }
+}
+
+void Central::handleData(CentralSession & session, const SlowHeader & header, const uint8_t * payload, size_t payloadSize){
+    /*
+    Data: entrega os dados (ou o fragmento) e confirma o seqNum. Duplicatas são
+    confirmadas de novo, mas não entregues outra vez.
+    */
+    refreshTtl(session);
+    if(acceptPayload(session, header, payload, payloadSize)){
+        sendAck(session, header.seqNum, false);
+    }
+}
+
+void Central::handleDisconnect(CentralSession & session, const SlowHeader & header){
+    /*
+    Disconnect: confirma e desativa a sessão. Ela continua na tabela até o STTL
+    expirar, para que o peripheral possa fazer revive.
+    */
+    sendAck(session, header.seqNum, false);
+    session.active = false;
+    reassembler.dropSession(session.reassembly);
+
+    if(verbose){
+        SLOW_LOG_INFO("Sessão desconectada (aguardando revive ou expiração)");
+    }
+}
+
+bool Central::acceptPayload(CentralSession & session, const SlowHeader & header, const uint8_t * payload, size_t payloadSize){
+    /*
+    Confere o seqNum no bitmap de duplicatas e, se for novo, entrega os dados:
+    direto quando a mensagem tem um só pacote, ou pelo Reassembler quando fragmentada.
+    O seqNum só é marcado como recebido depois que o fragmento foi aceito, para que um
+    fragmento recusado (sem slot livre) seja retransmitido pelo peripheral.
+
+    return  true se o pacote deve ser confirmado (novo ou duplicata); false se foi recusado.
+    */
+    int32_t diff = (int32_t)(header.seqNum - session.highestPeerSeq);
+    uint32_t back = diff > 0 ? 0 : (uint32_t)(-diff);
+    if(diff <= 0 && (back >= 64 || (session.recentSeqs & (1ULL << back)))){
+        return true;
+    }
+
+    Flags flags = header.getFlags();
+    bool fragmented = flags.MB || header.fo > 0;
+
+    if(fragmented){
+        ReassembledMessage message;
+        ReassemblyResult result = reassembler.addFragment(session.reassembly, session.sid, header.fid, header.fo, flags.MB,
+                                                          header.seqNum, payload, payloadSize, message);
+        if(result == ReassemblyResult::REJECTED){
+            stats.fragmentsRejected++;
+            return false;
+        }
+        if(result == ReassemblyResult::COMPLETE){
+            deliver(session, string_view((const char *)message.data, message.size));
+            reassembler.release(session.reassembly, message);
+        }
+    }else if(payloadSize > 0){
+        deliver(session, string_view((const char *)payload, payloadSize));
+    }
+
+    if(diff > 0){
+        session.recentSeqs = diff >= 64 ? 0 : session.recentSeqs << diff;
+        session.recentSeqs |= 1;
+        session.highestPeerSeq = header.seqNum;
+    }else{
+        session.recentSeqs |= 1ULL << back;
+    }
+    return true;
+}
+
+void Central::deliver(CentralSession & session, string_view message){
+    stats.messagesDelivered++;
+    stats.bytesDelivered += message.size();
+    if(onMessage){
+        onMessage(session.sid, message);
+    }
+}
+
+void Central::sendSetup(const CentralSession & session, bool accepted, const struct sockaddr_in & to){
+    SlowHeader header;
+    header.sid = session.sid;
+    header.sttlAndFlags = (sessionTtlMs << 5) | SetupMessage::flags | (accepted ? FLAG_AR : 0);
+    header.seqNum = session.seqNum;
+    header.ackNum = 0; // o peripheral exige ackNum 0 no Setup
+    header.window = CENTRAL_WINDOW_SIZE;
+
+    queueReply(header, to);
+}
+
+void Central::sendAck(const CentralSession & session, uint32_t ackNum, bool revive){
+    /*
+    ACK a partir da imagem da sessão; o de revive leva também Accept (AR).
+    */
+    uint8_t * buffer = nextReplyBuffer();
+    session.ackImage.stamp(buffer, session.seqNum, ackNum, 0, 0, revive ? FLAG_AR : 0);
+
+    stats.acksSent++;
+    io.queueSendTo(session.peer, buffer, SLOW_HEADER_SIZE);
+}
+
+void Central::sendFailed(uint32_t ackNum, const struct sockaddr_in & to){
+    /*
+    Failed: SID Nil e AR = 0, em resposta a revive ou dados de uma sessão que não existe mais.
+    */
+    SlowHeader header;
+    header.sid = SID::Nil();
+    header.sttlAndFlags = FailedMessage::flags | FLAG_ACK;
+    header.ackNum = ackNum;
+
+    queueReply(header, to);
+}
+
+void Central::queueReply(SlowHeader & header, const struct sockaddr_in & to){
+    /*
+    Serializa a resposta num dos buffers de cabeçalho e a enfileira no lote de envio.
+    */
+    uint8_t * buffer = nextReplyBuffer();
+    serializationOfSlowHeader(header, buffer);
+    io.queueSendTo(to, buffer, SLOW_HEADER_SIZE);
+}
+
+uint8_t * Central::nextReplyBuffer(){
+    /*
+    Próximo buffer de cabeçalho livre. Os buffers só são reaproveitados depois que
+    o lote é submetido.
+    */
+    if(replyCount == replyHeaders.size()){
+        io.flushSends();
+        replyCount = 0;
+    }
+    return replyHeaders[replyCount++].data();
+}
+
+void Central::expireSessions(){
+    /*
+    Remove as sessões cujo STTL expirou.
+    */
+    CentralClock::time_point now = CentralClock::now();
+
+    for(auto it = sessions.begin(); it != sessions.end(); ){
+        if(now >= it->second.expiresAt){
+            reassembler.dropSession(it->second.reassembly);
+            it = sessions.erase(it);
+            stats.sessionsExpired++;
+        }else{
+            ++it;
+        }
+    }
+}
+
+SID Central::generateSID(){
+    /*
+    Gera um SID UUIDv8 (RFC 9562): bits aleatórios, com a versão (8) nos 4 bits
+    altos do octeto 6 e a variante (10) nos 2 bits altos do octeto 8. O primeiro octeto
+    do custom_a leva o shard + 1, para o direcionamento do SO_REUSEPORT.
+    */
+    SID sid;
+    do{
+        uint64_t high = rng();
+        uint64_t low = rng();
+        memcpy(&sid.byte[0], &high, 8);
+        memcpy(&sid.byte[8], &low, 8);
+
+        sid.byte[SID_SHARD_OCTET] = (uint8_t)(shardIndex + 1);
+        sid.byte[6] = (sid.byte[6] & 0x0f) | 0x80;
+        sid.byte[8] = (sid.byte[8] & 0x3f) | 0x80;
+    }while(sessions.count(sid));
+
+    return sid;
+}
+
+void Central::refreshTtl(CentralSession & session){
+    session.expiresAt = CentralClock::now() + chrono::milliseconds(sessionTtlMs);
+}
+
+CentralCluster::CentralCluster(int workerCount){
+    workerCount = max(1, min(workerCount, MAX_CENTRAL_SHARDS));
+    for(int i = 0; i < workerCount; i++){
+        workers.emplace_back(new Central(i, workerCount));
+    }
+}
+
+bool CentralCluster::initNetwork(int port, const char * bindAddress){
+    /*
+    Abre os sockets de todos os workers, em ordem (o índice no grupo SO_REUSEPORT é a
+    ordem dos bind()), e anexa o direcionamento por SID.
+    */
+    bool reusePort = workers.size() > 1;
+
+    for(auto & worker : workers){
+        if(!worker->initNetwork(port, bindAddress, reusePort)){
+            return false;
+        }
+    }
+
+    if(reusePort){
+        workers[0]->attachShardSteering();
+    }
+
+    SLOW_LOG_INFO("Central escutando em ", bindAddress, ":", port, " com ", workers.size(), " worker(s)");
+    return true;
+}
+
+void CentralCluster::run(){
+    /*
+    Roda cada worker na sua thread, fixada no núcleo (índice % núcleos disponíveis),
+    e retorna quando todos terminarem (ver stop()).
+    */
+    if(workers.size() == 1){
+        workers[0]->run();
+        return;
+    }
+
+    unsigned cores = max(1u, thread::hardware_concurrency());
+    vector<thread> threads;
+
+    for(size_t i = 0; i < workers.size(); i++){
+        threads.emplace_back([this, i, cores](){
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % cores, &cpus);
+            pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+            workers[i]->run();
+        });
+    }
+
+    for(thread & t : threads){
+        t.join();
+    }
+}
+
+void CentralCluster::stop(){
+    /*
+    Pede para todos os workers pararem. Seguro em signal handler (só escreve nos eventfds).
+    */
+    for(auto & worker : workers){
+        worker->stop();
+    }
+}
+
+CentralStats CentralCluster::getStats() const{
+    /*
+    Soma as estatísticas dos workers. Só é consistente depois que run() retornou.
+    */
+    CentralStats total;
+    for(const auto & worker : workers){
+        const CentralStats & s = worker->getStats();
+        total.packetsReceived += s.packetsReceived;
+        total.acksSent += s.acksSent;
+        total.sessionsCreated += s.sessionsCreated;
+        total.sessionsExpired += s.sessionsExpired;
+        total.revivesAccepted += s.revivesAccepted;
+        total.revivesFailed += s.revivesFailed;
+        total.messagesDelivered += s.messagesDelivered;
+        total.bytesDelivered += s.bytesDelivered;
+        total.fragmentsRejected += s.fragmentsRejected;
+    }
+    return total;
+}
+
+size_t CentralCluster::sessionCount() const{
+    size_t total = 0;
+    for(const auto & worker : workers){
+        total += worker->sessionCount();
+    }
+    return total;
+}
@@ -0,0 +1,148 @@
+#ifndef CENTRAL_H
+#define CENTRAL_H
+
+#include "slow.h"
+#include "batchio.h"
+#include "reassembly.h"
+#include "messages.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+using CentralClock = chrono::steady_clock;
+
+const uint16_t CENTRAL_WINDOW_SIZE = 45 * MAX_DATA_SIZE; // maior múltiplo de um fragmento que cabe nos 16 bits
+const uint32_t DEFAULT_SESSION_TTL_MS = 60000;
+const size_t DEFAULT_MAX_SESSIONS = 100000;
+const int SID_SHARD_OCTET = 0; // octeto do custom_a (UUIDv8) que leva o shard + 1; 0 fica reservado para o SID Nil
+const int MAX_CENTRAL_SHARDS = 255;
+const size_t DEFAULT_REASSEMBLY_SLOTS = 256; // mensagens fragmentadas em montagem ao mesmo tempo, por worker
+
+struct CentralSession {
+    SID sid;
+    struct sockaddr_in peer;
+    CentralClock::time_point expiresAt;
+    uint32_t seqNum = 0;          // seqNum da central, anunciado no Setup e repetido nos ACKs
+    uint32_t highestPeerSeq = 0;  // maior seqNum recebido do peripheral
+    uint64_t recentSeqs = 0;      // bitmap dos 64 seqNums anteriores ao maior (detecção de duplicatas)
+    bool active = true;           // false depois do Disconnect: só pode voltar com revive
+    ReassemblyState reassembly;   // mensagens fragmentadas em montagem (slots do Reassembler)
+    HeaderImage ackImage;         // ACK pré-serializado: cada resposta só carimba o ackNum
+};
+
+struct CentralStats {
+    uint64_t packetsReceived = 0;
+    uint64_t acksSent = 0;
+    uint64_t sessionsCreated = 0;
+    uint64_t sessionsExpired = 0;
+    uint64_t revivesAccepted = 0;
+    uint64_t revivesFailed = 0;
+    uint64_t messagesDelivered = 0;
+    uint64_t bytesDelivered = 0;
+    uint64_t fragmentsRejected = 0;
+};
+
+class Central{
+    /*
+    Lado central do protocolo SLOW, para testes locais e benchmarks do peripheral.
+
+    Um único socket UDP atende todas as sessões: um laço epoll drena o socket em lote
+    (recvmmsg), processa cada datagrama pela tabela SID -> sessão e envia as respostas
+    no mesmo lote (sendmmsg). Um timerfd varre as sessões cujo STTL expirou.
+    Mensagens fragmentadas são montadas no Reassembler do worker; o handler recebe
+    uma visão do slab, válida só durante a chamada.
+    */
+    public:
+        using MessageHandler = function<void(const SID &, string_view)>;
+
+        Central(int shardIndex = 0, int shardCount = 1);
+        ~Central();
+
+        bool initNetwork(int port, const char * bindAddress = "0.0.0.0", bool reusePort = false);
+        bool attachShardSteering();
+        static int shardOfSID(const SID & sid, int shardCount);
+        void run();
+        void stop();
+
+        void setSessionTtl(uint32_t ttlMs) { sessionTtlMs = ttlMs; }
+        void setMaxSessions(size_t maxSessions) { this->maxSessions = maxSessions; }
+        void setMessageHandler(MessageHandler handler) { onMessage = handler; }
+        void setVerbose(bool verbose) { this->verbose = verbose; }
+
+        size_t sessionCount() const { return sessions.size(); }
+        const CentralStats & getStats() const { return stats; }
+    private:
+        int shardIndex;
+        int shardCount;
+        int sockFileDescriptor;
+        int epollFileDescriptor;
+        int timerFileDescriptor;
+        int stopFileDescriptor;
+
+        BatchIO io;
+        unordered_map<SID, CentralSession, SIDHash, SIDEqual> sessions;
+        mt19937_64 rng;
+
+        uint32_t sessionTtlMs;
+        size_t maxSessions;
+        bool verbose;
+        MessageHandler onMessage;
+        CentralStats stats;
+        Reassembler reassembler;
+
+        // cabeçalhos das respostas ficam aqui até o flushSends() do lote
+        vector<array<uint8_t, SLOW_HEADER_SIZE>> replyHeaders;
+        size_t replyCount;
+
+        void drainSocket();
+        void handleDatagram(const Datagram & datagram);
+        void handleConnect(const SlowHeader & header, const struct sockaddr_in & from);
+        void handleRevive(const SlowHeader & header, const uint8_t * payload, size_t payloadSize, const struct sockaddr_in & from);
+        void handleData(CentralSession & session, const SlowHeader & header, const uint8_t * payload, size_t payloadSize);
+        void handleDisconnect(CentralSession & session, const SlowHeader & header);
+
+        bool acceptPayload(CentralSession & session, const SlowHeader & header, const uint8_t * payload, size_t payloadSize);
+        void deliver(CentralSession & session, string_view message);
+
+        void sendSetup(const CentralSession & session, bool accepted, const struct sockaddr_in & to);
+        void sendAck(const CentralSession & session, uint32_t ackNum, bool revive);
+        void sendFailed(uint32_t ackNum, const struct sockaddr_in & to);
+        void queueReply(SlowHeader & header, const struct sockaddr_in & to);
+        uint8_t * nextReplyBuffer();
+
+        void expireSessions();
+        SID generateSID();
+        void refreshTtl(CentralSession & session);
+};
+
+class CentralCluster{
+    /*
+    Central multi-core: N workers, cada um com o seu próprio socket SO_REUSEPORT na mesma
+    porta, a sua própria tabela de sessões e a sua própria thread fixada num núcleo.
+    Nada é compartilhado no caminho dos pacotes.
+
+    O shard do worker que criou a sessão vai no SID (octeto SID_SHARD_OCTET = shard + 1).
+    Um programa cBPF (SO_ATTACH_REUSEPORT_CBPF) lê esse octeto do datagrama e entrega o pacote
+    ao socket do shard dono da sessão; pacotes com SID Nil (Connect) caem no hash padrão do
+    kernel, espalhando os novos handshakes entre os workers. Se o kernel não aceitar o programa,
+    fica só o hash de 4-tupla, que mantém um mesmo endereço de peripheral no mesmo worker.
+    */
+    public:
+        explicit CentralCluster(int workers);
+
+        bool initNetwork(int port, const char * bindAddress = "0.0.0.0");
+        void run();
+        void stop();
+
+        int workerCount() const { return (int)workers.size(); }
+        Central & worker(int i) { return *workers[i]; }
+        CentralStats getStats() const;
+        size_t sessionCount() const;
+    private:
+        vector<unique_ptr<Central>> workers;
+};
+
+#endif
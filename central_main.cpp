@@ -0,0 +1,68 @@
+#include "central.h"
+#include "logger.h"
+
+#include <csignal>
+
+static CentralCluster * runningCentral = nullptr;
+
+static void handleSignal(int){
+    if(runningCentral){
+        runningCentral->stop();
+    }
+}
+
+int main(int argc, char ** argv){
+    /*
+    Uso: ./central_slow [porta] [-v] [-w workers]
+    Sobe uma central SLOW local (padrão: porta 7033) até receber SIGINT/SIGTERM.
+    -w N usa N workers com SO_REUSEPORT (0 = um por núcleo).
+    */
+    int port = 7033;
+    int workers = 1;
+    bool verbose = false;
+
+    for(int i = 1; i < argc; i++){
+        string arg = argv[i];
+        if(arg == "-v"){
+            verbose = true;
+        }else if(arg == "-w" && i + 1 < argc){
+            workers = atoi(argv[++i]);
+            if(workers <= 0){
+                workers = max(1u, thread::hardware_concurrency());
+            }
+        }else{
+            port = atoi(argv[i]);
+        }
+    }
+
+    CentralCluster central(workers);
+    if(!central.initNetwork(port)){
+        cout << "Falha ao iniciar a Central\n";
+        return 1;
+    }
+
+    for(int i = 0; i < central.workerCount(); i++){
+        central.worker(i).setVerbose(verbose);
+        central.worker(i).setMessageHandler([verbose](const SID &, string_view message){
+            if(verbose){
+                SLOW_LOG_INFO("Mensagem recebida (", message.size(), " bytes)");
+            }
+        });
+    }
+
+    runningCentral = &central;
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+
+    central.run();
+
+    CentralStats stats = central.getStats();
+    slowLogger().flush();
+    cout << "\nPacotes recebidos: " << stats.packetsReceived
+         << "\nACKs enviados: " << stats.acksSent
+         << "\nSessões criadas: " << stats.sessionsCreated
+         << "\nRevives aceitos/falhos: " << stats.revivesAccepted << "/" << stats.revivesFailed
+         << "\nMensagens entregues: " << stats.messagesDelivered << " (" << stats.bytesDelivered << " bytes)\n";
+
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include "congestion.h"
+
+// ganhos da sondagem de banda do BBR, em quartos: uma rodada acima, uma abaixo, seis no ponto
+static const uint8_t BBR_GAIN_CYCLE[8] = {5, 3, 4, 4, 4, 4, 4, 4};
+static const chrono::seconds BBR_MIN_RTT_WINDOW{10};
+
+CongestionController::CongestionController(CongestionAlgorithm algorithm) : algorithm(algorithm){
+
+}
+
+void CongestionController::reset(CongestionAlgorithm newAlgorithm){
+    /*
+    Volta ao estado inicial (nova sessão): janela inicial, sem amostras.
+    */
+    *this = CongestionController(newAlgorithm);
+}
+
+void CongestionController::onAck(uint32_t ackedBytes, chrono::microseconds rttSample, uint32_t bytesInFlight,
+                                 SlowClock::time_point sentAt, SlowClock::time_point now){
+    /*
+    Um pacote foi confirmado.
+
+    param   ackedBytes     bytes de dados do pacote.
+    param   rttSample      RTT medido com ele; zero se foi retransmitido (regra de Karn).
+    param   bytesInFlight  bytes em trânsito quando o ACK chegou, contando os do pacote.
+    param   sentAt         última transmissão do pacote.
+    */
+    switch(algorithm){
+        case CongestionAlgorithm::NONE:
+            break;
+        case CongestionAlgorithm::NEWRENO:
+            if(sentAt >= recoveryStart && 2 * (uint64_t)bytesInFlight >= cwnd){
+                this->onAckNewReno(ackedBytes);
+            }
+            break;
+        case CongestionAlgorithm::BBR:
+            this->onAckBbr(ackedBytes, rttSample, now);
+            if(!pipeFilled && 2 * (uint64_t)bytesInFlight < cwnd){
+                break; // limitado pela aplicação: o startup só cresce com a janela em uso
+            }
+            cwnd = pipeFilled ? min(cwnd + ackedBytes, this->bbrTarget()) : cwnd + min(ackedBytes, UINT32_MAX - cwnd);
+            break;
+    }
+}
+
+void CongestionController::onAckNewReno(uint32_t ackedBytes){
+    /*
+    Abaixo do ssthresh, a janela cresce um ACK de bytes por ACK (dobra por RTT); acima,
+    um MSS por janela confirmada. Só cresce com a janela em uso (RFC 7661): uma sessão
+    que manda pouco não acumula uma janela que depois sairia de uma vez.
+    */
+    if(cwnd < ssthresh){
+        cwnd += min(ackedBytes, CONGESTION_MSS);
+        return;
+    }
+    ackedInRound += ackedBytes;
+    if(ackedInRound >= cwnd){
+        ackedInRound -= cwnd;
+        cwnd += CONGESTION_MSS;
+    }
+}
+
+void CongestionController::onAckBbr(uint32_t ackedBytes, chrono::microseconds rttSample, SlowClock::time_point now){
+    /*
+    Atualiza o RTT mínimo (esquecido depois de BBR_MIN_RTT_WINDOW) e conta os bytes
+    confirmados na rodada atual; a rodada dura um RTT mínimo (pelo menos 1 ms).
+    */
+    if(rttSample.count() > 0){
+        uint32_t sampleUs = (uint32_t)min<int64_t>(rttSample.count(), UINT32_MAX);
+        if(minRttUs == 0 || sampleUs <= minRttUs || now - minRttStamp > BBR_MIN_RTT_WINDOW){
+            minRttUs = sampleUs;
+            minRttStamp = now;
+        }
+    }
+    if(minRttUs == 0){
+        return; // sem RTT ainda não há como medir rodadas
+    }
+    if(ackedInRound == 0 && roundStart == SlowClock::time_point()){
+        roundStart = now;
+    }
+    ackedInRound += ackedBytes;
+
+    chrono::microseconds roundLength = max<chrono::microseconds>(chrono::microseconds(minRttUs), chrono::milliseconds(1));
+    if(now - roundStart >= roundLength){
+        this->endBbrRound(now);
+    }
+}
+
+void CongestionController::endBbrRound(SlowClock::time_point now){
+    /*
+    Fecha a rodada: a taxa de entrega dela entra no filtro de máximo da banda. Uma rodada
+    que durou muito mais que o RTT teve uma pausa (sem dados a enviar) e não é amostra.
+    */
+    int64_t elapsedUs = chrono::duration_cast<chrono::microseconds>(now - roundStart).count();
+    int64_t roundUs = max<int64_t>(minRttUs, 1000);
+    if(elapsedUs <= 4 * roundUs){
+        bandwidthSamples[roundIndex % CONGESTION_BW_ROUNDS] = (uint32_t)min<uint64_t>((uint64_t)ackedInRound * 1000 / elapsedUs, UINT32_MAX);
+        roundIndex++;
+        gainCycle = (gainCycle + 1) % 8;
+
+        uint32_t bandwidth = *max_element(bandwidthSamples, bandwidthSamples + CONGESTION_BW_ROUNDS);
+        if(!pipeFilled){
+            // startup: enquanto a banda cresce 25% por rodada ainda há espaço no gargalo
+            if((uint64_t)bandwidth * 4 >= (uint64_t)fullBandwidth * 5){
+                fullBandwidth = bandwidth;
+                stalledRounds = 0;
+            }else if(++stalledRounds >= 3){
+                pipeFilled = true;
+                cwnd = min(cwnd, this->bbrTarget());
+            }
+        }
+    }
+    roundStart = now;
+    ackedInRound = 0;
+}
+
+uint32_t CongestionController::bbrTarget() const{
+    /*
+    Janela do BBR fora do startup: 2 x BDP (banda do gargalo x RTT mínimo), com o ganho
+    da fase da sondagem; nunca abaixo de CONGESTION_MIN_WINDOW.
+    */
+    uint64_t bandwidth = *max_element(bandwidthSamples, bandwidthSamples + CONGESTION_BW_ROUNDS);
+    uint64_t bdp = bandwidth * minRttUs / 1000;
+    uint64_t target = 2 * bdp * BBR_GAIN_CYCLE[gainCycle] / 4;
+    return (uint32_t)max<uint64_t>(CONGESTION_MIN_WINDOW, min<uint64_t>(target, UINT32_MAX));
+}
+
+uint64_t CongestionController::bottleneckBandwidth() const{
+    return (uint64_t)*max_element(bandwidthSamples, bandwidthSamples + CONGESTION_BW_ROUNDS) * 1000;
+}
+
+void CongestionController::onLoss(SlowClock::time_point sentAt, SlowClock::time_point now, uint32_t bytesInFlight){
+    /*
+    A retransmissão rápida declarou perdido um pacote enviado em sentAt. NewReno: a
+    janela cai pela metade do que está em trânsito, uma vez por episódio. BBR: perdas
+    isoladas não são sinal de congestionamento; só o RTO reduz a janela.
+    */
+    if(algorithm != CongestionAlgorithm::NEWRENO || sentAt < recoveryStart){
+        return;
+    }
+    ssthresh = max(bytesInFlight / 2, CONGESTION_MIN_WINDOW);
+    cwnd = ssthresh;
+    ackedInRound = 0;
+    recoveryStart = now;
+}
+
+void CongestionController::onTimeout(SlowClock::time_point now, uint32_t bytesInFlight){
+    /*
+    O RTO venceu: a janela volta a um pacote (NewReno, RFC 5681 seção 3.1) ou ao mínimo
+    (BBR), e cresce de novo com os ACKs das retransmissões.
+    */
+    switch(algorithm){
+        case CongestionAlgorithm::NONE:
+            return;
+        case CongestionAlgorithm::NEWRENO:
+            ssthresh = max(bytesInFlight / 2, CONGESTION_MIN_WINDOW);
+            cwnd = CONGESTION_MSS;
+            break;
+        case CongestionAlgorithm::BBR:
+            cwnd = CONGESTION_MIN_WINDOW;
+            break;
+    }
+    ackedInRound = 0;
+    roundStart = SlowClock::time_point();
+    recoveryStart = now;
+}
@@ -0,0 +1,69 @@
+#ifndef CONGESTION_H
+#define CONGESTION_H
+
+#include "slow.h"
+#include "rtt.h"
+
+const uint32_t CONGESTION_MSS = MAX_DATA_SIZE;               // fragmento cheio
+const uint32_t CONGESTION_INITIAL_WINDOW = 10 * CONGESTION_MSS; // RFC 6928
+const uint32_t CONGESTION_MIN_WINDOW = 2 * CONGESTION_MSS;
+const size_t CONGESTION_BW_ROUNDS = 4;                       // rodadas da janela de máximo da banda (BBR)
+
+enum class CongestionAlgorithm : uint8_t {
+    NONE,     // só a janela anunciada pela central limita o envio
+    NEWRENO,  // AIMD: slow start, congestion avoidance e metade da janela por perda (RFC 5681/6582)
+    BBR       // por atraso: janela = 2 x banda do gargalo x RTT mínimo, perdas isoladas não reduzem
+};
+
+class CongestionController{
+    /*
+    Controle de congestionamento da janela de envio. A janela (cwnd, em bytes de dados)
+    limita o que fica em trânsito junto com a janela da central: min(cwnd, janela).
+
+    É alimentado por quem mantém a janela de envio: onAck() a cada pacote confirmado
+    (com a amostra de RTT, se houver), onLoss() quando a retransmissão rápida declara um
+    pacote perdido e onTimeout() quando o RTO vence. O algoritmo é escolhido por valor
+    (sem alocação), para caber na linha de sessão do multiplexador.
+
+    Uma perda só reduz a janela uma vez por rodada: pacotes enviados antes da última
+    redução (recoveryStart) pertencem ao mesmo episódio, como o "recover" do NewReno.
+    */
+    public:
+        explicit CongestionController(CongestionAlgorithm algorithm = CongestionAlgorithm::NEWRENO);
+
+        void reset(CongestionAlgorithm algorithm);
+        CongestionAlgorithm getAlgorithm() const { return algorithm; }
+
+        void onAck(uint32_t ackedBytes, chrono::microseconds rttSample, uint32_t bytesInFlight,
+                   SlowClock::time_point sentAt, SlowClock::time_point now);
+        void onLoss(SlowClock::time_point sentAt, SlowClock::time_point now, uint32_t bytesInFlight);
+        void onTimeout(SlowClock::time_point now, uint32_t bytesInFlight);
+
+        uint32_t window() const { return algorithm == CongestionAlgorithm::NONE ? UINT32_MAX : cwnd; }
+        uint32_t limit(uint32_t receiverWindow) const { return min(this->window(), receiverWindow); }
+        uint32_t slowStartThreshold() const { return ssthresh; }
+        uint64_t bottleneckBandwidth() const; // BBR: bytes/s; 0 antes da primeira rodada
+        chrono::microseconds minRtt() const { return chrono::microseconds(minRttUs); }
+    private:
+        SlowClock::time_point recoveryStart;
+        SlowClock::time_point roundStart;    // BBR: início da rodada em que os bytes confirmados são contados
+        SlowClock::time_point minRttStamp;
+        uint32_t cwnd = CONGESTION_INITIAL_WINDOW;
+        uint32_t ssthresh = UINT32_MAX;
+        uint32_t ackedInRound = 0;           // NewReno: bytes rumo ao próximo MSS; BBR: bytes da rodada
+        uint32_t minRttUs = 0;
+        uint32_t fullBandwidth = 0;          // BBR: última banda (bytes/ms) que cresceu 25% no startup
+        uint32_t bandwidthSamples[CONGESTION_BW_ROUNDS] = {}; // BBR: bytes/ms de cada rodada recente
+        CongestionAlgorithm algorithm;
+        uint8_t roundIndex = 0;
+        uint8_t stalledRounds = 0;           // BBR: rodadas sem a banda crescer 25%
+        uint8_t gainCycle = 0;               // BBR: fase da sondagem de banda
+        bool pipeFilled = false;             // BBR: saiu do startup
+
+        void onAckNewReno(uint32_t ackedBytes);
+        void onAckBbr(uint32_t ackedBytes, chrono::microseconds rttSample, SlowClock::time_point now);
+        void endBbrRound(SlowClock::time_point now);
+        uint32_t bbrTarget() const;
+};
+
+#endif
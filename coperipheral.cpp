@@ -0,0 +1,195 @@
+#include "coperipheral.h"
+
+SlowTask & SlowTask::operator=(SlowTask && other) noexcept {
+    if(this != &other){
+        if(handle){
+            handle.destroy();
+        }
+        handle = exchange(other.handle, nullptr);
+    }
+    return *this;
+}
+
+SlowTask::~SlowTask(){
+    if(handle){
+        handle.destroy();
+    }
+}
+
+coroutine_handle<> SlowTask::await_suspend(coroutine_handle<> awaiting) noexcept {
+    /*
+    Transferência simétrica: quem aguarda fica suspenso e a tarefa começa na hora,
+    sem passar pela fila do escalonador.
+    */
+    handle.promise().continuation = awaiting;
+    return handle;
+}
+
+coroutine_handle<> SlowTask::promise_type::FinalAwaiter::await_suspend(coroutine_handle<promise_type> handle) noexcept {
+    /*
+    Fim da tarefa: retoma quem a aguardava ou, se ela pertence ao escalonador, avisa que
+    o quadro pode ser liberado.
+    */
+    promise_type & promise = handle.promise();
+    if(promise.continuation){
+        return promise.continuation;
+    }
+    if(promise.scheduler != nullptr){
+        promise.scheduler->taskFinished(handle);
+    }
+    return noop_coroutine();
+}
+
+SlowScheduler::SlowScheduler() : liveTasks(0){
+    epollFileDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    if(epollFileDescriptor < 0){
+        perror("epoll_create1");
+    }
+}
+
+SlowScheduler::~SlowScheduler(){
+    if(epollFileDescriptor >= 0){
+        close(epollFileDescriptor);
+    }
+}
+
+bool SlowScheduler::attach(Peripheral & peripheral){
+    /*
+    Registra o descritor de eventos do peripheral (depois de initNetwork()).
+    */
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = &peripheral;
+    if(epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, peripheral.getEventFileDescriptor(), &event) < 0){
+        perror("epoll_ctl (escalonador)");
+        return false;
+    }
+    return true;
+}
+
+void SlowScheduler::detach(Peripheral & peripheral){
+    epoll_ctl(epollFileDescriptor, EPOLL_CTL_DEL, peripheral.getEventFileDescriptor(), NULL);
+}
+
+void SlowScheduler::spawn(SlowTask task){
+    /*
+    Assume o quadro da tarefa e a coloca na fila de prontas.
+    */
+    coroutine_handle<SlowTask::promise_type> handle = exchange(task.handle, nullptr);
+    handle.promise().scheduler = this;
+    liveTasks++;
+    ready.push_back(handle);
+}
+
+void SlowScheduler::taskFinished(coroutine_handle<> handle){
+    // o quadro está suspenso no final_suspend: pode ser destruído depois de sair dele
+    ready.push_back(handle);
+}
+
+void SlowScheduler::resumeReady(){
+    /*
+    Retoma as corrotinas prontas. As que já terminaram (voltaram pela fila em
+    taskFinished()) são destruídas.
+    */
+    while(!ready.empty()){
+        coroutine_handle<> handle = ready.front();
+        ready.pop_front();
+        if(handle.done()){
+            handle.destroy();
+            liveTasks--;
+        }else{
+            handle.resume();
+        }
+    }
+}
+
+bool SlowScheduler::runOnce(chrono::milliseconds timeout){
+    /*
+    Retoma as corrotinas prontas, espera até timeout por algum peripheral (negativo espera
+    sem limite; com corrotinas prontas não espera) e roda o laço de eventos dos que ficaram
+    prontos.
+
+    return  false se o epoll falhar.
+    */
+    this->resumeReady();
+    if(liveTasks == 0){
+        return true;
+    }
+
+    int waitMs = ready.empty() ? (timeout.count() < 0 ? -1 : (int)min<int64_t>(timeout.count(), INT_MAX)) : 0;
+
+    struct epoll_event events[64];
+    int count = epoll_wait(epollFileDescriptor, events, 64, waitMs);
+    if(count < 0){
+        if(errno == EINTR){
+            return true;
+        }
+        perror("epoll_wait (escalonador)");
+        return false;
+    }
+
+    for(int i = 0; i < count; i++){
+        Peripheral * peripheral = static_cast<Peripheral *>(events[i].data.ptr);
+        peripheral->runOnce(chrono::milliseconds(0));
+    }
+
+    this->resumeReady();
+    return true;
+}
+
+bool SlowScheduler::run(){
+    /*
+    Roda até todas as tarefas entregues com spawn() terminarem.
+
+    return  false se o epoll falhar.
+    */
+    while(liveTasks > 0){
+        if(!this->runOnce(chrono::milliseconds(-1))){
+            return false;
+        }
+    }
+    return true;
+}
+
+void OperationAwaitable::await_suspend(coroutine_handle<> handle){
+    /*
+    O callback pode rodar antes mesmo de a chamada retornar (operação que falha na hora);
+    como ele só agenda a corrotina, a retomada acontece depois, no escalonador.
+    */
+    CompletionCallback onComplete = [this, handle](OperationId, bool result){
+        success = result;
+        scheduler.schedule(handle);
+    };
+
+    switch(kind){
+        case CoOperation::CONNECT:
+            peripheral.connectAsync(move(onComplete));
+            break;
+        case CoOperation::SEND:
+            peripheral.sendDataAsync(data, move(onComplete));
+            break;
+        case CoOperation::DISCONNECT:
+            peripheral.disconnectAsync(move(onComplete));
+            break;
+        case CoOperation::REVIVE:
+            peripheral.zeroWayConnectAsync(data, move(onComplete));
+            break;
+    }
+}
+
+CoPeripheral::~CoPeripheral(){
+    if(attached){
+        scheduler.detach(peripheral);
+    }
+}
+
+bool CoPeripheral::initNetwork(const char * hostName, int port){
+    /*
+    Inicializa o peripheral e o registra no escalonador.
+    */
+    if(!peripheral.initNetwork(hostName, port)){
+        return false;
+    }
+    attached = scheduler.attach(peripheral);
+    return attached;
+}
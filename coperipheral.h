@@ -0,0 +1,148 @@
+#ifndef COPERIPHERAL_H
+#define COPERIPHERAL_H
+
+#include "peripheral.h"
+
+#include <coroutine>
+#include <sys/epoll.h>
+
+class SlowScheduler;
+
+class SlowTask{
+    /*
+    Corrotina das operações do peripheral. Começa suspensa: ou é entregue ao escalonador
+    (SlowScheduler::spawn()), que passa a ser o dono do quadro, ou é aguardada por outra
+    corrotina (co_await task), que é retomada quando ela termina.
+    */
+    public:
+        struct promise_type{
+            SlowScheduler * scheduler = nullptr; // só nas tarefas entregues ao escalonador
+            coroutine_handle<> continuation;     // quem aguarda esta tarefa, se alguém
+
+            SlowTask get_return_object() { return SlowTask(coroutine_handle<promise_type>::from_promise(*this)); }
+            suspend_always initial_suspend() noexcept { return {}; }
+
+            struct FinalAwaiter{
+                bool await_ready() noexcept { return false; }
+                coroutine_handle<> await_suspend(coroutine_handle<promise_type> handle) noexcept;
+                void await_resume() noexcept {}
+            };
+            FinalAwaiter final_suspend() noexcept { return {}; }
+
+            void return_void() {}
+            void unhandled_exception() { terminate(); } // o protocolo não usa exceções: erro vira false nas operações
+        };
+
+        SlowTask(SlowTask && other) noexcept : handle(exchange(other.handle, nullptr)) {}
+        SlowTask & operator=(SlowTask && other) noexcept;
+        SlowTask(const SlowTask &) = delete;
+        SlowTask & operator=(const SlowTask &) = delete;
+        ~SlowTask();
+
+        // co_await task: começa a tarefa e retoma quem aguarda quando ela terminar
+        bool await_ready() const noexcept { return !handle || handle.done(); }
+        coroutine_handle<> await_suspend(coroutine_handle<> awaiting) noexcept;
+        void await_resume() const noexcept {}
+    private:
+        explicit SlowTask(coroutine_handle<promise_type> h) : handle(h) {}
+        coroutine_handle<promise_type> handle;
+
+        friend class SlowScheduler;
+};
+
+class SlowScheduler{
+    /*
+    Escalonador de uma thread para corrotinas de vários peripherals. Cada peripheral
+    registrado entra com o seu descritor de eventos (getEventFileDescriptor(): socket e
+    prazos de retransmissão); quando ele fica pronto, o escalonador roda runOnce(0) daquele
+    peripheral. Os callbacks das operações só colocam a corrotina na fila de prontas, e ela
+    é retomada fora do laço de eventos do peripheral, então pode começar a próxima operação
+    sem reentrância.
+    */
+    public:
+        SlowScheduler();
+        ~SlowScheduler();
+
+        bool attach(Peripheral & peripheral);
+        void detach(Peripheral & peripheral);
+
+        void spawn(SlowTask task);
+        void schedule(coroutine_handle<> handle) { ready.push_back(handle); }
+
+        bool run();
+        bool runOnce(chrono::milliseconds timeout);
+        size_t activeTasks() const { return liveTasks; }
+    private:
+        int epollFileDescriptor;
+        deque<coroutine_handle<>> ready;
+        size_t liveTasks;
+
+        void resumeReady();
+        void taskFinished(coroutine_handle<> handle);
+
+        friend struct SlowTask::promise_type::FinalAwaiter;
+};
+
+enum class CoOperation {
+    CONNECT,
+    SEND,
+    DISCONNECT,
+    REVIVE
+};
+
+class OperationAwaitable{
+    /*
+    co_await de uma operação do peripheral: começa a versão assíncrona (connectAsync(),
+    sendDataAsync()...) com um callback que devolve a corrotina ao escalonador.
+    O resultado do co_await é o success da operação.
+    */
+    public:
+        OperationAwaitable(Peripheral & peripheral, SlowScheduler & scheduler, CoOperation kind, string_view data = string_view())
+            : peripheral(peripheral), scheduler(scheduler), kind(kind), data(data) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> handle);
+        bool await_resume() const noexcept { return success; }
+    private:
+        Peripheral & peripheral;
+        SlowScheduler & scheduler;
+        CoOperation kind;
+        string_view data;
+        bool success = false;
+};
+
+class CoPeripheral{
+    /*
+    Peripheral com interface de corrotinas:
+
+        SlowTask session(CoPeripheral & p, string_view data){
+            bool connected = co_await p.connect();
+            if(connected){
+                co_await p.send(data);
+                co_await p.disconnect();
+            }
+        }
+
+    Os dados de send()/revive() não são copiados e precisam continuar válidos até o co_await retornar.
+    O g++ 12 gera código errado para co_await direto na condição de um if/while (o corpo da
+    corrotina nem começa): guarde o resultado numa variável, como acima.
+    */
+    public:
+        explicit CoPeripheral(SlowScheduler & scheduler) : scheduler(scheduler) {}
+        ~CoPeripheral();
+
+        bool initNetwork(const char * hostName, int port);
+
+        OperationAwaitable connect() { return OperationAwaitable(peripheral, scheduler, CoOperation::CONNECT); }
+        OperationAwaitable send(string_view data) { return OperationAwaitable(peripheral, scheduler, CoOperation::SEND, data); }
+        OperationAwaitable disconnect() { return OperationAwaitable(peripheral, scheduler, CoOperation::DISCONNECT); }
+        OperationAwaitable revive(string_view data) { return OperationAwaitable(peripheral, scheduler, CoOperation::REVIVE, data); }
+
+        Peripheral & get() { return peripheral; }
+    private:
+        SlowScheduler & scheduler;
+        Peripheral peripheral;
+        bool attached = false;
+};
+
+#endif
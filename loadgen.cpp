@@ -0,0 +1,562 @@
+#include "peripheral.h"
+#include "multiplexer.h"
+#include "logger.h"
+
+#include <csignal>
+#include <sys/resource.h>
+
+/*
+Gerador de carga do SLOW (make slow_loadgen).
+
+Muitas sessões simultâneas contra uma central (central_slow local por padrão), todas
+numa única thread, cada uma rodando um roteiro de operações. Mede handshakes/s,
+mensagens/s, bytes/s e os percentis de latência de cada tipo de operação.
+
+    ./slow_loadgen [-h host] [-p porta] [-c sessões] [-r taxa] [-d segundos] [-s roteiro] [-m sockets]
+                   [-a newreno|bbr|none]
+
+    -c  sessões simultâneas (padrão 1000)
+    -r  open loop: novas sessões por segundo, a taxa fixa; cada chegada ocupa uma das -c
+        sessões e, se todas estiverem ocupadas, espera na fila pela próxima que vagar.
+        A latência conta do instante em que a chegada estava marcada, com a espera na
+        fila (sem omissão coordenada).
+        Sem -r é closed loop: cada sessão recomeça o roteiro assim que termina.
+    -d  duração das chegadas em segundos (padrão 10); depois disso só terminam as em andamento
+        e as da fila; as que não terminarem em LOADGEN_DRAIN_TIMEOUT entram nos percentis do
+        roteiro com a latência até lá
+    -s  roteiro: passos separados por vírgula (padrão "connect,send:1024,disconnect")
+            connect | send:BYTES[xVEZES] | revive:BYTES | disconnect
+    -m  usa o SessionMultiplexer com esse número de sockets em vez de um Peripheral
+        (um socket) por sessão; o multiplexador não faz revive
+    -a  controle de congestionamento das sessões (padrão newreno; none só respeita a
+        janela anunciada pela central)
+*/
+
+using LoadClock = chrono::steady_clock;
+
+const chrono::seconds LOADGEN_DRAIN_TIMEOUT{10}; // espera pelas sessões em andamento depois da duração
+
+enum class LoadOperation {
+    CONNECT,
+    SEND,
+    REVIVE,
+    DISCONNECT,
+    COUNT
+};
+
+const char * LOAD_OPERATION_NAMES[] = {"connect", "send", "revive", "disconnect"};
+
+struct LoadStep {
+    LoadOperation operation;
+    size_t bytes = 0;
+    int repeat = 1;
+};
+
+struct LoadSession {
+    size_t step = 0;
+    int repeat = 0;         // quantas vezes o passo atual já rodou
+    bool busy = false;
+    LoadClock::time_point arrival;   // instante marcado da chegada que a sessão atende
+    LoadClock::time_point stepStart;
+};
+
+struct OperationStats {
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    uint64_t bytes = 0;
+    vector<float> latencyUs; // só das operações bem-sucedidas
+};
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void handleSignal(int){
+    interrupted = 1;
+}
+
+class LoadTarget{
+    /*
+    Para onde vão as operações: um Peripheral por sessão ou um SessionMultiplexer.
+    Os dois têm a mesma API assíncrona (callback de conclusão).
+    */
+    public:
+        virtual ~LoadTarget() {}
+        virtual bool open(const char * host, int port, int sessions) = 0;
+        virtual void start(int session, LoadOperation operation, string_view data, CompletionCallback onComplete) = 0;
+        virtual bool runOnce(chrono::milliseconds timeout) = 0;
+};
+
+class PeripheralTarget : public LoadTarget{
+    /*
+    Um Peripheral (socket, epoll e timerfd próprios) por sessão, com um epoll por cima
+    de todos, como o SlowScheduler.
+    */
+    public:
+        explicit PeripheralTarget(CongestionAlgorithm algorithm) : algorithm(algorithm) {}
+
+        ~PeripheralTarget(){
+            if(epollFileDescriptor >= 0){
+                close(epollFileDescriptor);
+            }
+        }
+
+        bool open(const char * host, int port, int sessions) override {
+            epollFileDescriptor = epoll_create1(EPOLL_CLOEXEC);
+            if(epollFileDescriptor < 0){
+                perror("epoll_create1");
+                return false;
+            }
+            for(int i = 0; i < sessions; i++){
+                peripherals.push_back(make_unique<Peripheral>());
+                if(!peripherals.back()->initNetwork(host, port)){
+                    return false;
+                }
+                peripherals.back()->setCongestionAlgorithm(algorithm);
+                struct epoll_event event;
+                event.events = EPOLLIN;
+                event.data.u32 = i;
+                if(epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, peripherals.back()->getEventFileDescriptor(), &event) < 0){
+                    perror("epoll_ctl");
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void start(int session, LoadOperation operation, string_view data, CompletionCallback onComplete) override {
+            Peripheral & peripheral = *peripherals[session];
+            switch(operation){
+                case LoadOperation::CONNECT:
+                    peripheral.connectAsync(move(onComplete));
+                    break;
+                case LoadOperation::SEND:
+                    peripheral.sendDataAsync(data, move(onComplete));
+                    break;
+                case LoadOperation::REVIVE:
+                    peripheral.zeroWayConnectAsync(data, move(onComplete));
+                    break;
+                default:
+                    peripheral.disconnectAsync(move(onComplete));
+                    break;
+            }
+        }
+
+        bool runOnce(chrono::milliseconds timeout) override {
+            struct epoll_event events[256];
+            int count = epoll_wait(epollFileDescriptor, events, 256, (int)timeout.count());
+            if(count < 0){
+                return errno == EINTR;
+            }
+            for(int i = 0; i < count; i++){
+                peripherals[events[i].data.u32]->runOnce(chrono::milliseconds(0));
+            }
+            return true;
+        }
+    private:
+        int epollFileDescriptor = -1;
+        CongestionAlgorithm algorithm;
+        vector<unique_ptr<Peripheral>> peripherals;
+};
+
+class MultiplexerTarget : public LoadTarget{
+    public:
+        MultiplexerTarget(int sockets, CongestionAlgorithm algorithm) : sockets(sockets) {
+            mux.setCongestionAlgorithm(algorithm);
+        }
+
+        bool open(const char * host, int port, int sessions) override {
+            if(!mux.initNetwork(host, port, sockets)){
+                return false;
+            }
+            for(int i = 0; i < sessions; i++){
+                ids.push_back(mux.openSession());
+            }
+            return true;
+        }
+
+        void start(int session, LoadOperation operation, string_view data, CompletionCallback onComplete) override {
+            switch(operation){
+                case LoadOperation::CONNECT:
+                    if(mux.isConnected(ids[session])){
+                        // roteiro anterior falhou no meio: a sessão velha é abandonada (expira na central)
+                        mux.closeSession(ids[session]);
+                        ids[session] = mux.openSession();
+                    }
+                    mux.connectAsync(ids[session], move(onComplete));
+                    break;
+                case LoadOperation::SEND:
+                    mux.sendDataAsync(ids[session], data, move(onComplete));
+                    break;
+                case LoadOperation::DISCONNECT:
+                    mux.disconnectAsync(ids[session], move(onComplete));
+                    break;
+                default:
+                    onComplete(0, false); // revive é recusado na leitura do roteiro
+                    break;
+            }
+        }
+
+        bool runOnce(chrono::milliseconds timeout) override {
+            return mux.runOnce(timeout) >= 0;
+        }
+    private:
+        int sockets;
+        SessionMultiplexer mux;
+        vector<MuxSessionId> ids;
+};
+
+class LoadGenerator{
+    /*
+    Roda os roteiros. Cada passo começa no callback do anterior; o recomeço de um roteiro
+    (closed loop) e as chegadas (open loop) ficam para o laço principal, para que uma
+    sequência de falhas imediatas não vire recursão.
+    */
+    public:
+        LoadGenerator(LoadTarget & target, const vector<LoadStep> & script, int sessionCount)
+            : target(target), script(script), sessions(sessionCount), stats((size_t)LoadOperation::COUNT){
+            size_t largest = 0;
+            for(const LoadStep & step : script){
+                largest = max(largest, step.bytes);
+            }
+            payload.assign(largest, 'L');
+            for(int i = sessionCount - 1; i >= 0; i--){
+                idle.push_back(i);
+            }
+        }
+
+        void run(double rate, chrono::seconds duration){
+            /*
+            rate > 0: open loop a rate sessões/s; rate == 0: closed loop com todas as sessões.
+            */
+            LoadClock::time_point start = LoadClock::now();
+            LoadClock::time_point end = start + duration;
+            uint64_t arrivals = 0;
+            LoadClock::time_point now = start;
+
+            closedLoop = rate <= 0;
+            if(closedLoop){
+                while(!idle.empty()){
+                    ready.push_back(idle.back());
+                    idle.pop_back();
+                }
+            }
+
+            while(!interrupted){
+                now = LoadClock::now();
+                bool arriving = now < end;
+
+                if(arriving && rate > 0){
+                    uint64_t due = (uint64_t)(chrono::duration<double>(now - start).count() * rate);
+                    for(; arrivals < due; arrivals++){
+                        waiting.push_back(start + chrono::duration_cast<LoadClock::duration>(chrono::duration<double>(arrivals / rate)));
+                    }
+                }
+
+                // open loop: a chegada mais antiga da fila fica com a sessão que vagou, inclusive depois da duração
+                while(!waiting.empty() && !idle.empty()){
+                    int id = idle.back();
+                    idle.pop_back();
+                    LoadClock::time_point arrival = waiting.front();
+                    waiting.pop_front();
+                    this->beginScript(id, arrival);
+                }
+                maxWaiting = max(maxWaiting, waiting.size());
+
+                for(size_t i = 0; i < ready.size(); i++){
+                    if(arriving){
+                        this->beginScript(ready[i], now);
+                    }else{
+                        idle.push_back(ready[i]);
+                    }
+                }
+                ready.clear();
+
+                if(!arriving && busySessions == 0 && waiting.empty()){
+                    break;
+                }
+                if(!arriving && now > end + LOADGEN_DRAIN_TIMEOUT){
+                    break;
+                }
+
+                // open loop acorda a cada milissegundo para as chegadas; closed loop só pelos eventos
+                if(!target.runOnce(chrono::milliseconds(rate > 0 ? 1 : 100))){
+                    perror("laço de eventos");
+                    break;
+                }
+            }
+            elapsed = chrono::duration<double>(LoadClock::now() - start).count();
+
+            // o que não terminou (na fila ou em andamento) entra nos percentis do roteiro com a latência até aqui
+            for(LoadClock::time_point arrival : waiting){
+                this->censorScript(arrival, now);
+            }
+            waiting.clear();
+            for(const LoadSession & session : sessions){
+                if(session.busy){
+                    this->censorScript(session.arrival, now);
+                }
+            }
+        }
+
+        void report(const char * mode, const char * transport, const string & scriptText) const {
+            printf("slow_loadgen: %s, %zu sessões (%s), roteiro %s, %.1f s\n",
+                   mode, sessions.size(), transport, scriptText.c_str(), elapsed);
+            printf("  roteiros completos %10" PRIu64 "  %10.1f/s   falhos %" PRIu64 "   não terminados %" PRIu64 "   fila máx %zu\n",
+                   scripts.completed, scripts.completed / elapsed, scripts.failed, unfinished, maxWaiting);
+
+            const OperationStats & connects = stats[(size_t)LoadOperation::CONNECT];
+            const OperationStats & revives = stats[(size_t)LoadOperation::REVIVE];
+            uint64_t messages = stats[(size_t)LoadOperation::SEND].completed + revives.completed;
+            uint64_t bytes = stats[(size_t)LoadOperation::SEND].bytes + revives.bytes;
+            printf("  handshakes/s %12.1f\n", (connects.completed + revives.completed) / elapsed);
+            printf("  mensagens/s  %12.1f\n", messages / elapsed);
+            printf("  bytes/s      %12.1f MB/s\n", bytes / elapsed / 1e6);
+
+            printf("  %-11s %10s %8s %10s %10s %10s\n", "operação", "ok", "falhas", "p50 us", "p99 us", "p99.9 us");
+            for(size_t i = 0; i <= stats.size(); i++){
+                // a última linha é o roteiro inteiro, da chegada marcada ao fim (com os não terminados)
+                const OperationStats & operation = i < stats.size() ? stats[i] : scripts;
+                if(operation.completed + operation.failed == 0){
+                    continue;
+                }
+                vector<float> samples = operation.latencyUs;
+                printf("  %-10s %10" PRIu64 " %8" PRIu64 " %10.1f %10.1f %10.1f\n", i < stats.size() ? LOAD_OPERATION_NAMES[i] : "roteiro",
+                       operation.completed, operation.failed,
+                       percentile(samples, 0.50), percentile(samples, 0.99), percentile(samples, 0.999));
+            }
+        }
+    private:
+        LoadTarget & target;
+        const vector<LoadStep> & script;
+        vector<LoadSession> sessions;
+        vector<OperationStats> stats;
+        string payload;
+
+        vector<int> idle;  // sessões livres (open loop)
+        vector<int> ready; // sessões para começar o roteiro na próxima volta do laço
+        deque<LoadClock::time_point> waiting; // chegadas (open loop) esperando uma sessão livre
+        size_t maxWaiting = 0;
+        size_t busySessions = 0;
+        bool closedLoop = true;
+        OperationStats scripts; // roteiros inteiros
+        uint64_t unfinished = 0;
+        double elapsed = 0;
+
+        static double percentile(vector<float> & samples, double p){
+            if(samples.empty()){
+                return 0;
+            }
+            size_t index = min(samples.size() - 1, (size_t)(p * samples.size()));
+            nth_element(samples.begin(), samples.begin() + index, samples.end());
+            return samples[index];
+        }
+
+        void beginScript(int id, LoadClock::time_point arrival){
+            LoadSession & session = sessions[id];
+            session.busy = true;
+            session.step = 0;
+            session.repeat = 0;
+            session.arrival = arrival;
+            busySessions++;
+            this->startStep(id);
+        }
+
+        void startStep(int id){
+            // o primeiro passo conta da chegada marcada: a espera por uma sessão livre entra na latência dele
+            LoadSession & session = sessions[id];
+            const LoadStep & step = script[session.step];
+            session.stepStart = session.step == 0 && session.repeat == 0 ? session.arrival : LoadClock::now();
+            target.start(id, step.operation, string_view(payload).substr(0, step.bytes),
+                         [this, id](OperationId, bool success){ this->stepFinished(id, success); });
+        }
+
+        void stepFinished(int id, bool success){
+            LoadSession & session = sessions[id];
+            const LoadStep & step = script[session.step];
+            OperationStats & operation = stats[(size_t)step.operation];
+
+            if(!success){
+                // o roteiro desta sessão termina aqui; um Disconnect pendente fica para a próxima rodada
+                operation.failed++;
+                scripts.failed++;
+                this->endScript(id);
+                return;
+            }
+            operation.completed++;
+            operation.bytes += step.bytes;
+            operation.latencyUs.push_back(chrono::duration<float, micro>(LoadClock::now() - session.stepStart).count());
+
+            if(++session.repeat < step.repeat){
+                this->startStep(id);
+                return;
+            }
+            session.repeat = 0;
+            if(++session.step < script.size()){
+                this->startStep(id);
+                return;
+            }
+            scripts.completed++;
+            scripts.latencyUs.push_back(chrono::duration<float, micro>(LoadClock::now() - session.arrival).count());
+            this->endScript(id);
+        }
+
+        void censorScript(LoadClock::time_point arrival, LoadClock::time_point now){
+            unfinished++;
+            scripts.failed++;
+            scripts.latencyUs.push_back(chrono::duration<float, micro>(now - arrival).count());
+        }
+
+        void endScript(int id){
+            // closed loop recomeça na próxima volta do laço; open loop espera a próxima chegada
+            sessions[id].busy = false;
+            busySessions--;
+            if(closedLoop){
+                ready.push_back(id);
+            }else{
+                idle.push_back(id);
+            }
+        }
+};
+
+static bool parseScript(const string & text, vector<LoadStep> & script){
+    /*
+    "connect,send:1024x4,disconnect,revive:512,disconnect" -> passos do roteiro.
+    */
+    stringstream stream(text);
+    string item;
+    while(getline(stream, item, ',')){
+        LoadStep step;
+        string name = item.substr(0, item.find(':'));
+        string argument = item.find(':') == string::npos ? "" : item.substr(item.find(':') + 1);
+
+        if(name == "connect"){
+            step.operation = LoadOperation::CONNECT;
+        }else if(name == "send"){
+            step.operation = LoadOperation::SEND;
+        }else if(name == "revive"){
+            step.operation = LoadOperation::REVIVE;
+        }else if(name == "disconnect"){
+            step.operation = LoadOperation::DISCONNECT;
+        }else{
+            printf("Passo desconhecido no roteiro: %s\n", item.c_str());
+            return false;
+        }
+
+        if(!argument.empty()){
+            size_t times = argument.find('x');
+            step.bytes = strtoull(argument.c_str(), nullptr, 10);
+            if(times != string::npos){
+                step.repeat = max(1, atoi(argument.c_str() + times + 1));
+            }
+        }
+        script.push_back(step);
+    }
+    return !script.empty();
+}
+
+static void raiseFileLimit(int sessions){
+    // cada Peripheral usa três descritores (socket, epoll e timerfd)
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max){
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && (rlim_t)sessions * 3 + 64 > limit.rlim_cur){
+        printf("Aviso: %d sessões precisam de ~%d descritores e o limite é %llu (use -m)\n",
+               sessions, sessions * 3 + 64, (unsigned long long)limit.rlim_cur);
+    }
+}
+
+int main(int argc, char ** argv){
+    const char * host = "127.0.0.1";
+    int port = 7033;
+    int sessions = 1000;
+    double rate = 0;
+    int duration = 10;
+    string scriptText = "connect,send:1024,disconnect";
+    int muxSockets = 0;
+    CongestionAlgorithm algorithm = CongestionAlgorithm::NEWRENO;
+    bool validArguments = true;
+
+    for(int i = 1; i < argc; i++){
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "-h" && hasValue){
+            host = argv[++i];
+        }else if(arg == "-p" && hasValue){
+            port = atoi(argv[++i]);
+        }else if(arg == "-c" && hasValue){
+            sessions = max(1, atoi(argv[++i]));
+        }else if(arg == "-r" && hasValue){
+            rate = atof(argv[++i]);
+        }else if(arg == "-d" && hasValue){
+            duration = max(1, atoi(argv[++i]));
+        }else if(arg == "-s" && hasValue){
+            scriptText = argv[++i];
+        }else if(arg == "-a" && hasValue){
+            string name = argv[++i];
+            if(name != "newreno" && name != "bbr" && name != "none"){
+                validArguments = false;
+            }
+            algorithm = name == "bbr" ? CongestionAlgorithm::BBR :
+                        name == "none" ? CongestionAlgorithm::NONE : CongestionAlgorithm::NEWRENO;
+        }else if(arg == "-m"){
+            muxSockets = hasValue && isdigit((unsigned char)argv[i + 1][0]) ? max(1, atoi(argv[++i])) : 1;
+        }else{
+            validArguments = false; // opção desconhecida ou sem o valor
+        }
+    }
+    if(!validArguments){
+        printf("Uso: %s [-h host] [-p porta] [-c sessões] [-r taxa] [-d segundos] [-s roteiro] [-m sockets] "
+               "[-a newreno|bbr|none]\n", argv[0]);
+        return 1;
+    }
+
+    vector<LoadStep> script;
+    if(!parseScript(scriptText, script)){
+        return 1;
+    }
+    if(muxSockets > 0){
+        for(const LoadStep & step : script){
+            if(step.operation == LoadOperation::REVIVE){
+                printf("O multiplexador não faz revive: rode sem -m\n");
+                return 1;
+            }
+        }
+    }else{
+        raiseFileLimit(sessions);
+    }
+
+    unique_ptr<LoadTarget> target;
+    if(muxSockets > 0){
+        target = make_unique<MultiplexerTarget>(muxSockets, algorithm);
+    }else{
+        target = make_unique<PeripheralTarget>(algorithm);
+    }
+
+    // Peripheral e multiplexador registram cada handshake: desliga o log durante a carga
+    LogLevel originalLevel = slowLogger().getLevel();
+    slowLogger().setLevel(LogLevel::OFF);
+    bool opened = target->open(host, port, sessions);
+    if(!opened){
+        printf("Falha ao abrir as sessões para %s:%d\n", host, port);
+        return 1;
+    }
+
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+
+    LoadGenerator generator(*target, script, sessions);
+    generator.run(rate, chrono::seconds(duration));
+
+    char mode[64];
+    if(rate > 0){
+        snprintf(mode, sizeof(mode), "open loop %.0f sessões/s", rate);
+    }else{
+        snprintf(mode, sizeof(mode), "closed loop");
+    }
+    generator.report(mode, muxSockets > 0 ? "multiplexador" : "Peripheral", scriptText);
+
+    target.reset(); // os destrutores dos peripherals também registram
+    slowLogger().setLevel(originalLevel);
+    return 0;
+}
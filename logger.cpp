@@ -0,0 +1,214 @@
+#include "logger.h"
+
+#include <unistd.h>
+
+SlowLogger & slowLogger(){
+    // criado no primeiro uso; o destrutor (na saída do programa) escreve o que faltou
+    static SlowLogger logger;
+    return logger;
+}
+
+static LogLevel levelFromEnvironment(){
+    const char * name = getenv("SLOW_LOG");
+    if(name == nullptr){
+        return LogLevel::INFO;
+    }
+    string value = name;
+    if(value == "trace") return LogLevel::TRACE;
+    if(value == "debug") return LogLevel::DEBUG;
+    if(value == "warn") return LogLevel::WARN;
+    if(value == "error") return LogLevel::ERROR;
+    if(value == "off") return LogLevel::OFF;
+    return LogLevel::INFO;
+}
+
+SlowLogger::SlowLogger() : slots(LOG_RING_SLOTS), enqueuePosition(0), writtenPosition(0), droppedMessages(0),
+    runtimeLevel((uint8_t)levelFromEnvironment()), stopping(false), writerSleeping(false), flushWaiters(0){
+    /*
+    Cada slot começa com sequence == índice: livre para a volta 0 da fila (fila limitada de
+    Vyukov). O produtor que o ocupa publica sequence = posição + 1; o consumidor o devolve
+    com sequence = posição + LOG_RING_SLOTS, liberando-o para a próxima volta.
+    */
+    for(size_t i = 0; i < slots.size(); i++){
+        slots[i].sequence.store(i, memory_order_relaxed);
+    }
+    writer = thread([this]{ this->drain(); });
+}
+
+SlowLogger::~SlowLogger(){
+    stopping.store(true);
+    writerSleeping.store(false); // depois de stopping: se a thread de escrita dormir, já vê stopping
+    {
+        lock_guard<mutex> guard(wakeMutex);
+    }
+    wakeWriter.notify_one();
+    if(writer.joinable()){
+        writer.join();
+    }
+}
+
+SlowLogger::Slot * SlowLogger::claim(uint64_t & position){
+    /*
+    Reserva o próximo slot da fila para um produtor.
+
+    return  o slot (a ser publicado com sequence = position + 1); nullptr se a fila está cheia.
+    */
+    position = enqueuePosition.load(memory_order_relaxed);
+    while(true){
+        Slot & slot = slots[position & (LOG_RING_SLOTS - 1)];
+        uint64_t sequence = slot.sequence.load(memory_order_acquire);
+        int64_t difference = (int64_t)(sequence - position);
+        if(difference == 0){
+            if(enqueuePosition.compare_exchange_weak(position, position + 1, memory_order_relaxed)){
+                return &slot;
+            }
+        }else if(difference < 0){
+            droppedMessages.fetch_add(1, memory_order_relaxed);
+            return nullptr;
+        }else{
+            position = enqueuePosition.load(memory_order_relaxed);
+        }
+    }
+}
+
+void SlowLogger::wake(){
+    /*
+    Acorda a thread de escrita que dormiu com a fila vazia. Só o primeiro produtor depois
+    que ela dormiu passa daqui (exchange); os outros da mesma rajada não fazem chamada ao sistema.
+    */
+    if(!writerSleeping.exchange(false)){
+        return;
+    }
+    {
+        lock_guard<mutex> guard(wakeMutex); // ela pode estar entre testar o predicado e dormir
+    }
+    wakeWriter.notify_one();
+}
+
+void SlowLogger::encodeText(LogRecord & record, const char * data, size_t size){
+    size_t room = LOG_TEXT_SIZE - record.textSize;
+    if(size > room){
+        // truncado: termina com "..." para não parecer a mensagem inteira
+        size = room;
+        memcpy(record.text + record.textSize, data, size);
+        if(size >= 3){
+            memcpy(record.text + record.textSize + size - 3, "...", 3);
+        }
+    }else{
+        memcpy(record.text + record.textSize, data, size);
+    }
+    push(record, LogArgType::TEXT, ((uint64_t)record.textSize << 32) | size);
+    record.textSize += size;
+}
+
+void SlowLogger::format(const LogRecord & record, string & out) const{
+    char number[32];
+    for(int i = 0; i < record.argCount; i++){
+        uint64_t value = record.values[i];
+        switch(record.types[i]){
+            case LogArgType::TEXT:
+                out.append(record.text + (value >> 32), value & 0xffffffff);
+                break;
+            case LogArgType::SIGNED:
+                out.append(number, to_chars(number, number + sizeof(number), (int64_t)value).ptr);
+                break;
+            case LogArgType::UNSIGNED:
+                out.append(number, to_chars(number, number + sizeof(number), value).ptr);
+                break;
+            case LogArgType::FLOATING: {
+                double floating;
+                memcpy(&floating, &value, sizeof(floating));
+                out.append(number, snprintf(number, sizeof(number), "%g", floating)); // como o cout
+                break;
+            }
+            case LogArgType::CHARACTER:
+                out.push_back((char)value);
+                break;
+            case LogArgType::BOOLEAN:
+                out.push_back(value ? '1' : '0');
+                break;
+        }
+    }
+    out.push_back('\n');
+}
+
+void SlowLogger::drain(){
+    /*
+    Thread de escrita: tira as mensagens publicadas em ordem, formata num buffer e o
+    escreve de uma vez (um fwrite por rodada, não um write por mensagem). Com a fila vazia
+    dorme em wakeWriter até um produtor publicar (ver wake()): parada não acorda sozinha.
+    */
+    string buffer;
+    uint64_t position = 0;
+    uint64_t reportedDrops = 0;
+
+    while(true){
+        bool stop = stopping.load(memory_order_acquire);
+
+        while(true){
+            Slot & slot = slots[position & (LOG_RING_SLOTS - 1)];
+            if(slot.sequence.load(memory_order_acquire) != position + 1){
+                break;
+            }
+            this->format(slot.record, buffer);
+            slot.sequence.store(position + LOG_RING_SLOTS, memory_order_release);
+            position++;
+            if(buffer.size() >= 64 * 1024){
+                fwrite(buffer.data(), 1, buffer.size(), stdout);
+                buffer.clear();
+            }
+        }
+
+        uint64_t drops = droppedMessages.load(memory_order_relaxed);
+        if(drops != reportedDrops){
+            buffer += "[log] " + to_string(drops - reportedDrops) + " mensagens descartadas (fila cheia)\n";
+            reportedDrops = drops;
+        }
+        if(!buffer.empty()){
+            fwrite(buffer.data(), 1, buffer.size(), stdout);
+            fflush(stdout);
+            buffer.clear();
+        }
+        writtenPosition.store(position);
+        if(flushWaiters.load() > 0){
+            lock_guard<mutex> guard(wakeMutex);
+            written.notify_all();
+        }
+
+        if(stop){
+            return; // stopping foi lido antes da última drenagem: nada publicado antes dele ficou para trás
+        }
+
+        /*
+        Anuncia que vai dormir e só então confere a fila de novo: com as cercas dos dois
+        lados, um produtor que publicou depois da conferência vê writerSleeping e a acorda.
+        */
+        writerSleeping.store(true, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        Slot & next = slots[position & (LOG_RING_SLOTS - 1)];
+        if(next.sequence.load(memory_order_acquire) == position + 1 || stopping.load()
+            || droppedMessages.load(memory_order_relaxed) != reportedDrops){
+            writerSleeping.store(false, memory_order_relaxed);
+            continue;
+        }
+        unique_lock<mutex> lock(wakeMutex);
+        wakeWriter.wait(lock, [this]{ return !writerSleeping.load(memory_order_acquire); });
+    }
+}
+
+void SlowLogger::flush(){
+    /*
+    Espera até tudo o que já foi registrado estar escrito. Para intercalar o log com
+    saída direta no terminal (ex.: os prompts do main.cpp) na ordem certa.
+    */
+    uint64_t target = enqueuePosition.load(memory_order_acquire);
+    if(!writer.joinable()){
+        return;
+    }
+    // a thread de escrita avisa em written a cada rodada enquanto houver alguém aqui
+    flushWaiters.fetch_add(1);
+    unique_lock<mutex> lock(wakeMutex);
+    written.wait(lock, [this, target]{ return writtenPosition.load() >= target; });
+    lock.unlock();
+    flushWaiters.fetch_sub(1);
+}
@@ -0,0 +1,184 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <bits/stdc++.h>
+
+using namespace std;
+
+// níveis como números, para poderem vir do compilador (-DSLOW_LOG_LEVEL=1)
+#define SLOW_LOG_LEVEL_TRACE 0
+#define SLOW_LOG_LEVEL_DEBUG 1
+#define SLOW_LOG_LEVEL_INFO  2
+#define SLOW_LOG_LEVEL_WARN  3
+#define SLOW_LOG_LEVEL_ERROR 4
+#define SLOW_LOG_LEVEL_OFF   5
+
+// abaixo deste nível as chamadas nem são compiladas (nem os argumentos são avaliados)
+#ifndef SLOW_LOG_LEVEL
+#define SLOW_LOG_LEVEL SLOW_LOG_LEVEL_INFO
+#endif
+
+enum class LogLevel : uint8_t {
+    TRACE = SLOW_LOG_LEVEL_TRACE, // cada campo de cada pacote
+    DEBUG = SLOW_LOG_LEVEL_DEBUG, // cada pacote (envio, retransmissão, timeout)
+    INFO  = SLOW_LOG_LEVEL_INFO,  // eventos de sessão (conexão, revive, desconexão)
+    WARN  = SLOW_LOG_LEVEL_WARN,
+    ERROR = SLOW_LOG_LEVEL_ERROR,
+    OFF   = SLOW_LOG_LEVEL_OFF
+};
+
+constexpr bool logCompiled(LogLevel level){
+    // com SLOW_LOG_LEVEL 0 tudo é compilado; a comparação (sempre verdadeira) geraria -Wtype-limits
+#if SLOW_LOG_LEVEL <= SLOW_LOG_LEVEL_TRACE
+    (void)level;
+    return true;
+#else
+    return (int)level >= SLOW_LOG_LEVEL;
+#endif
+}
+
+#define SLOW_LOG(level, ...) \
+    do{ \
+        if constexpr(logCompiled(level)){ \
+            SlowLogger & slowLogger_ = slowLogger(); \
+            if(slowLogger_.enabled(level)){ \
+                slowLogger_.log(level, __VA_ARGS__); \
+            } \
+        } \
+    }while(0)
+
+#define SLOW_LOG_TRACE(...) SLOW_LOG(LogLevel::TRACE, __VA_ARGS__)
+#define SLOW_LOG_DEBUG(...) SLOW_LOG(LogLevel::DEBUG, __VA_ARGS__)
+#define SLOW_LOG_INFO(...)  SLOW_LOG(LogLevel::INFO, __VA_ARGS__)
+#define SLOW_LOG_WARN(...)  SLOW_LOG(LogLevel::WARN, __VA_ARGS__)
+#define SLOW_LOG_ERROR(...) SLOW_LOG(LogLevel::ERROR, __VA_ARGS__)
+
+const size_t LOG_RING_SLOTS = 4096;  // potência de 2
+const int LOG_MAX_ARGS = 12;
+const size_t LOG_TEXT_SIZE = 480;    // bytes de texto copiados por mensagem (o resto é truncado)
+
+enum class LogArgType : uint8_t {
+    TEXT,      // value = (deslocamento << 32) | tamanho dentro de text
+    SIGNED,
+    UNSIGNED,
+    FLOATING,
+    CHARACTER,
+    BOOLEAN
+};
+
+struct LogRecord {
+    /*
+    Uma mensagem ainda não formatada: os argumentos como vieram (inteiros, double, texto
+    copiado), na ordem em que seriam escritos com <<. A formatação fica para a thread de escrita.
+    */
+    LogLevel level;
+    uint8_t argCount;
+    uint16_t textSize;
+    LogArgType types[LOG_MAX_ARGS];
+    uint64_t values[LOG_MAX_ARGS];
+    char text[LOG_TEXT_SIZE];
+};
+
+class SlowLogger{
+    /*
+    Log com níveis para o caminho quente. Uma chamada habilitada só copia os argumentos para
+    um slot de uma fila circular sem trava (vários produtores, um consumidor: as threads da
+    Central também registram) e volta; uma thread de fundo formata as mensagens e as escreve
+    em lote no stdout. Com a fila cheia a mensagem é descartada (e contada), nunca bloqueia.
+
+    Use pelas macros (SLOW_LOG_INFO("Conexão aceita, sttl ", sttl)): os argumentos são
+    concatenados como no cout e a quebra de linha é acrescentada. O nível em tempo de
+    execução começa em INFO ou no da variável de ambiente SLOW_LOG (trace, debug, info,
+    warn, error, off).
+    */
+    public:
+        SlowLogger();
+        ~SlowLogger();
+
+        bool enabled(LogLevel level) const { return (uint8_t)level >= runtimeLevel.load(memory_order_relaxed); }
+        void setLevel(LogLevel level) { runtimeLevel.store((uint8_t)level, memory_order_relaxed); }
+        LogLevel getLevel() const { return (LogLevel)runtimeLevel.load(memory_order_relaxed); }
+
+        template<class... Args>
+        void log(LogLevel level, const Args &... args){
+            static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "mensagem de log com argumentos demais");
+            uint64_t position;
+            Slot * slot = this->claim(position);
+            if(slot == nullptr){
+                return;
+            }
+            LogRecord & record = slot->record;
+            record.level = level;
+            record.argCount = 0;
+            record.textSize = 0;
+            (this->encode(record, args), ...);
+            slot->sequence.store(position + 1, memory_order_release);
+            // par da cerca de drain(): ou a thread de escrita vê esta mensagem, ou este produtor a vê dormindo
+            atomic_thread_fence(memory_order_seq_cst);
+            if(writerSleeping.load(memory_order_relaxed)){
+                this->wake();
+            }
+        }
+
+        void flush();
+        uint64_t dropped() const { return droppedMessages.load(memory_order_relaxed); }
+    private:
+        struct Slot {
+            atomic<uint64_t> sequence;
+            LogRecord record;
+        };
+
+        vector<Slot> slots;
+        alignas(64) atomic<uint64_t> enqueuePosition;
+        alignas(64) atomic<uint64_t> writtenPosition; // tudo antes disto já foi escrito
+        alignas(64) atomic<uint64_t> droppedMessages;
+        atomic<uint8_t> runtimeLevel;
+        atomic<bool> stopping;
+        alignas(64) atomic<bool> writerSleeping;  // thread de escrita parada em wakeWriter, com a fila vazia
+        atomic<uint32_t> flushWaiters;            // threads paradas em flush(), esperando writtenPosition
+        mutex wakeMutex;
+        condition_variable wakeWriter;
+        condition_variable written;
+        thread writer;
+
+        Slot * claim(uint64_t & position);
+        void wake();
+        void drain();
+        void format(const LogRecord & record, string & out) const;
+
+        void encodeText(LogRecord & record, const char * data, size_t size);
+        void encode(LogRecord & record, const char * text) { encodeText(record, text ? text : "(null)", text ? strlen(text) : 6); }
+        void encode(LogRecord & record, const string & text) { encodeText(record, text.data(), text.size()); }
+        void encode(LogRecord & record, string_view text) { encodeText(record, text.data(), text.size()); }
+        void encode(LogRecord & record, char value) { push(record, LogArgType::CHARACTER, (uint64_t)(unsigned char)value); }
+        void encode(LogRecord & record, bool value) { push(record, LogArgType::BOOLEAN, value); }
+
+        template<class T>
+        void encode(LogRecord & record, T value){
+            if constexpr(is_pointer_v<T> && is_same_v<remove_cv_t<remove_pointer_t<T>>, char>){
+                encode(record, (const char *)value); // char * sem const
+            }else if constexpr(is_floating_point_v<T>){
+                double number = value;
+                uint64_t bits;
+                memcpy(&bits, &number, sizeof(bits));
+                push(record, LogArgType::FLOATING, bits);
+            }else if constexpr(is_enum_v<T>){
+                push(record, LogArgType::SIGNED, (uint64_t)(int64_t)value);
+            }else if constexpr(is_signed_v<T>){
+                push(record, LogArgType::SIGNED, (uint64_t)(int64_t)value);
+            }else{
+                static_assert(is_unsigned_v<T>, "tipo sem formatação no log");
+                push(record, LogArgType::UNSIGNED, (uint64_t)value);
+            }
+        }
+
+        static void push(LogRecord & record, LogArgType type, uint64_t value){
+            record.types[record.argCount] = type;
+            record.values[record.argCount] = value;
+            record.argCount++;
+        }
+};
+
+SlowLogger & slowLogger();
+
+#endif
@@ -1,22 +1,60 @@
 #include "peripheral.h"
+#include "logger.h"
 
-int main(){
+static void printReceived(Peripheral & peripheral){
+    // mensagens que a central mandou enquanto a última operação rodava
+    ReceivedMessage message;
+    while(peripheral.receive(message)){
+        cout << "Mensagem da central (" << message.size << " bytes): ";
+        for(string_view segment : message.segments){
+            cout << segment;
+        }
+        cout << "\n";
+        peripheral.release(message);
+    }
+}
+
+int main(int argc, char ** argv){
     Peripheral peripheral;
 
+    // central padrão é o servidor de teste; ./peripheral_slow [host] [porta] aponta para outra (ex.: central_slow local)
+    const char * host = argc > 1 ? argv[1] : "slow.gmelodie.com";
+    int port = argc > 2 ? atoi(argv[2]) : 7033;
+
     // inicialzaçao do peripheral 
-    if(!peripheral.initNetwork("slow.gmelodie.com", 7033)){
+    if(!peripheral.initNetwork(host, port)){
         cout << "Falha ao iniciar o Peripheral\n";
         return 1;
     }
 
-    if(peripheral.connect()){
+    // GSO/GRO para mensagens grandes; sem suporte do kernel, segue um datagrama por vez
+    peripheral.enableOffload();
+    // io_uring quando o kernel suporta: receber não custa syscall e os envios saem em lote
+    peripheral.enableUring();
+    // sessão de uma execução anterior, se ainda dentro do STTL: o revive leva uma ida e volta, o connect três
+    peripheral.enableSessionCache();
+
+    bool connected = false;
+    if(peripheral.canRevive()){
+        connected = peripheral.zeroWayConnect("");
+    }
+    if(!connected){
+        connected = peripheral.connect();
+    }
+    slowLogger().flush();
+    if(connected){
         while(1){
-            cout << "Digite 'data' para enviar uma mensagem, 'disconnect' para desconectar, 'revive' para 0-way, ou 'end' para sair.\n";
+            // o log é escrito por outra thread: esvazia antes de falar com o usuário
+            slowLogger().flush();
+            printReceived(peripheral);
+            cout << "Digite 'data' para enviar uma mensagem, 'file' para enviar um arquivo, 'disconnect' para desconectar, 'revive' para 0-way, ou 'end' para sair.\n";
             string operation;
             cin >> operation; 
 
             if(operation == "disconnect"){
-                if(peripheral.disconnect()){
+                bool disconnected = peripheral.disconnect();
+                slowLogger().flush();
+                if(disconnected){
                     cout << "Desconectado com êxito.\n";
                 }else{
                     cout << "erro ao enviar a mensagem de disconnect ou validaçao do ack\n";
@@ -27,14 +65,34 @@ int main(){
                 if (cin.peek() == '\n') { // Verifica se há um newline pendente
                     cin.ignore();
                }
+               slowLogger().flush();
                cout << "Digite os dados a enviar: ";
                getline(cin, data);
 
-                if(peripheral.sendData(data)){
+                bool sent = peripheral.sendData(data);
+                slowLogger().flush();
+                if(sent){
                     cout << "Dados enviados com êxito.\n";
                 }else{
                     cout << "erro ao enviar os dados ou validaçao do ack\n";
                 }
+            }else if(operation == "file"){
+                string path;
+
+                if (cin.peek() == '\n') { // Verifica se há um newline pendente
+                    cin.ignore();
+                }
+                slowLogger().flush();
+                cout << "Digite o caminho do arquivo: ";
+                getline(cin, path);
+
+                bool sent = peripheral.sendFile(path); // lido aos poucos, conforme a janela abre
+                slowLogger().flush();
+                if(sent){
+                    cout << "Arquivo enviado com êxito.\n";
+                }else{
+                    cout << "erro ao ler ou enviar o arquivo\n";
+                }
             }else if(operation == "revive"){
                 if (peripheral.canRevive()) { // Se há dados de sessão anterior
                     cout << "Tentando 0-Way connect (revive)...\n";
@@ -42,10 +100,13 @@ int main(){
                     if (cin.peek() == '\n') { // Verifica se há um newline pendente
                          cin.ignore();
                     }
+                    slowLogger().flush();
                     cout << "Digite dados para enviar com o revive: ";
                     getline(cin, reviveData);
 
-                    if (peripheral.zeroWayConnect(reviveData)) {
+                    bool revived = peripheral.zeroWayConnect(reviveData);
+                    slowLogger().flush();
+                    if (revived) {
                         cout << "0-Way Connect (Revive) BEM-SUCEDIDO!\n";
                     } else {
                         cout << "Falha na tentativa de 0-Way Connect (Revive).\n";
@@ -0,0 +1,149 @@
+#ifndef MESSAGES_H
+#define MESSAGES_H
+
+#include "slow.h"
+
+// posição de cada campo no cabeçalho serializado
+const int WIRE_SID_OFFSET = 0;
+const int WIRE_STTL_FLAGS_OFFSET = 16;
+const int WIRE_SEQNUM_OFFSET = 20;
+const int WIRE_ACKNUM_OFFSET = 24;
+const int WIRE_WINDOW_OFFSET = 28;
+const int WIRE_FID_OFFSET = 30;
+const int WIRE_FO_OFFSET = 31;
+
+// bits das flags no byte baixo de sttlAndFlags (mesma ordem de Flags::toByte)
+constexpr uint8_t FLAG_C = 1 << 4;
+constexpr uint8_t FLAG_R = 1 << 3;
+constexpr uint8_t FLAG_ACK = 1 << 2;
+constexpr uint8_t FLAG_AR = 1 << 1;
+constexpr uint8_t FLAG_MB = 1 << 0;
+constexpr uint8_t FLAG_ALL = 0x1f;
+
+const uint16_t PERIPHERAL_WINDOW_SIZE = 45 * MAX_DATA_SIZE; // janela de recepção do peripheral com o buffer vazio (RECEIVE_BUFFER_SLOTS)
+
+template<uint8_t FlagBits, uint8_t FlagMask>
+struct SlowMessage {
+    /*
+    Tipo de mensagem SLOW: as flags que ele leva (FlagBits) e quais bits são conferidos
+    na recepção (FlagMask). Os bits fora da máscara variam por pacote (MB, AR do Setup...).
+    Reconhecer um pacote é uma única comparação mascarada do byte de flags.
+    */
+    static_assert((FlagBits & ~FlagMask) == 0, "as flags do tipo precisam estar dentro da máscara");
+
+    static constexpr uint8_t flags = FlagBits;
+    static constexpr uint8_t mask = FlagMask;
+
+    static constexpr bool matches(uint8_t flagByte) { return (flagByte & mask) == flags; }
+    static bool matches(const uint8_t * wire) { return matches(wire[WIRE_STTL_FLAGS_OFFSET]); }
+};
+
+using ConnectMessage    = SlowMessage<FLAG_C, FLAG_ALL>;
+using SetupMessage      = SlowMessage<0, FLAG_C | FLAG_R | FLAG_MB>;   // AR diz se foi aceito
+using DataMessage       = SlowMessage<0, FLAG_ALL & ~FLAG_MB>;
+using AckMessage        = SlowMessage<FLAG_ACK, FLAG_ALL>;
+using ReviveMessage     = SlowMessage<FLAG_R, FLAG_ALL & ~FLAG_MB>;
+using ReviveAckMessage  = SlowMessage<FLAG_ACK | FLAG_AR, FLAG_ALL>;
+using FailedMessage     = SlowMessage<0, FLAG_AR>;                     // com SID Nil
+// O Disconnect da especificação é C+R+ACK, mas a central de teste não aceita: o
+// peripheral manda um pacote sem flags e com janela 0 (ver sendDisconnectMessage()).
+using DisconnectMessage = SlowMessage<0, FLAG_ALL>;
+
+constexpr uint16_t dataWindow(uint16_t window){
+    /*
+    Janela anunciada num Data. Com o buffer de recepção cheio ela seria 0, e um Data
+    vazio ficaria igual ao Disconnect (sem flags, sem dados, janela 0), que as centrais
+    encerram. Fechada, ela vai como 1 byte: continua sem espaço para um fragmento.
+    */
+    return window > 0 ? window : 1;
+}
+
+inline void storeWire32(uint8_t * buffer, uint32_t value){
+#if SLOW_HEADER_NATIVE_LAYOUT
+    memcpy(buffer, &value, sizeof(value));
+#else
+    serializationOf32bits(value, buffer);
+#endif
+}
+
+inline void storeWire16(uint8_t * buffer, uint16_t value){
+#if SLOW_HEADER_NATIVE_LAYOUT
+    memcpy(buffer, &value, sizeof(value));
+#else
+    serializationOf16bits(value, buffer);
+#endif
+}
+
+constexpr array<uint8_t, SLOW_HEADER_SIZE> constantHeaderImage(uint8_t flags, uint16_t window){
+    /*
+    Cabeçalho inteiro montado em tempo de compilação, para mensagens sem estado de
+    sessão (Connect: SID Nil, STTL 0, seqNum/ackNum 0).
+    */
+    array<uint8_t, SLOW_HEADER_SIZE> image{};
+    image[WIRE_STTL_FLAGS_OFFSET] = flags;
+    image[WIRE_WINDOW_OFFSET] = window & 0xff;
+    image[WIRE_WINDOW_OFFSET + 1] = window >> 8;
+    return image;
+}
+
+constexpr array<uint8_t, SLOW_HEADER_SIZE> CONNECT_HEADER_IMAGE = constantHeaderImage(ConnectMessage::flags, PERIPHERAL_WINDOW_SIZE);
+
+class HeaderImage{
+    /*
+    Cabeçalho pré-serializado de um tipo de mensagem numa sessão: SID, STTL, flags e
+    janela ficam prontos, e cada pacote só copia os 32 bytes e escreve seqNum, ackNum,
+    fid, fo e o bit MB por cima. Remontado só quando a sessão muda (setup/revive) e
+    atualizado em setSttl()/setWindow() quando a central anuncia valores novos.
+    */
+    public:
+        HeaderImage() { memset(bytes, 0, sizeof(bytes)); }
+
+        template<class Message>
+        void build(const SID & sid, uint32_t sttl, uint16_t window){
+            memcpy(bytes + WIRE_SID_OFFSET, sid.byte, sizeof(sid.byte));
+            storeWire32(bytes + WIRE_STTL_FLAGS_OFFSET, (sttl & 0xffffffe0) | Message::flags);
+            storeWire32(bytes + WIRE_SEQNUM_OFFSET, 0);
+            storeWire32(bytes + WIRE_ACKNUM_OFFSET, 0);
+            storeWire16(bytes + WIRE_WINDOW_OFFSET, window);
+            bytes[WIRE_FID_OFFSET] = 0;
+            bytes[WIRE_FO_OFFSET] = 0;
+        }
+
+        void setSttl(uint32_t sttl){
+            uint8_t flags = bytes[WIRE_STTL_FLAGS_OFFSET] & FLAG_ALL;
+            storeWire32(bytes + WIRE_STTL_FLAGS_OFFSET, (sttl & 0xffffffe0) | flags);
+        }
+
+        void setWindow(uint16_t window){
+            storeWire16(bytes + WIRE_WINDOW_OFFSET, window);
+        }
+
+        void stamp(uint8_t * out, uint32_t seqNum, uint32_t ackNum, uint8_t fid = 0, uint8_t fo = 0, uint8_t extraFlags = 0) const {
+            /*
+            Escreve o cabeçalho de um pacote em out: a imagem mais os campos por pacote.
+            extraFlags entra no byte de flags (FLAG_MB nos fragmentos, FLAG_AR no ACK de revive).
+            */
+            memcpy(out, bytes, SLOW_HEADER_SIZE);
+            out[WIRE_STTL_FLAGS_OFFSET] |= extraFlags;
+            storeWire32(out + WIRE_SEQNUM_OFFSET, seqNum);
+            storeWire32(out + WIRE_ACKNUM_OFFSET, ackNum);
+            out[WIRE_FID_OFFSET] = fid;
+            out[WIRE_FO_OFFSET] = fo;
+        }
+
+        bool sameSession(const uint8_t * wire) const {
+            return memcmp(wire + WIRE_SID_OFFSET, bytes + WIRE_SID_OFFSET, sizeof(SID)) == 0;
+        }
+
+        template<class Message>
+        bool accepts(const uint8_t * wire) const {
+            // pacote da mesma sessão e do tipo esperado
+            return sameSession(wire) && Message::matches(wire);
+        }
+
+        const uint8_t * data() const { return bytes; }
+    private:
+        alignas(16) uint8_t bytes[SLOW_HEADER_SIZE];
+};
+
+#endif
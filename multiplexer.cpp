@@ -0,0 +1,1078 @@
+#include "multiplexer.h"
+#include "logger.h"
+
+SessionMultiplexer::SessionMultiplexer(size_t packetPoolSize) : epollFileDescriptor(-1), timerFileDescriptor(-1), packetPoolSize(packetPoolSize){
+    memset(&centralAddress, 0, sizeof(centralAddress));
+}
+
+SessionMultiplexer::~SessionMultiplexer(){
+    /*
+    Fecha os sockets e o laço de eventos. Operações pendentes são descartadas sem callback,
+    como no Peripheral; a central esquece as sessões quando o STTL vencer.
+    */
+    this->closeNetwork();
+}
+
+void SessionMultiplexer::closeNetwork(){
+    /*
+    Fecha os sockets, o epoll e o timerfd que estiverem abertos, deixando os descritores
+    em -1 (usado também quando initNetwork() falha no meio).
+    */
+    for(unique_ptr<MuxSocket> & socket : sockets){
+        if(socket->fileDescriptor >= 0){
+            close(socket->fileDescriptor);
+        }
+    }
+    sockets.clear();
+    for(int * fd : {&epollFileDescriptor, &timerFileDescriptor}){
+        if(*fd >= 0){
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+bool SessionMultiplexer::initNetwork(const char * hostName, int port, int socketCount){
+    /*
+    Abre socketCount sockets UDP para a central (as sessões são distribuídas entre eles
+    em rodízio) e monta o laço de eventos: um epoll com os sockets e um timerfd armado com
+    o prazo mais próximo de todas as sessões.
+
+    param   hostName     Nome ou endereço do servidor central.
+    param   port         Porta UDP em que o servidor está escutando.
+    param   socketCount  Quantos sockets abrir (1 a 255); cada um faz um handshake por vez.
+    return  true se tudo foi criado; false caso contrário.
+    */
+    socketCount = max(1, min(socketCount, 255));
+
+    struct hostent * serverInfo = gethostbyname(hostName);
+    if(serverInfo == NULL){
+        SLOW_LOG_ERROR("Problema em pegar o host!");
+        return false;
+    }
+    centralAddress.sin_family = AF_INET;
+    memcpy(&centralAddress.sin_addr.s_addr, serverInfo->h_addr_list[0], serverInfo->h_length);
+    centralAddress.sin_port = htons(port);
+
+    epollFileDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    timerFileDescriptor = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(epollFileDescriptor < 0 || timerFileDescriptor < 0){
+        perror("epoll/timerfd");
+        this->closeNetwork();
+        return false;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u32 = MUX_NIL;
+    if(epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, timerFileDescriptor, &event) < 0){
+        perror("epoll_ctl");
+        this->closeNetwork();
+        return false;
+    }
+
+    for(int i = 0; i < socketCount; i++){
+        unique_ptr<MuxSocket> socket = make_unique<MuxSocket>();
+        socket->fileDescriptor = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if(socket->fileDescriptor < 0){
+            SLOW_LOG_ERROR("Problema na criação do socket!!");
+            this->closeNetwork();
+            return false;
+        }
+        socket->io.attach(socket->fileDescriptor, centralAddress);
+
+        event.data.u32 = i; // o índice do socket, para saber de onde veio cada datagrama
+        if(epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, socket->fileDescriptor, &event) < 0){
+            perror("epoll_ctl");
+            close(socket->fileDescriptor);
+            this->closeNetwork();
+            return false;
+        }
+        sockets.push_back(move(socket));
+    }
+
+    SLOW_LOG_INFO("Multiplexador: ", socketCount, " socket(s) para ", hostName, ":", port);
+    return true;
+}
+
+MuxSessionId SessionMultiplexer::openSession(){
+    /*
+    Reserva uma linha na tabela de sessões. A sessão começa sem conexão (connectAsync()).
+
+    return  identificador da sessão, usado nas demais chamadas.
+    */
+    uint32_t index;
+    if(freeSessions != MUX_NIL){
+        index = freeSessions;
+        freeSessions = sessions[index].nextWaiting;
+    }else{
+        index = sessions.size();
+        sessions.emplace_back();
+    }
+
+    MuxSession & session = sessions[index];
+    uint32_t generation = session.generation + 1;
+    session = MuxSession();
+    session.generation = generation;
+    session.rtt.setPolicy(policy);
+    session.congestion.reset(congestionAlgorithm);
+    session.open = true;
+    session.socketIndex = sockets.empty() ? 0 : index % sockets.size();
+    openSessions++;
+    return index;
+}
+
+void SessionMultiplexer::closeSession(MuxSessionId id){
+    /*
+    Libera a sessão na hora, sem Disconnect (a central a descarta quando o STTL vencer).
+    As operações pendentes falham, com callback.
+    */
+    if(id >= sessions.size() || !sessions[id].open){
+        return;
+    }
+    bool outer = !processing;
+    processing = true;
+
+    this->endSession(id);
+
+    MuxSession & session = sessions[id];
+    uint32_t index = session.firstOperation;
+    session.firstOperation = MUX_NIL;
+    session.lastOperation = MUX_NIL;
+    session.open = false;
+    session.nextWaiting = freeSessions;
+    freeSessions = id;
+    openSessions--;
+
+    while(index != MUX_NIL){
+        MuxOperation & operation = operations[index];
+        uint32_t next = operation.next;
+        OperationId operationId = operation.id;
+        CompletionCallback onComplete = move(operation.onComplete);
+        this->releaseOperation(index);
+        if(onComplete){
+            onComplete(operationId, false);
+        }
+        index = next;
+    }
+
+    if(outer){
+        this->settle();
+        processing = false;
+    }
+}
+
+bool SessionMultiplexer::isConnected(MuxSessionId id) const{
+    return id < sessions.size() && sessions[id].open && sessions[id].state == MuxSessionState::ESTABLISHED;
+}
+
+OperationId SessionMultiplexer::connectAsync(MuxSessionId session, CompletionCallback onComplete){
+    /*
+    Conecta a sessão: Connect, Setup e Data inicial, como Peripheral::connectAsync().
+    Com outro handshake em andamento no mesmo socket, o Connect espera a vez.
+    */
+    return enqueueOperation(session, OperationKind::CONNECT, string_view(), move(onComplete));
+}
+
+OperationId SessionMultiplexer::sendDataAsync(MuxSessionId session, string_view data, CompletionCallback onComplete){
+    /*
+    Enfileira uma mensagem na sessão; os fragmentos saem conforme a janela da central.
+    data não é copiado e precisa continuar válido até o callback.
+    */
+    return enqueueOperation(session, OperationKind::SEND, data, move(onComplete));
+}
+
+OperationId SessionMultiplexer::disconnectAsync(MuxSessionId session, CompletionCallback onComplete){
+    /*
+    Enfileira o Disconnect; com o ACK, a sessão volta a ficar sem conexão (pode conectar de novo).
+    */
+    return enqueueOperation(session, OperationKind::DISCONNECT, string_view(), move(onComplete));
+}
+
+OperationId SessionMultiplexer::enqueueOperation(MuxSessionId id, OperationKind kind, string_view data, CompletionCallback onComplete){
+    /*
+    Coloca a operação no fim da fila da sessão e, fora de um callback, já a faz avançar
+    e submete os envios.
+    */
+    if(id >= sessions.size() || !sessions[id].open){
+        SLOW_LOG_WARN("Sessão inválida no multiplexador");
+        if(onComplete){
+            onComplete(0, false);
+        }
+        return 0;
+    }
+
+    uint32_t index = this->allocateOperation();
+    MuxOperation & operation = operations[index];
+    operation.id = nextOperationId++;
+    operation.kind = kind;
+    operation.data = data;
+    operation.onComplete = move(onComplete);
+
+    MuxSession & session = sessions[id];
+    if(session.lastOperation == MUX_NIL){
+        session.firstOperation = index;
+    }else{
+        operations[session.lastOperation].next = index;
+    }
+    session.lastOperation = index;
+
+    OperationId operationId = operation.id;
+    bool outer = !processing;
+    processing = true;
+    this->schedulePump(id);
+    if(outer){
+        this->settle();
+        processing = false;
+    }
+    return operationId;
+}
+
+int SessionMultiplexer::runOnce(chrono::milliseconds timeout){
+    /*
+    Uma volta do laço de eventos de todas as sessões: espera por datagramas em qualquer
+    socket ou pelo prazo mais próximo (no máximo timeout; negativo espera sem limite),
+    encaminha cada datagrama pelo SID, trata os prazos vencidos e submete os envios de
+    todas as sessões, um lote por socket.
+
+    return  número de eventos tratados; -1 em caso de erro.
+    */
+    if(epollFileDescriptor < 0){
+        SLOW_LOG_ERROR("Laço de eventos não inicializado (chame initNetwork())");
+        return -1;
+    }
+    bool outer = !processing;
+    processing = true;
+    this->settle();
+
+    int waitMs = timeout.count() < 0 ? -1 : (int)min<int64_t>(timeout.count(), INT_MAX);
+    for(unique_ptr<MuxSocket> & socket : sockets){
+        if(socket->io.hasReceived()){
+            waitMs = 0;
+        }
+    }
+
+    struct epoll_event events[64];
+    int ready = epoll_wait(epollFileDescriptor, events, 64, waitMs);
+    if(ready < 0){
+        processing = !outer;
+        if(errno == EINTR){
+            return 0;
+        }
+        perror("epoll_wait");
+        return -1;
+    }
+
+    bool timerFired = false;
+    vector<bool> readable(sockets.size(), false);
+    for(size_t i = 0; i < sockets.size(); i++){
+        readable[i] = sockets[i]->io.hasReceived();
+    }
+    for(int i = 0; i < ready; i++){
+        uint32_t index = events[i].data.u32;
+        if(index == MUX_NIL){
+            uint64_t expirations;
+            if(read(timerFileDescriptor, &expirations, sizeof(expirations)) > 0){
+                timerFired = true;
+            }
+            continue;
+        }
+        if(events[i].events & EPOLLERR){
+            int soError = 0;
+            socklen_t len = sizeof(soError);
+            getsockopt(sockets[index]->fileDescriptor, SOL_SOCKET, SO_ERROR, &soError, &len);
+        }
+        if(events[i].events & EPOLLIN){
+            readable[index] = true;
+        }
+    }
+
+    // primeiro os ACKs, depois os prazos: um ACK no limite do prazo evita a retransmissão
+    for(size_t i = 0; i < sockets.size(); i++){
+        if(!readable[i]){
+            continue;
+        }
+        Datagram datagram;
+        while(sockets[i]->io.nextDatagram(datagram)){
+            this->handleDatagram(i, datagram);
+        }
+        if(errno != EAGAIN && errno != EWOULDBLOCK){
+            SLOW_LOG_ERROR("ERRO SISTEMA ao receber pacotes da central.");
+        }
+    }
+    if(timerFired){
+        this->handleTimer();
+    }
+
+    if(outer){
+        this->settle();
+        processing = false;
+    }
+    return ready;
+}
+
+void SessionMultiplexer::settle(){
+    /*
+    Faz avançar as sessões marcadas, submete os lotes de envio e rearma o timer. Repete
+    enquanto a liberação de pacotes do pool acordar sessões que estavam esperando por ele.
+    */
+    do{
+        this->drainPumps();
+        this->flushSends();
+    }while(!pumpQueue.empty());
+    this->armTimer();
+}
+
+void SessionMultiplexer::schedulePump(uint32_t session){
+    if(!sessions[session].pumpQueued){
+        sessions[session].pumpQueued = true;
+        pumpQueue.push_back(session);
+    }
+}
+
+void SessionMultiplexer::drainPumps(){
+    /*
+    Faz avançar as sessões marcadas. Callbacks chamados no caminho podem marcar outras
+    (ou a mesma) sessões, que entram no fim da fila e são atendidas na mesma passada.
+    */
+    for(size_t i = 0; i < pumpQueue.size(); i++){
+        uint32_t session = pumpQueue[i];
+        sessions[session].pumpQueued = false;
+        this->pumpSession(session);
+    }
+    pumpQueue.clear();
+}
+
+void SessionMultiplexer::pumpSession(uint32_t id){
+    /*
+    Mesmas regras de Peripheral::pumpOperations(), para uma sessão: as operações concluídas
+    saem pela frente com callback; mensagens ocupam a janela em sequência; CONNECT e
+    DISCONNECT só começam na frente da fila, com a janela vazia.
+    Um callback pode fechar a sessão (ou até reabrir a linha): por isso a geração é conferida.
+    */
+    MuxSession & session = sessions[id];
+    uint32_t generation = session.generation;
+    auto alive = [&](){ return session.open && session.generation == generation; };
+
+    while(alive() && session.firstOperation != MUX_NIL && this->operationFinished(session, operations[session.firstOperation])){
+        this->finishOperation(id, true);
+    }
+
+    for(uint32_t index = session.firstOperation; alive() && index != MUX_NIL; index = operations[index].next){
+        MuxOperation & operation = operations[index];
+
+        if(operation.kind == OperationKind::SEND){
+            if(operation.allQueued){
+                continue;
+            }
+            if(session.state != MuxSessionState::ESTABLISHED){
+                if(index == session.firstOperation){
+                    SLOW_LOG_ERROR("ERRO: sessão não ativa. Não é possível enviar dados de aplicação.");
+                    this->finishOperation(id, false);
+                    this->schedulePump(id);
+                }
+                return;
+            }
+            if(!this->fillWindow(id, operation)){
+                SLOW_LOG_WARN("Falha ao enviar os dados");
+                this->failSession(id);
+                return;
+            }
+            if(!operation.allQueued){
+                return; // janela (ou pool) cheia
+            }
+        }else{
+            if(index == session.firstOperation && !operation.started && session.firstPacket == MUX_NIL){
+                if(!this->startOperation(id, operation)){
+                    this->finishOperation(id, false);
+                    this->schedulePump(id);
+                }
+            }
+            return;
+        }
+    }
+}
+
+bool SessionMultiplexer::startOperation(uint32_t id, MuxOperation & operation){
+    /*
+    Começa CONNECT (entra na fila de handshake do socket) ou DISCONNECT.
+
+    return  false se ela já falhou no início.
+    */
+    MuxSession & session = sessions[id];
+    operation.started = true;
+
+    if(operation.kind == OperationKind::CONNECT){
+        if(session.state != MuxSessionState::IDLE){
+            SLOW_LOG_INFO("Sessão já conectada");
+            return false;
+        }
+        MuxSocket & socket = *sockets[session.socketIndex];
+        session.state = MuxSessionState::WAITING;
+        session.nextWaiting = MUX_NIL;
+        if(socket.lastWaiting == MUX_NIL){
+            socket.firstWaiting = id;
+        }else{
+            sessions[socket.lastWaiting].nextWaiting = id;
+        }
+        socket.lastWaiting = id;
+        this->startNextHandshake(socket);
+        return true;
+    }
+
+    if(operation.kind == OperationKind::DISCONNECT){
+        if(session.state != MuxSessionState::ESTABLISHED){
+            SLOW_LOG_ERROR("Foi tentado enviar disconnect, porém a sessão não está ativa");
+            return false;
+        }
+        // a imagem de Disconnect é montada na hora: é uma vez por sessão e não vale a linha na tabela
+        SID sid;
+        memcpy(sid.byte, session.dataImage.data() + WIRE_SID_OFFSET, sizeof(sid.byte));
+        HeaderImage disconnectImage;
+        disconnectImage.build<DisconnectMessage>(sid, session.sttl, 0);
+        if(!this->queuePacket(id, disconnectImage, session.lastCentralSeqNum, nullptr, 0)){
+            SLOW_LOG_ERROR("Erro no envio de Disconnect");
+            return false;
+        }
+        operation.lastSeqNum = session.nextSeqNum - 1;
+        operation.allQueued = true;
+        return true;
+    }
+
+    SLOW_LOG_INFO("Operação não suportada pelo multiplexador");
+    return false;
+}
+
+bool SessionMultiplexer::fillWindow(uint32_t id, MuxOperation & operation){
+    /*
+    Coloca na janela da sessão os próximos fragmentos da mensagem enquanto houver espaço,
+    como Peripheral::fillWindow() (inclusive os segmentos de SEGMENT_MAX_FRAGMENTS), com
+    os fids da própria sessão.
+
+    return  false em caso de erro no envio.
+    */
+    MuxSession & session = sessions[id];
+    while(!operation.allQueued){
+        string_view fragment = operation.data.substr(operation.nextOffset, MAX_DATA_SIZE);
+        bool more = operation.nextOffset + fragment.size() < operation.data.size();
+        bool MB = more && operation.nextFo < SEGMENT_MAX_FRAGMENTS - 1;
+        if(!this->windowHasRoom(session, fragment.size())){
+            if(freePackets == MUX_NIL && packets.size() >= packetPoolSize){
+                packetWaiters.push_back(id);
+            }
+            return true;
+        }
+        if(!MB && operation.segmentPending && session.firstPacket != MUX_NIL &&
+           (int32_t)(packets[session.firstPacket].seqNum - operation.segmentEnd) <= 0){
+            return true; // o segmento anterior ainda não foi todo confirmado
+        }
+        if(operation.nextFo == 0 && MB){
+            operation.fid = session.nextFid++;
+        }
+
+        if(!this->queuePacket(id, session.dataImage, session.lastCentralSeqNum, reinterpret_cast<const uint8_t *>(fragment.data()),
+                              fragment.size(), operation.fid, operation.nextFo, MB ? FLAG_MB : 0)){
+            return false;
+        }
+        operation.nextOffset += fragment.size();
+        operation.nextFo++;
+
+        if(!MB && more){
+            operation.segmentPending = true;
+            operation.segmentEnd = session.nextSeqNum - 1;
+            operation.nextFo = 0;
+        }else if(!MB){
+            operation.allQueued = true;
+            operation.lastSeqNum = session.nextSeqNum - 1;
+        }
+    }
+    return true;
+}
+
+bool SessionMultiplexer::operationFinished(const MuxSession & session, const MuxOperation & operation) const{
+    if(!operation.allQueued){
+        return false;
+    }
+    return session.firstPacket == MUX_NIL || (int32_t)(packets[session.firstPacket].seqNum - operation.lastSeqNum) > 0;
+}
+
+void SessionMultiplexer::finishOperation(uint32_t id, bool success){
+    /*
+    Retira a operação da frente da fila da sessão, aplica o efeito final (DISCONNECT ou
+    handshake que falhou encerram a sessão) e chama o callback.
+    */
+    MuxSession & session = sessions[id];
+    uint32_t index = session.firstOperation;
+    MuxOperation & operation = operations[index];
+    session.firstOperation = operation.next;
+    if(session.firstOperation == MUX_NIL){
+        session.lastOperation = MUX_NIL;
+    }
+
+    OperationKind kind = operation.kind;
+    OperationId operationId = operation.id;
+    CompletionCallback onComplete = move(operation.onComplete);
+    this->releaseOperation(index);
+
+    bool handshakeFailed = kind == OperationKind::CONNECT && !success && session.state != MuxSessionState::ESTABLISHED;
+    if(kind == OperationKind::DISCONNECT || handshakeFailed){
+        this->endSession(id);
+    }
+    if(onComplete){
+        onComplete(operationId, success);
+    }
+}
+
+void SessionMultiplexer::failSession(uint32_t id){
+    /*
+    Aborta a janela da sessão (retransmissões esgotadas ou erro de envio) e falha as
+    operações que já tinham começado; as outras seguem na fila.
+    */
+    MuxSession & session = sessions[id];
+    this->clearWindow(id);
+
+    vector<pair<OperationId, CompletionCallback>> failed;
+    bool ended = false;
+    while(session.firstOperation != MUX_NIL && operations[session.firstOperation].started){
+        uint32_t index = session.firstOperation;
+        MuxOperation & operation = operations[index];
+        session.firstOperation = operation.next;
+        ended = ended || operation.kind != OperationKind::SEND;
+        failed.emplace_back(operation.id, move(operation.onComplete));
+        this->releaseOperation(index);
+    }
+    if(session.firstOperation == MUX_NIL){
+        session.lastOperation = MUX_NIL;
+    }
+    if(ended){
+        this->endSession(id);
+    }
+
+    this->schedulePump(id);
+    for(auto & [operationId, onComplete] : failed){
+        if(onComplete){
+            onComplete(operationId, false);
+        }
+    }
+}
+
+void SessionMultiplexer::endSession(uint32_t id){
+    /*
+    Volta a sessão ao estado sem conexão: sai do mapa de SIDs, da fila de handshake ou
+    libera o handshake do socket para a próxima sessão, e descarta a janela.
+    */
+    MuxSession & session = sessions[id];
+    MuxSocket & socket = *sockets[session.socketIndex];
+
+    switch(session.state){
+        case MuxSessionState::ESTABLISHED: {
+            SID sid;
+            memcpy(sid.byte, session.dataImage.data() + WIRE_SID_OFFSET, sizeof(sid.byte));
+            sessionsBySid.erase(sid);
+            break;
+        }
+        case MuxSessionState::WAITING:
+            this->unlinkWaiting(id);
+            break;
+        case MuxSessionState::CONNECTING:
+            session.state = MuxSessionState::IDLE;
+            if(socket.handshakeSession == id){
+                socket.handshakeSession = MUX_NIL;
+                this->startNextHandshake(socket);
+            }
+            break;
+        case MuxSessionState::IDLE:
+            break;
+    }
+
+    session.state = MuxSessionState::IDLE;
+    this->clearWindow(id);
+}
+
+bool SessionMultiplexer::beginHandshake(uint32_t id){
+    /*
+    Envia o Connect da sessão; o socket fica reservado para ela até o Setup (ou a desistência).
+
+    return  false se o Connect não pôde ser enfileirado.
+    */
+    MuxSession & session = sessions[id];
+    MuxSocket & socket = *sockets[session.socketIndex];
+
+    if(!socket.io.queueSend(CONNECT_HEADER_IMAGE.data(), SLOW_HEADER_SIZE)){
+        SLOW_LOG_ERROR("Erro no envio de Connect");
+        return false;
+    }
+    socket.handshakeSession = id;
+    session.state = MuxSessionState::CONNECTING;
+    session.handshakeAttempts = 0;
+    session.congestion.reset(congestionAlgorithm);
+    session.handshakeSentAt = SlowClock::now();
+    session.handshakeDeadline = session.handshakeSentAt + session.rtt.rto();
+    this->pushDeadline(session.handshakeDeadline, id, session.generation, true);
+    return true;
+}
+
+void SessionMultiplexer::startNextHandshake(MuxSocket & socket){
+    /*
+    Se o socket está livre, começa o handshake da primeira sessão da fila.
+    */
+    while(socket.handshakeSession == MUX_NIL && socket.firstWaiting != MUX_NIL){
+        uint32_t id = socket.firstWaiting;
+        socket.firstWaiting = sessions[id].nextWaiting;
+        if(socket.firstWaiting == MUX_NIL){
+            socket.lastWaiting = MUX_NIL;
+        }
+        sessions[id].nextWaiting = MUX_NIL;
+        sessions[id].state = MuxSessionState::IDLE;
+
+        if(!this->beginHandshake(id)){
+            this->finishOperation(id, false);
+            this->schedulePump(id); // as operações atrás do CONNECT falham em pumpSession()
+        }
+    }
+}
+
+void SessionMultiplexer::unlinkWaiting(uint32_t id){
+    MuxSocket & socket = *sockets[sessions[id].socketIndex];
+    uint32_t previous = MUX_NIL;
+    for(uint32_t index = socket.firstWaiting; index != MUX_NIL; previous = index, index = sessions[index].nextWaiting){
+        if(index != id){
+            continue;
+        }
+        uint32_t next = sessions[index].nextWaiting;
+        if(previous == MUX_NIL){
+            socket.firstWaiting = next;
+        }else{
+            sessions[previous].nextWaiting = next;
+        }
+        if(socket.lastWaiting == id){
+            socket.lastWaiting = previous;
+        }
+        sessions[id].nextWaiting = MUX_NIL;
+        return;
+    }
+}
+
+void SessionMultiplexer::handleDatagram(uint8_t socketIndex, const Datagram & datagram){
+    /*
+    Encaminha o datagrama pelo SID. Um SID desconhecido só interessa como Setup do
+    handshake em andamento no socket; o resto (ex.: ACK atrasado de sessão encerrada) é ignorado.
+    */
+    if(datagram.size < SLOW_HEADER_SIZE){
+        return;
+    }
+
+    SID sid;
+    memcpy(sid.byte, datagram.data + WIRE_SID_OFFSET, sizeof(sid.byte));
+    auto it = sessionsBySid.find(sid);
+    if(it != sessionsBySid.end()){
+        this->handleAck(it->second, datagram);
+        return;
+    }
+
+    MuxSocket & socket = *sockets[socketIndex];
+    if(socket.handshakeSession != MUX_NIL && SetupMessage::matches(datagram.data)){
+        this->handleSetup(socket, datagram);
+    }
+}
+
+void SessionMultiplexer::handleSetup(MuxSocket & socket, const Datagram & datagram){
+    /*
+    Setup para o handshake em andamento no socket. Como os Setups não se distinguem, o
+    de um Connect retransmitido pode chegar depois e ser usado pela próxima sessão da
+    fila: é uma sessão nova e válida na central, então isso não causa erro; a que sobrar
+    expira pelo STTL.
+    */
+    SlowHeader setupHeader;
+    deserializationForSlowHeader(setupHeader, datagram.data);
+    if(setupHeader.ackNum != 0){
+        return;
+    }
+
+    uint32_t id = socket.handshakeSession;
+    MuxSession & session = sessions[id];
+
+    if(!setupHeader.getFlags().AR){
+        SLOW_LOG_WARN("Conexão rejeitada pela central");
+        this->finishOperation(id, false);
+        this->schedulePump(id);
+        return;
+    }
+
+    if(session.handshakeAttempts == 0){ // regra de Karn
+        session.rtt.addSample(chrono::duration_cast<chrono::microseconds>(SlowClock::now() - session.handshakeSentAt));
+    }
+    session.sttl = setupHeader.getSttl();
+    session.lastCentralSeqNum = setupHeader.seqNum;
+    session.centralWindow = setupHeader.window;
+    session.nextSeqNum = 1; // o Connect leva seqNum 0
+    session.dataImage.build<DataMessage>(setupHeader.sid, session.sttl, PERIPHERAL_WINDOW_SIZE);
+    session.state = MuxSessionState::ESTABLISHED;
+    sessionsBySid[setupHeader.sid] = id;
+    socket.handshakeSession = MUX_NIL;
+
+    // Data inicial: a operação CONNECT termina com o ACK dele
+    MuxOperation & operation = operations[session.firstOperation];
+    if(this->queuePacket(id, session.dataImage, setupHeader.seqNum, nullptr, 0)){
+        operation.lastSeqNum = session.nextSeqNum - 1;
+        operation.allQueued = true;
+    }else{
+        SLOW_LOG_WARN("Falha no envio de Data");
+        this->failSession(id);
+    }
+
+    // por último: falhas de handshake de outras sessões chamam callbacks, que podem fechar esta
+    this->startNextHandshake(socket);
+}
+
+void SessionMultiplexer::handleAck(uint32_t id, const Datagram & datagram){
+    /*
+    ACK de uma sessão: marca o pacote reconhecido, desliza a janela e atualiza STTL,
+    seqNum e janela da central, como Peripheral::handleAck(). ACKs repetidos ou de
+    pacotes que já saíram da janela são ignorados, e os pacotes anteriores sem ACK entram
+    na retransmissão rápida como em Peripheral::slideWindow(); ACKs e perdas alimentam o
+    controle de congestionamento da sessão. Dados que vierem junto
+    são ignorados.
+    */
+    MuxSession & session = sessions[id];
+    if(session.state != MuxSessionState::ESTABLISHED || session.firstPacket == MUX_NIL || !AckMessage::matches(datagram.data)){
+        return;
+    }
+
+    SlowHeader ackHeader;
+    deserializationForSlowHeader(ackHeader, datagram.data);
+
+    uint32_t offset = ackHeader.ackNum - packets[session.firstPacket].seqNum;
+    if(offset >= session.packetsInFlight){
+        return;
+    }
+
+    if(ackHeader.getSttl() != session.sttl){
+        session.sttl = ackHeader.getSttl();
+        session.dataImage.setSttl(session.sttl);
+    }
+    session.lastCentralSeqNum = ackHeader.seqNum;
+    session.centralWindow = ackHeader.window;
+
+    uint32_t index = session.firstPacket;
+    while(offset-- > 0){
+        index = packets[index].next;
+    }
+    MuxPacket & packet = packets[index];
+    if(packet.acked){
+        return;
+    }
+    SlowClock::time_point now = SlowClock::now();
+    chrono::microseconds sample{0};
+    if(packet.retries == 0){
+        sample = chrono::duration_cast<chrono::microseconds>(now - packet.sentAt);
+        session.rtt.addSample(sample);
+    }
+    session.congestion.onAck(packet.payloadSize, sample, session.bytesInFlight, packet.sentAt, now);
+    packet.acked = true;
+    session.bytesInFlight -= packet.payloadSize;
+
+    const RetransmissionPolicy & policy = session.rtt.getPolicy();
+    for(uint32_t earlier = session.firstPacket; policy.duplicateAckThreshold > 0 && earlier != index; ){
+        MuxPacket & lost = packets[earlier];
+        uint32_t current = earlier;
+        earlier = lost.next;
+        if(lost.acked || packet.sentAt < lost.sentAt || ++lost.laterAcks < policy.duplicateAckThreshold ||
+           lost.retries >= policy.maxRetries){
+            continue;
+        }
+        session.congestion.onLoss(lost.sentAt, now, session.bytesInFlight);
+        lost.retries++;
+        lost.laterAcks = 0;
+        if(!this->transmitPacket(lost, current)){
+            this->failSession(id);
+            return;
+        }
+    }
+
+    this->slideWindow(id);
+    this->schedulePump(id);
+}
+
+void SessionMultiplexer::handleTimer(){
+    /*
+    Trata os prazos vencidos do heap: retransmite Connects e pacotes (com backoff no RTO
+    da sessão) ou desiste deles. O backoff acontece uma vez por rodada, no pacote mais
+    antigo da janela, como em Peripheral::retransmitExpired().
+    */
+    SlowClock::time_point now = SlowClock::now();
+
+    while(!deadlines.empty() && deadlines.front().when <= now){
+        MuxDeadline deadline = deadlines.front();
+        pop_heap(deadlines.begin(), deadlines.end(), greater<MuxDeadline>());
+        deadlines.pop_back();
+        if(!this->deadlineValid(deadline)){
+            continue;
+        }
+
+        if(deadline.handshake){
+            uint32_t id = deadline.index;
+            MuxSession & session = sessions[id];
+            session.rtt.backoff();
+            if(session.handshakeAttempts >= session.rtt.getPolicy().maxRetries){
+                SLOW_LOG_WARN("Falha no setup da conexão");
+                this->finishOperation(id, false);
+                this->schedulePump(id);
+                continue;
+            }
+            session.handshakeAttempts++;
+            if(!sockets[session.socketIndex]->io.queueSend(CONNECT_HEADER_IMAGE.data(), SLOW_HEADER_SIZE)){
+                this->finishOperation(id, false);
+                this->schedulePump(id);
+                continue;
+            }
+            session.handshakeSentAt = now;
+            session.handshakeDeadline = now + session.rtt.rto();
+            this->pushDeadline(session.handshakeDeadline, id, session.generation, true);
+            continue;
+        }
+
+        MuxPacket & packet = packets[deadline.index];
+        uint32_t id = packet.session;
+        MuxSession & session = sessions[id];
+        if(packet.retries >= session.rtt.getPolicy().maxRetries){
+            SLOW_LOG_WARN("Número máximo de retransmissões excedido (SeqNum: ", packet.seqNum, ")");
+            this->failSession(id);
+            continue;
+        }
+        if(deadline.index == session.firstPacket){
+            session.rtt.backoff();
+            session.congestion.onTimeout(now, session.bytesInFlight);
+        }
+        packet.retries++;
+        if(!this->transmitPacket(packet, deadline.index)){
+            this->failSession(id);
+        }
+    }
+}
+
+bool SessionMultiplexer::deadlineValid(const MuxDeadline & deadline) const{
+    /*
+    Uma entrada do heap vale enquanto o que ela vigia não mudou: o pacote (ou handshake)
+    continua o mesmo, sem ACK, e o prazo não foi renovado por uma retransmissão.
+    */
+    if(deadline.handshake){
+        const MuxSession & session = sessions[deadline.index];
+        return session.open && session.generation == deadline.generation
+            && session.state == MuxSessionState::CONNECTING && session.handshakeDeadline == deadline.when;
+    }
+    const MuxPacket & packet = packets[deadline.index];
+    return packet.session != MUX_NIL && packet.generation == deadline.generation
+        && !packet.acked && packet.deadline == deadline.when;
+}
+
+void SessionMultiplexer::pushDeadline(SlowClock::time_point when, uint32_t index, uint32_t generation, bool handshake){
+    deadlines.push_back(MuxDeadline{when, index, generation, handshake});
+    push_heap(deadlines.begin(), deadlines.end(), greater<MuxDeadline>());
+}
+
+void SessionMultiplexer::armTimer(){
+    /*
+    Arma o timerfd para o prazo válido mais próximo. Quando as entradas velhas (pacotes já
+    confirmados) passam a dominar o heap, ele é reconstruído só com as válidas.
+    */
+    if(timerFileDescriptor < 0){
+        return;
+    }
+
+    if(deadlines.size() > 4096 && deadlines.size() > 4 * (livePackets + sessionsBySid.size())){
+        erase_if(deadlines, [this](const MuxDeadline & deadline){ return !this->deadlineValid(deadline); });
+        make_heap(deadlines.begin(), deadlines.end(), greater<MuxDeadline>());
+    }
+    while(!deadlines.empty() && !this->deadlineValid(deadlines.front())){
+        pop_heap(deadlines.begin(), deadlines.end(), greater<MuxDeadline>());
+        deadlines.pop_back();
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if(!deadlines.empty()){
+        int64_t ns = chrono::duration_cast<chrono::nanoseconds>(deadlines.front().when.time_since_epoch()).count();
+        ns = max<int64_t>(ns, 1); // zero desarmaria o timer
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+    }
+    timerfd_settime(timerFileDescriptor, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void SessionMultiplexer::flushSends(){
+    /*
+    Submete o lote de cada socket (um sendmmsg com os pacotes de todas as suas sessões)
+    e só então devolve ao pool os pacotes liberados, cujos cabeçalhos estavam no lote.
+    Uma falha de envio não derruba nenhuma sessão: os pacotes seguem na janela e são
+    retransmitidos no prazo.
+    */
+    for(unique_ptr<MuxSocket> & socket : sockets){
+        if(socket->io.pendingSends() > 0 && !socket->io.flushSends()){
+            SLOW_LOG_ERROR("Erro no envio do lote");
+            socket->io.discardSends();
+        }
+    }
+
+    for(uint32_t index : retiredPackets){
+        packets[index].next = freePackets;
+        freePackets = index;
+    }
+    if(!retiredPackets.empty()){
+        retiredPackets.clear();
+        for(uint32_t session : packetWaiters){
+            if(sessions[session].open){
+                this->schedulePump(session);
+            }
+        }
+        packetWaiters.clear();
+    }
+}
+
+uint32_t SessionMultiplexer::allocateOperation(){
+    uint32_t index;
+    if(freeOperations != MUX_NIL){
+        index = freeOperations;
+        freeOperations = operations[index].next;
+        operations[index] = MuxOperation();
+    }else{
+        index = operations.size();
+        operations.emplace_back();
+    }
+    return index;
+}
+
+void SessionMultiplexer::releaseOperation(uint32_t index){
+    MuxOperation & operation = operations[index];
+    operation.onComplete = nullptr;
+    operation.data = string_view();
+    operation.next = freeOperations;
+    freeOperations = index;
+}
+
+uint32_t SessionMultiplexer::allocatePacket(){
+    /*
+    Pega um pacote do pool compartilhado.
+
+    return  índice do pacote; MUX_NIL se o pool acabou.
+    */
+    uint32_t index;
+    if(freePackets != MUX_NIL){
+        index = freePackets;
+        freePackets = packets[index].next;
+    }else if(packets.size() < packetPoolSize){
+        index = packets.size();
+        packets.emplace_back();
+    }else{
+        return MUX_NIL;
+    }
+    packets[index].generation++;
+    livePackets++;
+    return index;
+}
+
+void SessionMultiplexer::releasePacket(uint32_t index){
+    packets[index].session = MUX_NIL;
+    livePackets--;
+    retiredPackets.push_back(index);
+}
+
+bool SessionMultiplexer::windowHasRoom(const MuxSession & session, size_t payloadSize) const{
+    /*
+    Como Peripheral::windowHasRoom() (janela da central e de congestionamento), mais o
+    limite do pool compartilhado.
+    */
+    if(freePackets == MUX_NIL && packets.size() >= packetPoolSize){
+        return false;
+    }
+    if(session.firstPacket == MUX_NIL){
+        return true;
+    }
+    if(session.packetsInFlight >= MUX_MAX_SESSION_PACKETS){
+        return false;
+    }
+    return session.bytesInFlight + payloadSize <= session.congestion.limit(session.centralWindow);
+}
+
+bool SessionMultiplexer::queuePacket(uint32_t id, const HeaderImage & image, uint32_t ackNum, const uint8_t * payload,
+                                     size_t payloadSize, uint8_t fid, uint8_t fo, uint8_t extraFlags){
+    /*
+    Carimba um pacote novo da sessão a partir da imagem, coloca no fim da janela dela e
+    no lote de envio do socket.
+
+    return  false se o pool acabou ou o envio falhou.
+    */
+    uint32_t index = this->allocatePacket();
+    if(index == MUX_NIL){
+        return false;
+    }
+
+    MuxSession & session = sessions[id];
+    MuxPacket & packet = packets[index];
+    packet.seqNum = session.nextSeqNum;
+    image.stamp(packet.header, packet.seqNum, ackNum, fid, fo, extraFlags);
+    packet.payload = payload;
+    packet.payloadSize = payloadSize;
+    packet.session = id;
+    packet.next = MUX_NIL;
+    packet.retries = 0;
+    packet.laterAcks = 0;
+    packet.acked = false;
+
+    if(!this->transmitPacket(packet, index)){
+        this->releasePacket(index);
+        return false;
+    }
+
+    if(session.lastPacket == MUX_NIL){
+        session.firstPacket = index;
+    }else{
+        packets[session.lastPacket].next = index;
+    }
+    session.lastPacket = index;
+    session.packetsInFlight++;
+    session.bytesInFlight += payloadSize;
+    session.nextSeqNum++;
+    return true;
+}
+
+bool SessionMultiplexer::transmitPacket(MuxPacket & packet, uint32_t index){
+    /*
+    Enfileira (ou reenfileira) o pacote no lote do socket da sessão e registra o prazo
+    de retransmissão no heap.
+    */
+    MuxSession & session = sessions[packet.session];
+    if(!sockets[session.socketIndex]->io.queueSend(packet.header, SLOW_HEADER_SIZE, packet.payload, packet.payloadSize)){
+        return false;
+    }
+    packet.sentAt = SlowClock::now();
+    packet.deadline = packet.sentAt + session.rtt.rto();
+    this->pushDeadline(packet.deadline, index, packet.generation, false);
+    return true;
+}
+
+void SessionMultiplexer::slideWindow(uint32_t id){
+    MuxSession & session = sessions[id];
+    while(session.firstPacket != MUX_NIL && packets[session.firstPacket].acked){
+        uint32_t index = session.firstPacket;
+        session.firstPacket = packets[index].next;
+        session.packetsInFlight--;
+        this->releasePacket(index);
+    }
+    if(session.firstPacket == MUX_NIL){
+        session.lastPacket = MUX_NIL;
+    }
+}
+
+void SessionMultiplexer::clearWindow(uint32_t id){
+    MuxSession & session = sessions[id];
+    for(uint32_t index = session.firstPacket; index != MUX_NIL; ){
+        uint32_t next = packets[index].next;
+        this->releasePacket(index);
+        index = next;
+    }
+    session.firstPacket = MUX_NIL;
+    session.lastPacket = MUX_NIL;
+    session.packetsInFlight = 0;
+    session.bytesInFlight = 0;
+}
@@ -0,0 +1,224 @@
+#ifndef MULTIPLEXER_H
+#define MULTIPLEXER_H
+
+#include "slow.h"
+#include "rtt.h"
+#include "congestion.h"
+#include "batchio.h"
+#include "messages.h"
+#include "peripheral.h" // OperationId, OperationKind e CompletionCallback
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+using MuxSessionId = uint32_t;
+const MuxSessionId INVALID_MUX_SESSION = UINT32_MAX;
+const uint32_t MUX_NIL = UINT32_MAX;                // fim das listas encadeadas por índice
+const size_t MUX_DEFAULT_PACKET_POOL = 64 * 1024;   // pacotes em trânsito somando todas as sessões
+const size_t MUX_MAX_SESSION_PACKETS = MAX_IN_FLIGHT_PACKETS;
+
+enum class MuxSessionState : uint8_t {
+    IDLE,        // sem sessão com a central
+    WAITING,     // na fila de handshake do socket
+    CONNECTING,  // Connect enviado, esperando o Setup
+    ESTABLISHED
+};
+
+struct MuxSession {
+    /*
+    Estado de uma sessão no multiplexador: só o que muda por sessão. O SID e o STTL
+    ficam dentro da imagem de Data, e os pacotes e operações ficam nos pools
+    compartilhados, ligados por índice.
+    */
+    HeaderImage dataImage;          // SID, STTL, flags e janela já serializados
+    RttEstimator rtt;
+    CongestionController congestion;
+    SlowClock::time_point handshakeSentAt;
+    SlowClock::time_point handshakeDeadline;
+    uint32_t sttl = 0;
+    uint32_t nextSeqNum = 0;
+    uint32_t lastCentralSeqNum = 0;
+    uint32_t bytesInFlight = 0;
+    uint32_t firstPacket = MUX_NIL; // janela de envio, em ordem de seqNum
+    uint32_t lastPacket = MUX_NIL;
+    uint32_t firstOperation = MUX_NIL;
+    uint32_t lastOperation = MUX_NIL;
+    uint32_t nextWaiting = MUX_NIL; // fila de handshake do socket (ou lista de sessões livres)
+    uint32_t generation = 0;        // muda a cada open(), invalida prazos antigos no heap
+    uint16_t centralWindow = 0;
+    uint16_t packetsInFlight = 0;
+    MuxSessionState state = MuxSessionState::IDLE;
+    uint8_t socketIndex = 0;
+    uint8_t handshakeAttempts = 0;
+    uint8_t nextFid = 0;            // fids por sessão: a central monta fragmentos por (SID, fid)
+    bool open = false;
+    bool pumpQueued = false;
+};
+
+static_assert(sizeof(MuxSession) <= 256, "uma sessão do multiplexador deve caber em poucas linhas de cache");
+
+struct MuxPacket {
+    uint8_t header[SLOW_HEADER_SIZE];
+    const uint8_t * payload = nullptr; // fatia do buffer do chamador
+    SlowClock::time_point sentAt;
+    SlowClock::time_point deadline;
+    uint32_t seqNum = 0;
+    uint32_t payloadSize = 0;
+    uint32_t session = MUX_NIL;
+    uint32_t next = MUX_NIL;           // próximo da mesma sessão (ou da lista livre)
+    uint32_t generation = 0;           // muda a cada reuso do slot
+    uint16_t retries = 0;
+    uint16_t laterAcks = 0;            // ACKs de pacotes enviados depois dele (retransmissão rápida)
+    bool acked = false;
+};
+
+struct MuxOperation {
+    OperationId id = 0;
+    OperationKind kind = OperationKind::SEND;
+    string_view data;
+    size_t nextOffset = 0;
+    uint32_t lastSeqNum = 0;
+    uint32_t next = MUX_NIL;
+    uint32_t segmentEnd = 0;     // seqNum do último pacote do segmento anterior
+    uint8_t fid = 0;
+    uint8_t nextFo = 0;
+    bool segmentPending = false; // como em PeripheralOperation
+    bool started = false;
+    bool allQueued = false;
+    CompletionCallback onComplete;
+};
+
+struct MuxDeadline {
+    SlowClock::time_point when;
+    uint32_t index;      // pacote, ou sessão se handshake
+    uint32_t generation;
+    bool handshake;
+
+    bool operator>(const MuxDeadline & other) const { return when > other.when; }
+};
+
+struct MuxSocket {
+    int fileDescriptor = -1;
+    BatchIO io;
+    uint32_t handshakeSession = MUX_NIL; // o Setup não traz nada que o ligue ao Connect: um handshake por vez
+    uint32_t firstWaiting = MUX_NIL;
+    uint32_t lastWaiting = MUX_NIL;
+};
+
+class SessionMultiplexer{
+    /*
+    Muitas sessões SLOW sobre poucos sockets UDP, num único laço de eventos (epoll + um
+    timerfd). Os datagramas da central são encaminhados pelo SID para a sessão, e os
+    envios de todas as sessões de um socket saem juntos no mesmo sendmmsg.
+
+    Cada sessão ocupa só uma linha da tabela de sessões (sizeof(MuxSession)); os pacotes
+    em trânsito vêm de um pool compartilhado de tamanho fixo e os prazos de retransmissão
+    ficam num heap único, então o custo de uma sessão parada é essa linha mais uma entrada
+    no mapa de SIDs.
+
+    O Setup da central não carrega nada que o associe a um Connect (SID Nil, ackNum 0),
+    então cada socket tem no máximo um handshake em andamento e as outras sessões esperam
+    na fila; mais sockets (initNetwork(..., socketCount)) fazem handshakes em paralelo.
+    Revive e dados vindos da central não são tratados aqui: use o Peripheral para isso.
+
+    As operações seguem a semântica do Peripheral: assíncronas, em ordem por sessão, com
+    o callback chamado de dentro de runOnce() (ou da própria chamada, se falhar na hora).
+    */
+    public:
+        explicit SessionMultiplexer(size_t packetPoolSize = MUX_DEFAULT_PACKET_POOL);
+        ~SessionMultiplexer();
+
+        bool initNetwork(const char * hostName, int port, int socketCount = 1);
+
+        MuxSessionId openSession();
+        void closeSession(MuxSessionId session);
+
+        OperationId connectAsync(MuxSessionId session, CompletionCallback onComplete = nullptr);
+        OperationId sendDataAsync(MuxSessionId session, string_view data, CompletionCallback onComplete = nullptr);
+        OperationId disconnectAsync(MuxSessionId session, CompletionCallback onComplete = nullptr);
+
+        int runOnce(chrono::milliseconds timeout);
+        int getEventFileDescriptor() const { return epollFileDescriptor; }
+
+        bool isConnected(MuxSessionId session) const;
+        size_t sessionCount() const { return openSessions; }
+        size_t connectedSessions() const { return sessionsBySid.size(); }
+        static constexpr size_t sessionFootprint() { return sizeof(MuxSession); }
+
+        void setRetransmissionPolicy(const RetransmissionPolicy & policy) { this->policy = policy; }
+        void setCongestionAlgorithm(CongestionAlgorithm algorithm) { congestionAlgorithm = algorithm; } // sessões abertas depois
+    private:
+        int epollFileDescriptor;
+        int timerFileDescriptor;
+        struct sockaddr_in centralAddress;
+        vector<unique_ptr<MuxSocket>> sockets;
+
+        // deque: referências continuam válidas quando um callback abre sessões ou enfileira operações
+        deque<MuxSession> sessions;
+        uint32_t freeSessions = MUX_NIL;
+        size_t openSessions = 0;
+        unordered_map<SID, uint32_t, SIDHash, SIDEqual> sessionsBySid;
+
+        deque<MuxPacket> packets; // capacidade fixa: o BatchIO guarda ponteiros para os cabeçalhos
+        size_t packetPoolSize;
+        uint32_t freePackets = MUX_NIL;
+        size_t livePackets = 0;
+        vector<uint32_t> retiredPackets; // liberados, mas o cabeçalho ainda pode estar no lote de envio
+        vector<uint32_t> packetWaiters;  // sessões paradas porque o pool acabou
+
+        deque<MuxOperation> operations;
+        uint32_t freeOperations = MUX_NIL;
+        OperationId nextOperationId = 1;
+
+        // heap de prazos (pacotes e handshakes); entradas velhas são descartadas quando chegam ao topo
+        vector<MuxDeadline> deadlines;
+
+        vector<uint32_t> pumpQueue; // sessões com operações para avançar
+        bool processing = false;
+
+        RetransmissionPolicy policy;
+        CongestionAlgorithm congestionAlgorithm = CongestionAlgorithm::NEWRENO;
+
+        OperationId enqueueOperation(MuxSessionId session, OperationKind kind, string_view data, CompletionCallback onComplete);
+        void schedulePump(uint32_t session);
+        void drainPumps();
+        void pumpSession(uint32_t session);
+        bool startOperation(uint32_t session, MuxOperation & operation);
+        bool fillWindow(uint32_t session, MuxOperation & operation);
+        bool operationFinished(const MuxSession & session, const MuxOperation & operation) const;
+        void finishOperation(uint32_t session, bool success);
+        void failSession(uint32_t session);
+        void endSession(uint32_t session);
+
+        bool beginHandshake(uint32_t session);
+        void startNextHandshake(MuxSocket & socket);
+        void unlinkWaiting(uint32_t session);
+        void handleDatagram(uint8_t socketIndex, const Datagram & datagram);
+        void handleSetup(MuxSocket & socket, const Datagram & datagram);
+        void handleAck(uint32_t session, const Datagram & datagram);
+        void handleTimer();
+        bool deadlineValid(const MuxDeadline & deadline) const;
+        void pushDeadline(SlowClock::time_point when, uint32_t index, uint32_t generation, bool handshake);
+        void armTimer();
+        void flushSends();
+        void settle();
+        void closeNetwork();
+
+        uint32_t allocateOperation();
+        void releaseOperation(uint32_t operation);
+        uint32_t allocatePacket();
+        void releasePacket(uint32_t packet);
+        bool windowHasRoom(const MuxSession & session, size_t payloadSize) const;
+        bool queuePacket(uint32_t session, const HeaderImage & image, uint32_t ackNum, const uint8_t * payload,
+                         size_t payloadSize, uint8_t fid = 0, uint8_t fo = 0, uint8_t extraFlags = 0);
+        bool transmitPacket(MuxPacket & packet, uint32_t index);
+        void slideWindow(uint32_t session);
+        void clearWindow(uint32_t session);
+};
+
+#endif
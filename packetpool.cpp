@@ -0,0 +1,71 @@
+#include "packetpool.h"
+
+PacketPool::PacketPool(size_t capacity) : buffers(nullptr), freeList(nullptr), count(0), freeCount(0){
+    this->reserve(capacity);
+}
+
+PacketPool::~PacketPool(){
+    free(buffers);
+}
+
+void PacketPool::reserve(size_t capacity){
+    /*
+    Aloca os buffers do pool. Só vale antes do primeiro uso: com buffers emprestados,
+    trocar o bloco invalidaria os ponteiros dos donos.
+    */
+    if(capacity == 0 || freeCount != count){
+        return;
+    }
+    free(buffers);
+    buffers = static_cast<PacketBuffer *>(aligned_alloc(alignof(PacketBuffer), capacity * sizeof(PacketBuffer)));
+    count = buffers != nullptr ? capacity : 0;
+    freeCount = 0;
+    freeList = nullptr;
+    for(size_t i = count; i > 0; i--){
+        PacketBuffer * buffer = new (&buffers[i - 1]) PacketBuffer();
+        buffer->next = freeList;
+        freeList = buffer;
+        freeCount++;
+    }
+}
+
+PacketBuffer * PacketPool::acquire(){
+    /*
+    Tira um buffer da lista livre, com uma referência (a de quem pediu).
+
+    return  nullptr se o pool está vazio.
+    */
+    PacketBuffer * buffer = freeList;
+    if(buffer == nullptr){
+        return nullptr;
+    }
+    freeList = buffer->next;
+    freeCount--;
+    buffer->next = nullptr;
+    buffer->payloadSize = 0;
+    buffer->refs = 1;
+    return buffer;
+}
+
+void PacketPool::release(PacketBuffer * buffer){
+    /*
+    Devolve uma referência; com a última, o buffer volta para a lista livre.
+    */
+    if(--buffer->refs > 0){
+        return;
+    }
+    buffer->next = freeList;
+    freeList = buffer;
+    freeCount++;
+}
+
+void PacketPool::releaseChain(PacketBuffer * first){
+    /*
+    Devolve uma referência de cada buffer de uma mensagem (encadeados por next).
+    */
+    while(first != nullptr){
+        PacketBuffer * next = first->next; // release() pode reaproveitar next para a lista livre
+        this->release(first);
+        first = next;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef PACKETPOOL_H
+#define PACKETPOOL_H
+
+#include "slow.h"
+#include "reassembly.h" // CACHE_LINE_SIZE
+
+struct alignas(CACHE_LINE_SIZE) PacketBuffer {
+    /*
+    Um datagrama SLOW inteiro (cabeçalho + até MAX_DATA_SIZE bytes de dados), contíguo e
+    começando numa linha de cache. Pertence a quem tem uma referência (refs); com a última
+    devolvida, volta para a lista livre do pool.
+    */
+    SlowPacket packet;
+    uint16_t payloadSize = 0;
+    uint16_t refs = 0;
+    PacketBuffer * next = nullptr; // próximo fragmento da mesma mensagem, ou da lista livre
+
+    uint8_t * bytes() { return reinterpret_cast<uint8_t *>(&packet); }
+    const uint8_t * payload() const { return packet.data; }
+};
+
+static_assert(offsetof(PacketBuffer, packet) == 0 && sizeof(SlowPacket) == SLOW_HEADER_SIZE + MAX_DATA_SIZE,
+              "o cabeçalho e os dados do PacketBuffer precisam ser contíguos");
+
+class PacketPool{
+    /*
+    Pool de buffers de pacote com contagem de referências. Todos os buffers são alocados de
+    uma vez em reserve(); acquire()/release() só mexem na lista livre, então o caminho de
+    envio não toca no heap. Um buffer pode ter mais de um dono (ex.: a janela de envio e a
+    operação que ainda espera as conclusões do MSG_ZEROCOPY): cada um chama retain() ao
+    pegá-lo e release() ao largá-lo.
+    */
+    public:
+        explicit PacketPool(size_t capacity = 0);
+        ~PacketPool();
+
+        PacketPool(const PacketPool &) = delete;
+        PacketPool & operator=(const PacketPool &) = delete;
+
+        void reserve(size_t capacity);
+        PacketBuffer * acquire();
+        void retain(PacketBuffer * buffer) { buffer->refs++; }
+        void release(PacketBuffer * buffer);
+        void releaseChain(PacketBuffer * first);
+
+        size_t capacity() const { return count; }
+        size_t available() const { return freeCount; }
+    private:
+        PacketBuffer * buffers;
+        PacketBuffer * freeList;
+        size_t count;
+        size_t freeCount;
+};
+
+#endif
@@ -1,8 +1,20 @@
 #include "peripheral.h"
-
-static int current_fid = 0;
-
-Peripheral::Peripheral() : sockFileDescriptor(-1), sessionON(false), nextSeqNumToSend(0){
+#include "logger.h"
+
+// Um fid só volta a ser usado depois de 255 outros segmentos fragmentados (2+ pacotes cada)
+// começarem, e todos eles ficam na janela depois do pacote mais antigo sem ACK: com até
+// 510 pacotes nela, um fid nunca é reutilizado enquanto o seu segmento ainda pode estar
+// em montagem na central. Vale também para o multiplexador (MUX_MAX_SESSION_PACKETS).
+static_assert(MAX_IN_FLIGHT_PACKETS <= 2 * 255, "a janela de envio permitiria reutilizar um fid ainda em uso");
+// Um segmento abortado, porém, deixa o seu slot na central com o mesmo (SID, fid): ela separa
+// as mensagens pelos seqNums (fragmentos numerados em ordem de fo, a janela inteira antes
+// do próximo segmento) e só descarta um slot parado quando nenhum fragmento dele pode mais
+// estar na janela, a uma janela mais um segmento de distância.
+static_assert(MAX_IN_FLIGHT_PACKETS + SEGMENT_MAX_FRAGMENTS <= REASSEMBLY_STALE_SPAN,
+              "a central poderia descartar o slot de um segmento ainda em envio");
+
+Peripheral::Peripheral() : sockFileDescriptor(-1), epollFileDescriptor(-1), timerFileDescriptor(-1), transportFileDescriptor(-1), sessionON(false), nextSeqNumToSend(0), inFlight(MAX_IN_FLIGHT_PACKETS),
+    operations(INITIAL_OPERATION_SLOTS), ackHeaders(IO_BATCH_SIZE){
     /*
     Inicializa toda a estrutura do objeto Peripheral com valores padrão
     */
@@ -13,40 +25,47 @@ Peripheral::Peripheral() : sockFileDescriptor(-1), sessionON(false), nextSeqNumT
 Peripheral::~Peripheral(){
     /*
     Destrutor da classe Peripheral.
-    Verifica se o socket está aberto, e o fecha.
+    Verifica se o socket está aberto, e o fecha (junto com o epoll e o timerfd do laço de eventos).
     */
     
     if(sockFileDescriptor >= 0){
-        cout << "fechando o socket" << '\n';
+        SLOW_LOG_DEBUG("fechando o socket");
         close(sockFileDescriptor);
     }
+    for(int fd : {epollFileDescriptor, timerFileDescriptor}){
+        if(fd >= 0){
+            close(fd);
+        }
+    }
 }
 
 bool Peripheral::initNetwork(const char * hostName, int port){
 /*
  Inicializa a conexão de rede com a central.
  
-  Abre um socket UDP, resolve o nome do host, configura o endereço e a porta
-  do servidor central, e define um timeout de recebimento.
+  Abre um socket UDP, resolve o nome do host e configura o endereço e a porta
+  do servidor central. Não há timeout global no socket: runOnce() espera no epoll até
+  um datagrama ou até o timerfd, armado com o prazo mais próximo (RTO) da janela ou do
+  handshake (ver armTimer()).
  
   param   hostName  Nome ou endereço do servidor central.
   param   port      Porta UDP em que o servidor está escutando.
   return  true se o socket foi criado e configurado com sucesso;
-          false em caso de falha na criação do socket, resolução do host ou configuração do timeout.
+          false em caso de falha na criação do socket ou resolução do host.
  */
     
     sockFileDescriptor = socket(AF_INET, SOCK_DGRAM, 0);
 
     if(sockFileDescriptor < 0){
-        cout << "Problema na criação do socket!!\n";
+        SLOW_LOG_ERROR("Problema na criação do socket!!");
         return 0;
     }
-    cout << " Socket UDP criado com sucesso: " << sockFileDescriptor << '\n';
+    SLOW_LOG_INFO(" Socket UDP criado com sucesso: ", sockFileDescriptor);
 
     struct hostent * serverInfo;
     serverInfo = gethostbyname(hostName); // <- acho q n aceita a classe string 
     if(serverInfo == NULL){
-        cout << "Problema em pegar o host!\n";
+        SLOW_LOG_ERROR("Problema em pegar o host!");
         close(sockFileDescriptor);
         sockFileDescriptor = -1;
         return 0;
@@ -56,202 +75,916 @@ bool Peripheral::initNetwork(const char * hostName, int port){
     memcpy(&centralAddress.sin_addr.s_addr, serverInfo->h_addr_list[0], serverInfo->h_length); // Copia o endereço da central.
     centralAddress.sin_port = htons(port); // Salva número da porta.
 
-    cout << "Endereço central: " << hostName << ":" << port << '\n';
-
-    //configurando o timeout
+    SLOW_LOG_INFO("Endereço central: ", hostName, ":", port);
 
-    struct timeval timeVal;
-    timeVal.tv_sec = 3000; // timeout definido para 5 segundos
-    timeVal.tv_usec = 0; // microssegundos
+    // laço de eventos: o socket e um timerfd armado com o prazo de retransmissão mais próximo
+    epollFileDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    timerFileDescriptor = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(epollFileDescriptor < 0 || timerFileDescriptor < 0){
+        perror("epoll/timerfd");
+        this->closeNetwork();
+        return 0;
+    }
 
-    if(setsockopt(sockFileDescriptor, SOL_SOCKET, SO_RCVTIMEO, (const char * )&timeVal, sizeof(timeVal)) < 0){
-        cout << "WARNING: Falha em configurar o timeout\n";
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    for(int fd : {sockFileDescriptor, timerFileDescriptor}){
+        event.data.fd = fd;
+        if(epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, fd, &event) < 0){
+            perror("epoll_ctl");
+            this->closeNetwork();
+            return 0;
+        }
     }
+    io.attach(sockFileDescriptor, centralAddress);
+    transportFileDescriptor = sockFileDescriptor;
 
     return 1;
 }
 
+void Peripheral::closeNetwork(){
+    /*
+    Fecha o socket e os descritores do laço de eventos que chegaram a ser abertos por um
+    initNetwork() que falhou no meio, deixando-os em -1.
+    */
+    for(int * fd : {&sockFileDescriptor, &epollFileDescriptor, &timerFileDescriptor}){
+        if(*fd >= 0){
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
 bool Peripheral::connect(){
     /*
     Inicia a conexão com a central. Envia a mensagem de solicitação de conexão e processa a
-    mensagem de setup recebida da central.
+    mensagem de setup recebida da central. Versão síncrona de connectAsync(): roda o laço
+    de eventos até a conexão terminar.
 
     return  true se conexão for estabelecida corretamente;
             false caso algum problema ocorra.
     */
     
-    if(this->sendConnectMessage()){
-        if(this->waitSetupMessage()){
-            cout << "Setup bem sucedido\n";
-            
-            if(this->sendDataMessage()){
-                cout << "Envio de Data com sucesso\n";
-                if(this->waitAck()==AckStatus::ACK_OK){
-                    cout<< "Recebimento do ACK foi feito com êxito\n";
-                    cout << "CONEXÃO COMPLETAMENTE ESTABELECIDA\n";
-                    return 1;
-                }else{
-                    cout << "Falha na captura do ACK\n";
-                }
-            }else{
-                cout << "Falha no envio de Data\n";
-            }
-        }else{
-            cout << "Falha no setup da conexão\n";
-        }
-    }else{
-        cout << "Falha no envio da connect\n";
-    }
+    bool done = false, success = false;
+    this->connectAsync([&](OperationId, bool ok){ done = true; success = ok; });
+    return this->runUntil(done) && success;
+}
 
-    return 0;
+bool Peripheral::sendFile(const string & path){
+    /*
+    Envia o conteúdo de um arquivo como uma mensagem, lendo os fragmentos sob demanda.
+    Versão síncrona de sendFileAsync().
+
+    return  true se todos os fragmentos foram confirmados.
+    */
+    bool done = false, success = false;
+    this->sendFileAsync(path, [&](OperationId, bool ok){ done = true; success = ok; });
+    return this->runUntil(done) && success;
+}
+
+bool Peripheral::sendFd(int fd, off_t offset, size_t length){
+    /*
+    Envia length bytes de fd a partir de offset como uma mensagem. Versão síncrona de sendFdAsync().
+
+    return  true se todos os fragmentos foram confirmados.
+    */
+    bool done = false, success = false;
+    this->sendFdAsync(fd, offset, length, [&](OperationId, bool ok){ done = true; success = ok; });
+    return this->runUntil(done) && success;
 }
 
 bool Peripheral::disconnect(){
     /*
     Encerra a conexão com a central. Envia a mensagem de desconexão e
-    processa o retorno da central.
+    processa o retorno da central (versão síncrona de disconnectAsync()).
 
     return  true se conexão for fechada corretamente;
             false caso algum problema ocorra.
 
     */
     
-    if(this->sendDisconnectMessage()){
-        if(this->waitAck()==AckStatus::ACK_OK){
-            this->storeSession();
-            this->sessionON = false;
-            return 1;
+    bool done = false, success = false;
+    this->disconnectAsync([&](OperationId, bool ok){ done = true; success = ok; });
+    return this->runUntil(done) && success;
+}
+
+OperationId Peripheral::connectAsync(CompletionCallback onComplete){
+    /*
+    Começa a conexão com a central sem bloquear: envia o Connect e retorna. O laço de
+    eventos (runOnce()) trata o Setup, as retransmissões do Connect com backoff e o Data
+    inicial; onComplete(id, true) é chamado quando o ACK desse Data chega.
+
+    return  identificador da operação (o mesmo passado ao callback).
+    */
+    return enqueueOperation(OperationKind::CONNECT, string_view(), move(onComplete));
+}
+
+OperationId Peripheral::sendDataAsync(string_view data, CompletionCallback onComplete){
+    /*
+    Enfileira uma mensagem para a central e retorna. Os fragmentos vão para a rede à
+    medida que a janela da central abre, e onComplete é chamado quando todos forem
+    confirmados. data não é copiado: precisa continuar válido até o callback.
+
+    return  identificador da operação.
+    */
+    return enqueueOperation(OperationKind::SEND, data, move(onComplete));
+}
+
+OperationId Peripheral::sendDataCopyAsync(string_view data, CompletionCallback onComplete){
+    /*
+    Como sendDataAsync(), mas os dados são copiados na hora para buffers do pool de pacotes
+    (um por fragmento), então data pode ser descartado logo após o retorno. Cada buffer já
+    guarda o datagrama inteiro: o cabeçalho é carimbado nele quando o fragmento entra na
+    janela, as retransmissões reenviam o mesmo buffer, e ele volta ao pool com o ACK.
+    Sem buffers livres para a mensagem inteira (mensagem maior que o pool, ou outras
+    mensagens copiadas ainda em trânsito), a cópia vai para memória da própria operação,
+    numa alocação, e sai da janela como a de sendDataAsync().
+
+    return  identificador da operação.
+    */
+    if(packetPool.capacity() == 0){
+        packetPool.reserve(PACKET_POOL_SIZE);
+    }
+
+    size_t fragments = max<size_t>(1, (data.size() + MAX_DATA_SIZE - 1) / MAX_DATA_SIZE);
+    if(fragments > packetPool.available()){
+        SLOW_LOG_DEBUG("Pool de pacotes sem buffers livres para a mensagem (", fragments, " fragmentos): cópia própria");
+        PeripheralOperation & operation = this->prepareOperation(OperationKind::SEND, string_view(), move(onComplete));
+        operation.ownedData.assign(data.begin(), data.end());
+        operation.data = string_view(operation.ownedData.data(), operation.ownedData.size());
+        OperationId id = operation.id;
+        this->pumpOperations();
+        return id;
+    }
+
+    PacketBuffer * first = nullptr;
+    PacketBuffer * last = nullptr;
+    for(size_t offset = 0; offset < data.size() || first == nullptr; offset += MAX_DATA_SIZE){
+        string_view fragment = data.substr(offset, MAX_DATA_SIZE);
+        PacketBuffer * buffer = packetPool.acquire();
+        if(!fragment.empty()){
+            memcpy(buffer->packet.data, fragment.data(), fragment.size());
+        }
+        buffer->payloadSize = fragment.size();
+        (last != nullptr ? last->next : first) = buffer;
+        last = buffer;
+    }
+
+    PeripheralOperation & operation = this->prepareOperation(OperationKind::SEND, string_view(), move(onComplete));
+    operation.buffers = first;
+    operation.nextBuffer = first;
+    OperationId id = operation.id;
+    this->pumpOperations();
+    return id;
+}
+
+OperationId Peripheral::sendFdAsync(int fd, off_t offset, size_t length, CompletionCallback onComplete){
+    /*
+    Enfileira como uma mensagem os length bytes de fd a partir de offset. Os fragmentos
+    são lidos com pread() só quando cabem na janela, cada um para um buffer do pool de
+    pacotes que volta ao pool com o ACK: a memória usada não depende do tamanho do envio.
+    A posição de fd não muda, e fd precisa continuar aberto até o callback. Uma falha de
+    leitura (ex.: o arquivo encolheu) aborta a janela de envio, como uma falha de envio.
+
+    return  identificador da operação.
+    */
+    if(fd < 0 || offset < 0){
+        return this->rejectOperation(move(onComplete));
+    }
+    return this->enqueueSource(fd, offset, length, false, move(onComplete));
+}
+
+OperationId Peripheral::sendFileAsync(const string & path, CompletionCallback onComplete){
+    /*
+    Enfileira o conteúdo inteiro de um arquivo como uma mensagem (ver sendFdAsync()).
+    O arquivo é aberto aqui e fechado quando a operação termina.
+
+    return  identificador da operação; se o arquivo não abrir, o callback é chamado com
+            false antes do retorno.
+    */
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) < 0 || !S_ISREG(info.st_mode)){
+        SLOW_LOG_ERROR("Não foi possível abrir o arquivo ", path, ": ", strerror(errno));
+        if(fd >= 0){
+            close(fd);
+        }
+        return this->rejectOperation(move(onComplete));
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return this->enqueueSource(fd, 0, info.st_size, true, move(onComplete));
+}
+
+OperationId Peripheral::enqueueSource(int fd, off_t offset, size_t length, bool closeSource, CompletionCallback onComplete){
+    /*
+    Enfileira um SEND lido de fd sob demanda; com closeSource, fd é fechado quando a
+    operação termina (inclusive se ela falhar antes do retorno).
+    */
+    if(packetPool.capacity() == 0){
+        packetPool.reserve(PACKET_POOL_SIZE);
+    }
+
+    PeripheralOperation & operation = this->prepareOperation(OperationKind::SEND, string_view(), move(onComplete));
+    operation.sourceFd = fd;
+    operation.sourceOffset = offset;
+    operation.sourceSize = length;
+    operation.closeSource = closeSource;
+    OperationId id = operation.id;
+    this->pumpOperations();
+    return id;
+}
+
+OperationId Peripheral::disconnectAsync(CompletionCallback onComplete){
+    /*
+    Enfileira o Disconnect; ele sai depois que as mensagens anteriores forem confirmadas.
+    Com o ACK, a sessão é guardada para revive (storeSession()).
+
+    return  identificador da operação.
+    */
+    return enqueueOperation(OperationKind::DISCONNECT, string_view(), move(onComplete));
+}
+
+OperationId Peripheral::zeroWayConnectAsync(string_view data, CompletionCallback onComplete){
+    /*
+    Enfileira um revive (0-way connect) da sessão anterior levando data, que precisa
+    continuar válido até o callback. onComplete(id, true) indica que a central aceitou.
+
+    return  identificador da operação.
+    */
+    return enqueueOperation(OperationKind::REVIVE, data, move(onComplete));
+}
+
+OperationId Peripheral::enqueueOperation(OperationKind kind, string_view data, CompletionCallback onComplete){
+    /*
+    Coloca a operação no fim da fila e já tenta começá-la, para que os primeiros pacotes
+    saiam antes mesmo da próxima volta do laço. Se ela falhar na hora (ex.: sem sessão),
+    o callback é chamado antes do retorno.
+    */
+    OperationId id = this->prepareOperation(kind, data, move(onComplete)).id;
+    this->pumpOperations();
+    return id;
+}
+
+PeripheralOperation & Peripheral::prepareOperation(OperationKind kind, string_view data, CompletionCallback onComplete){
+    /*
+    Coloca a operação no fim da fila sem começá-la, para quem ainda precisa preencher a
+    origem dos dados (buffers copiados, arquivo). A referência vale até o pumpOperations().
+    */
+    if(operations.full()){
+        operations.grow();
+    }
+    PeripheralOperation & operation = operations.emplace_back();
+    operation.id = nextOperationId++;
+    operation.kind = kind;
+    operation.data = data;
+    operation.onComplete = move(onComplete);
+    return operation;
+}
+
+OperationId Peripheral::rejectOperation(CompletionCallback onComplete){
+    /*
+    Falha uma operação que nem chegou à fila: o callback é chamado antes do retorno.
+    */
+    OperationId id = nextOperationId++;
+    if(onComplete){
+        onComplete(id, false);
+    }
+    return id;
+}
+
+bool Peripheral::runUntil(const bool & done){
+    /*
+    Roda o laço de eventos até done virar true (o callback da operação o seta).
+    Usado pela API síncrona.
+
+    return  false se o laço de eventos falhar.
+    */
+    while(!done){
+        if(this->runOnce(chrono::milliseconds(1000)) < 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+int Peripheral::runOnce(chrono::milliseconds timeout){
+    /*
+    Uma volta do laço de eventos: submete os envios enfileirados, espera por pacotes da
+    central ou pelo prazo de retransmissão mais próximo (no máximo timeout; negativo
+    espera sem limite) e processa o que chegou, chamando os callbacks das operações
+    concluídas. Para embutir o peripheral em outro laço, registre getEventFileDescriptor()
+    (o epoll fica legível quando há trabalho) e chame runOnce(0) quando ele disparar.
+
+    return  número de eventos tratados; -1 em caso de erro.
+    */
+    if(epollFileDescriptor < 0){
+        SLOW_LOG_ERROR("Laço de eventos não inicializado (chame initNetwork())");
+        return -1;
+    }
+
+    this->pumpOperations();
+
+    // datagramas que já estão no anel (ex.: segmentos de um GRO) não geram evento no epoll
+    int waitMs = -1;
+    if(io.hasReceived()){
+        waitMs = 0;
+    }else if(timeout.count() >= 0){
+        waitMs = (int)min<int64_t>(timeout.count(), INT_MAX);
+    }
+
+    struct epoll_event events[4];
+    int ready = epoll_wait(epollFileDescriptor, events, 4, waitMs);
+    if(ready < 0){
+        if(errno == EINTR){
+            return 0;
+        }
+        perror("epoll_wait");
+        return -1;
+    }
+
+    bool readable = io.hasReceived();
+    bool timerFired = false;
+    for(int i = 0; i < ready; i++){
+        if(events[i].data.fd == timerFileDescriptor){
+            uint64_t expirations;
+            if(read(timerFileDescriptor, &expirations, sizeof(expirations)) > 0){
+                timerFired = true;
+            }
         }else{
-            cout << "Erro na validação do ack\n";
+            if(events[i].events & EPOLLERR){
+                this->handleSocketError();
+            }
+            if(events[i].events & EPOLLIN){
+                readable = true;
+            }
+        }
+    }
+
+    // primeiro os ACKs que chegaram, depois os prazos: um ACK no limite do prazo evita a retransmissão
+    if(readable){
+        Datagram datagram;
+        while(io.nextDatagram(datagram)){
+            this->handleDatagram(datagram);
+        }
+        if(errno != EAGAIN && errno != EWOULDBLOCK){
+            SLOW_LOG_ERROR("ERRO SISTEMA ao receber pacotes da central.");
+        }
+    }
+    if(timerFired){
+        this->handleTimer();
+    }
+
+    this->pumpOperations();
+    return ready;
+}
+
+void Peripheral::pumpOperations(){
+    /*
+    Faz as operações da fila avançarem:
+        - as concluídas saem pela frente, em ordem, e têm o callback chamado;
+        - mensagens (SEND) ocupam a janela de envio enquanto houver espaço, várias em sequência;
+        - CONNECT, DISCONNECT e REVIVE só começam na frente da fila, com a janela vazia,
+          e seguram as operações de trás até terminarem (os fragmentos do REVIVE ocupam
+          a janela como os de uma mensagem).
+    No fim, submete o lote de envio e rearma o timer com o prazo mais próximo.
+    Chamadas aninhadas (a partir de um callback) só registram a operação: a volta de fora continua.
+    */
+    if(pumping){
+        return;
+    }
+    pumping = true;
+
+    bool progress = true;
+    while(progress){
+        progress = false;
+
+        while(!operations.empty() && this->operationFinished(operations.front())){
+            this->finishOperation(true);
+            progress = true;
+        }
+
+        for(size_t i = 0; i < operations.size(); i++){
+            PeripheralOperation & operation = operations[i];
+
+            if(operation.kind == OperationKind::SEND){
+                if(operation.allQueued){
+                    continue;
+                }
+                if(sockFileDescriptor < 0 || !sessionON){
+                    if(i == 0){
+                        SLOW_LOG_ERROR("ERRO: Socket não inicializado ou sessão não ativa. Não é possível enviar dados de aplicação.");
+                        this->finishOperation(false);
+                        progress = true;
+                    }
+                    break;
+                }
+                if(!this->fillWindow(operation)){
+                    SLOW_LOG_WARN("Falha ao enviar os dados");
+                    this->failQueuedOperations();
+                    progress = true;
+                    break;
+                }
+                if(!operation.allQueued){
+                    break; // janela cheia
+                }
+            }else{
+                if(i == 0 && !operation.started && inFlight.empty()){
+                    if(!this->startOperation(operation)){
+                        this->finishOperation(false);
+                    }
+                    progress = true;
+                }else if(i == 0 && operation.kind == OperationKind::REVIVE && operation.started && !operation.allQueued){
+                    // revive maior que a janela: os próximos fragmentos saem conforme os ACKs chegam
+                    if(!this->fillWindow(operation)){
+                        SLOW_LOG_WARN("Falha ao enviar o revive");
+                        this->failQueuedOperations();
+                        progress = true;
+                    }
+                }
+                break;
+            }
+        }
+
+        if(io.pendingSends() > 0 && !io.flushSends()){
+            SLOW_LOG_ERROR("Erro no envio do lote");
+            this->failQueuedOperations();
+            progress = true;
+        }
+    }
+
+    pumping = false;
+    this->armTimer();
+}
+
+bool Peripheral::startOperation(PeripheralOperation & operation){
+    /*
+    Começa uma operação que precisa da janela vazia (CONNECT, DISCONNECT ou REVIVE).
+
+    return  false se ela já falhou no início.
+    */
+    operation.started = true;
+    SlowClock::time_point now = SlowClock::now();
+
+    switch(operation.kind){
+        case OperationKind::CONNECT:
+            handshakeAttempts = 0;
+            congestion.reset(congestion.getAlgorithm()); // sessão nova: o caminho pode ser outro
+            if(!this->sendConnectMessage()){
+                SLOW_LOG_WARN("Falha no envio da connect");
+                return false;
+            }
+            handshakePending = true;
+            handshakeSentAt = now;
+            handshakeDeadline = now + rtt.rto();
+            return true;
+
+        case OperationKind::DISCONNECT:
+            if(!this->sendDisconnectMessage()){
+                SLOW_LOG_WARN("Falha no envio da mensagem de disconnect");
+                return false;
+            }
+            operation.lastSeqNum = nextSeqNumToSend - 1;
+            operation.allQueued = true;
+            return true;
+
+        case OperationKind::REVIVE:
+            return this->startRevive(operation);
+
+        default:
+            return true;
+    }
+}
+
+bool Peripheral::operationFinished(const PeripheralOperation & operation){
+    /*
+    Uma operação com pacotes na janela (SEND, DISCONNECT, REVIVE) termina quando o último
+    deles é confirmado e sai da janela.
+    */
+    if(!operation.allQueued){
+        return false;
+    }
+    if(!inFlight.empty() && (int32_t)(inFlight.front().seqNum - operation.lastSeqNum) <= 0){
+        return false;
+    }
+    if(operation.kind == OperationKind::SEND && io.zeroCopyPending() > 0){
+        // com MSG_ZEROCOPY o kernel ainda pode estar lendo de data: só devolve o buffer ao chamador depois
+        io.reapCompletions();
+        return io.zeroCopyPending() == 0;
+    }
+    return true;
+}
+
+void Peripheral::finishOperation(bool success){
+    /*
+    Retira a operação da frente da fila, aplica o seu efeito final na sessão e chama o callback.
+    */
+    PeripheralOperation operation = move(operations.front());
+    operations.pop_front();
+    this->completeOperation(operation, success);
+}
+
+void Peripheral::completeOperation(PeripheralOperation & operation, bool success){
+    switch(operation.kind){
+        case OperationKind::CONNECT:
+            handshakePending = false;
+            if(success){
+                SLOW_LOG_DEBUG("Recebimento do ACK foi feito com êxito");
+                SLOW_LOG_INFO("CONEXÃO COMPLETAMENTE ESTABELECIDA");
+                sessionCache.store(centralAddress, currentSessionId, centralSttl, lastCentralSeqNum, nextSeqNumToSend, centralWindowSize);
+            }
+            break;
+        case OperationKind::REVIVE:
+            revivePending = false;
+            if(!success){
+                this->sessionON = false; // aceito só em parte: a sessão não é usada sem o revive completo
+            }
+            break;
+        case OperationKind::DISCONNECT:
+            if(success){
+                this->storeSession();
+            }else if(operation.allQueued){
+                SLOW_LOG_ERROR("Erro na validação do ack");
+            }
             this->sessionON = false;
+            break;
+        case OperationKind::SEND:
+            packetPool.releaseChain(operation.buffers);
+            operation.buffers = nullptr;
+            operation.nextBuffer = nullptr;
+            operation.ownedData = vector<char>();
+            if(operation.closeSource){
+                close(operation.sourceFd);
+                operation.closeSource = false;
+            }
+            break;
+    }
+
+    if(operation.onComplete){
+        operation.onComplete(operation.id, success);
+    }
+}
+
+void Peripheral::failQueuedOperations(){
+    /*
+    Aborta a janela de envio (retransmissões esgotadas ou erro de envio) e falha todas
+    as operações que já tinham começado. As que ainda não começaram seguem na fila.
+    Os callbacks só são chamados depois que a fila está consistente.
+    */
+    clearWindow();
+
+    vector<PeripheralOperation> failed;
+    while(!operations.empty() && operations.front().started){
+        failed.push_back(move(operations.front()));
+        operations.pop_front();
+    }
+    for(PeripheralOperation & operation : failed){
+        this->completeOperation(operation, false);
+    }
+}
+
+void Peripheral::handleDatagram(const Datagram & datagram){
+    /*
+    Encaminha um datagrama da central conforme o estado: resposta do revive, Setup do
+    handshake ou ACK da janela de envio.
+    */
+    if(revivePending){
+        switch(this->handleReviveResponse(datagram)){
+            case ReviveResponse::ACCEPTED:
+                if(!slideWindow()){
+                    this->failQueuedOperations();
+                }
+                break;
+            case ReviveResponse::FAILED:
+                this->failQueuedOperations();
+                break;
+            case ReviveResponse::IGNORED:
+                break;
+        }
+        return;
+    }
+
+    if(handshakePending && !operations.empty()){
+        // só um Setup (ackNum 0) responde ao Connect: um ACK atrasado da sessão anterior é ignorado
+        if(datagram.size < (size_t)SLOW_HEADER_SIZE || !SetupMessage::matches(datagram.data) ||
+           deserializationOf4bytes(datagram.data + WIRE_ACKNUM_OFFSET) != 0){
+            SLOW_LOG_DEBUG("Pacote ignorado durante o handshake: não é um Setup");
+            return;
+        }
+        PeripheralOperation & operation = operations.front();
+        handshakePending = false;
+
+        if(!this->handleSetupMessage(datagram)){
+            SLOW_LOG_WARN("Falha no setup da conexão");
+            this->finishOperation(false);
+            return;
         }
-    }else{  
-        cout << "Falha no envio da mensagem de disconnect\n";
+        if(handshakeAttempts == 0){ // regra de Karn: só amostra o RTT se o Connect não foi retransmitido
+            rtt.addSample(chrono::duration_cast<chrono::microseconds>(SlowClock::now() - handshakeSentAt));
+        }
+        SLOW_LOG_DEBUG("Setup bem sucedido");
+
+        if(!this->sendDataMessage()){
+            SLOW_LOG_WARN("Falha no envio de Data");
+            this->finishOperation(false);
+            return;
+        }
+        SLOW_LOG_DEBUG("Envio de Data com sucesso");
+        operation.lastSeqNum = nextSeqNumToSend - 1;
+        operation.allQueued = true;
+        return;
+    }
+
+    if(!sessionON){
+        return; // nada é esperado fora de uma sessão (ex.: resposta atrasada de um handshake já encerrado)
     }
 
-    return 0;
+    if(this->handleAck(datagram) == AckStatus::ACK_OK && !slideWindow()){
+        this->failQueuedOperations();
+    }
 }
 
-int generateFID() {
+void Peripheral::handleTimer(){
     /*
-    Gera um Fragment ID (FID), que identificará unicamente um fragmento.
-    Os FID's começam em 0 e são incrementados sequencialmente.
-    
-    return: próximo fid livre para ser usado por um fragmento.
+    Trata os prazos vencidos: retransmite o Connect (com backoff) e os pacotes da janela de
+    envio cujo ACK não chegou (mensagens, Disconnect e fragmentos do revive).
     */
-    
-    return current_fid++;
+    SlowClock::time_point now = SlowClock::now();
+
+    if(handshakePending && now >= handshakeDeadline && !operations.empty()){
+        SLOW_LOG_DEBUG("TIMED OUT");
+        rtt.backoff();
+
+        if(operations.front().kind == OperationKind::CONNECT && handshakeAttempts < rtt.getPolicy().maxRetries){
+            SLOW_LOG_DEBUG("tentando retransmissão do Connect");
+            handshakeAttempts++;
+            if(this->sendConnectMessage()){
+                handshakeSentAt = now;
+                handshakeDeadline = now + rtt.rto();
+            }else{
+                this->finishOperation(false);
+            }
+        }else{
+            SLOW_LOG_WARN("Falha no setup da conexão");
+            this->finishOperation(false);
+        }
+    }
+
+    if(!this->retransmitExpired()){
+        if(revivePending){
+            SLOW_LOG_WARN("TIMED OUT: Sem resposta do central para a tentativa de revive.");
+        }
+        this->failQueuedOperations();
+    }
+}
+
+void Peripheral::handleSocketError(){
+    /*
+    EPOLLERR no socket: conclusões do MSG_ZEROCOPY chegam pela fila de erros e não são
+    pacotes. Se não houver nenhuma, lê o erro pendente (ex.: ICMP) para limpar o evento.
+    */
+    if(io.reapCompletions() == 0){
+        int soError = 0;
+        socklen_t len = sizeof(soError);
+        getsockopt(sockFileDescriptor, SOL_SOCKET, SO_ERROR, &soError, &len);
+    }
+}
+
+void Peripheral::armTimer(){
+    /*
+    Arma o timerfd para o prazo mais próximo: o do handshake pendente ou o do pacote
+    da janela que vence primeiro. Sem prazos pendentes, desarma.
+    */
+    if(timerFileDescriptor < 0){
+        return;
+    }
+
+    SlowClock::time_point earliest = SlowClock::time_point::max();
+    if(handshakePending){
+        earliest = handshakeDeadline;
+    }
+    for(const InFlightPacket & packet : inFlight){
+        if(!packet.acked){
+            earliest = min(earliest, packet.deadline);
+        }
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if(earliest != SlowClock::time_point::max()){
+        // steady_clock é o CLOCK_MONOTONIC no Linux: o prazo vai como tempo absoluto
+        int64_t ns = chrono::duration_cast<chrono::nanoseconds>(earliest.time_since_epoch()).count();
+        ns = max<int64_t>(ns, 1); // zero desarmaria o timer
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+    }
+    timerfd_settime(timerFileDescriptor, TFD_TIMER_ABSTIME, &spec, nullptr);
 }
 
-bool Peripheral::sendFragmentedData(const string & data, int fid, int fo, bool MB){
+uint8_t Peripheral::generateFID(){
     /*
-    Envia uma mensagem à central, que foi dividida em vários fragmentos pois seu tamanho total é 
-    maior que o espaço total de dados de um fragmento. Depois, processa o ACK enviado pela central.
+    Gera o Fragment ID de um novo segmento fragmentado. Os fids são da sessão (a central
+    monta os fragmentos por SID e fid) e dão a volta em 255 (ver o static_assert no início).
+
+    return: próximo fid a ser usado por um segmento.
+    */
+    return nextFid++;
+}
+
+bool Peripheral::segmentConfirmed(uint32_t lastSeqNum) const{
+    /*
+    Todos os pacotes até lastSeqNum (o fim de um segmento) já foram confirmados e saíram da janela.
+    */
+    return inFlight.empty() || (int32_t)(inFlight.front().seqNum - lastSeqNum) > 0;
+}
+
+bool Peripheral::sendFragmentedData(string_view data, int fid, int fo, bool MB){
+    /*
+    Coloca um fragmento de uma mensagem na janela de envio. O fragmento é transmitido assim que
+    houver espaço na janela anunciada pela central (centralWindowSize); enquanto a janela estiver
+    cheia, roda o laço de eventos até que ela deslize. Não espera pelo ACK do próprio fragmento.
+    Os dados não são copiados (vão direto do buffer do chamador para o sendmmsg), então
+    precisam continuar válidos até o fragmento ser confirmado.
 
     param   data  Dados a serem enviados.
     param   fid   Fragment ID.
     param   fo    Fragment offset, indica qual a posição deste fragmento dentro da mensagem inteira.
     param   MB    More Bytes, indica se há mais fragmentos a serem enviados para completar a mensagem inteira.
 
-    return  true se o envio foi bem-sucedido;
+    return  true se o fragmento foi transmitido;
             false, caso contrário.
     */
     
     if (sockFileDescriptor < 0 || !sessionON) {
-        cout << "ERRO: Socket não inicializado ou sessão não ativa. Não é possível enviar dados de aplicação.\n";
+        SLOW_LOG_ERROR("ERRO: Socket não inicializado ou sessão não ativa. Não é possível enviar dados de aplicação.");
         return false;
     }
 
-    SlowHeader dataHeader;
+    // Bloqueia apenas enquanto a janela estiver cheia.
+    while(!windowHasRoom(data.size())){
+        if(this->runOnce(chrono::milliseconds(1000)) < 0 || !sessionON){
+            return false;
+        }
+    }
+
+    return this->queueFragment(dataImage, data, fid, fo, MB);
+}
+
+bool Peripheral::queueFragment(const HeaderImage & image, string_view data, int fid, int fo, bool MB, PacketBuffer * buffer){
+    /*
+    Coloca um fragmento na janela de envio e no lote de envio, sem esperar por espaço:
+    quem chama já conferiu windowHasRoom(). image é a imagem de Data da sessão ou a do
+    revive (flag R e SID anterior). Com buffer (mensagem copiada), data é o payload dele,
+    o cabeçalho é carimbado no próprio buffer e a janela fica com uma referência.
 
-    dataHeader.sid = this->currentSessionId;
-    dataHeader.setSttl(this->centralSttl);
+    return  true se o fragmento foi enfileirado;
+            false, caso contrário.
+    */
 
-    Flags dataFlags;
-    dataFlags.ACK = false;
-    dataFlags.MB = MB;
-    dataHeader.setFlags(dataFlags);
+    // Prepara o pacote direto na janela, para poder retransmiti-lo.
+    InFlightPacket & packet = inFlight.emplace_back();
+    packet.seqNum = this->nextSeqNumToSend;
 
-    dataHeader.seqNum = this->nextSeqNumToSend;
-   dataHeader.ackNum = this->lastCentralSeqNum; // Último seqnum conhecido do central.
+    // 1. Carimba o cabeçalho da sessão no slot da janela (ou no buffer); ackNum é o último seqnum conhecido do central.
+    if(buffer != nullptr){
+        packetPool.retain(buffer);
+        packet.buffer = buffer;
+    }
+    image.stamp(buffer != nullptr ? buffer->bytes() : packet.header, packet.seqNum, this->lastCentralSeqNum, fid, fo, MB ? FLAG_MB : 0);
 
-    dataHeader.window = 5 * MAX_DATA_SIZE; // janela de recebimento do peripheral.
-    dataHeader.fid = fid;
-    dataHeader.fo = fo;
+    // 2. Guarda só a fatia dos dados do chamador; cabeçalho e dados saem juntos num iovec
+    packet.payload = reinterpret_cast<const uint8_t *>(data.data());
+    packet.payloadSize = data.size();
 
-    // Preparar o buffer de envio completo (cabeçalho + dados)
-    uint8_t sendBuffer[MAX_DATA_SIZE+SLOW_HEADER_SIZE];
-    
-    // 1. Serializa o cabeçalho no início do buffer
-    serializationOfSlowHeader(dataHeader, sendBuffer); // Coloca 32 bytes no buffer
+    if(!queuePacket(packet)){
+        SLOW_LOG_ERROR("Não foi possivel nem sequer enviar os dados");
+        return false;
+    }
 
-    // 2. Copia os dados para o buffer, logo após o cabeçalho
-    size_t dataSize = data.size();
-    memcpy(&sendBuffer[SLOW_HEADER_SIZE], data.c_str(), dataSize);
+    return true;
+}
 
-    size_t totalSize = SLOW_HEADER_SIZE + dataSize;
+bool Peripheral::fillWindow(PeripheralOperation & operation){
+    /*
+    Coloca na janela os próximos fragmentos de uma mensagem (ou dos dados do revive)
+    enquanto houver espaço. Uma mensagem que cabe num pacote vai com fid 0/fo 0; as maiores
+    ganham um fid novo e são fatiadas (sem cópia) em fragmentos de MAX_DATA_SIZE.
 
-    int tentativas = 3; // tenta no maximo mais 3 vezes depois de dar errado
-    bool ackReceived = 0;
+    Como fo tem 8 bits, uma mensagem com mais de SEGMENT_MAX_FRAGMENTS fragmentos vira uma
+    sequência de segmentos, cada um com o seu fid, que a central entrega como mensagens
+    separadas. Os segmentos seguem um atrás do outro na janela (vários em trânsito), mas o
+    pacote que completa um segmento só sai depois que o segmento anterior foi todo
+    confirmado: assim a central completa, e entrega, os segmentos na ordem.
 
-    //antes do loop
-    this->nextSeqNumToSend++;
+    return  false em caso de erro no envio.
+    */
+    const HeaderImage & image = operation.kind == OperationKind::REVIVE ? reviveImage : dataImage;
+    while(!operation.allQueued){
+        PacketBuffer * buffer = operation.nextBuffer;
+        uint64_t messageSize = operation.sourceFd >= 0 ? operation.sourceSize : operation.data.size();
+        size_t fragmentSize = buffer != nullptr ? buffer->payloadSize : (size_t)min<uint64_t>(MAX_DATA_SIZE, messageSize - operation.nextOffset);
+        bool more = buffer != nullptr ? buffer->next != nullptr : operation.nextOffset + fragmentSize < messageSize;
+        bool MB = more && operation.nextFo < (int)SEGMENT_MAX_FRAGMENTS - 1;
+        if(!windowHasRoom(fragmentSize)){
+            return true;
+        }
+        if(!MB && operation.segmentPending && !this->segmentConfirmed(operation.segmentEnd)){
+            return true; // os ACKs do segmento anterior voltam a chamar o pumpOperations()
+        }
+        if(operation.sourceFd >= 0){
+            // arquivo: o fragmento só é lido agora que cabe na janela
+            if(!this->readFragment(operation, fragmentSize, buffer)){
+                operation.started = true; // mesmo no primeiro fragmento, failQueuedOperations() precisa encerrá-la
+                return false;
+            }
+            if(buffer == nullptr){
+                return true; // pool vazio: os ACKs devolvem buffers
+            }
+        }
+        string_view fragment = buffer != nullptr ? string_view(reinterpret_cast<const char *>(buffer->payload()), fragmentSize)
+                                                 : operation.data.substr(operation.nextOffset, MAX_DATA_SIZE);
 
-    for(int i = 0;i<=tentativas;i++){
-        if(i){
-            cout << "tentando retransmissão\n";
+        if(operation.nextFo == 0 && MB){
+            operation.fid = generateFID();
         }
-        if(!i){
-            cout << "tentando transmissão de dados\n";
+        if(!this->queueFragment(image, fragment, operation.fid, operation.nextFo, MB, buffer)){
+            if(operation.sourceFd >= 0){
+                packetPool.release(buffer);
+            }
+            return false;
+        }
+        operation.started = true;
+        operation.nextOffset += fragment.size();
+        operation.nextFo++;
+        if(operation.sourceFd >= 0){
+            packetPool.release(buffer); // a janela ficou com a única referência: volta ao pool com o ACK
+        }else if(buffer != nullptr){
+            operation.nextBuffer = buffer->next;
+            if(!io.zeroCopyEnabled()){
+                // a janela já tem a sua referência: sem MSG_ZEROCOPY, o buffer volta ao pool com o ACK
+                operation.buffers = buffer->next;
+                packetPool.release(buffer);
+            }
         }
 
-        // Enviar pela Rede
-        ssize_t bytesSent = sendto(sockFileDescriptor, sendBuffer, totalSize, 0,
-                                    (const struct sockaddr *)&centralAddress, sizeof(centralAddress));
-
-        if (bytesSent < 0) {
-            cout << "Não foi possivel nem sequer enviar os dados\n";
-            this->nextSeqNumToSend--;
-            return false;
-        } else if (bytesSent != totalSize) {
-            cout << "AVISO: Nem todos os bytes do pacote de dados foram enviados ("
-                    << bytesSent << "/" << totalSize << ").\n";
-            this->nextSeqNumToSend--;
-            return false;
-        } 
+        if(!MB && more){ // fim de um segmento: o próximo fragmento abre outro, com fid novo
+            operation.segmentPending = true;
+            operation.segmentEnd = nextSeqNumToSend - 1;
+            operation.nextFo = 0;
+        }else if(!MB){ // Último fragmento, não há nada mais a ser enviado.
+            operation.allQueued = true;
+            operation.lastSeqNum = nextSeqNumToSend - 1;
+        }
+    }
+    return true;
+}
 
-        // Recebe o ACK da central após o envio.
-        AckStatus status = this->waitAck();
+bool Peripheral::readFragment(PeripheralOperation & operation, size_t size, PacketBuffer *& buffer){
+    /*
+    Lê o próximo fragmento de um SEND de arquivo (pread, na posição sourceOffset +
+    nextOffset) para um buffer do pool.
 
-        if (status == AckStatus::ACK_OK) {
-            SlowHeader ackHeader = this->lastReceivedAckHeader;
-        }
+    param   buffer  recebe o buffer lido, com uma referência da operação; nullptr se o
+                    pool está vazio e há pacotes em trânsito que vão devolver buffers.
 
-        if(status == AckStatus::ACK_OK){
-            ackReceived = true;
-            break;
-        }else if(status == AckStatus::TIMEOUT){
-            // so não recebeu ack entao tenta enviar denovo.
-            cout << "TIMED OUT\n";
-        }else{
-            cout << "Falha em receber o ACK\n";
-            break;
+    return  false se a leitura falhou, o arquivo acabou antes do esperado, ou o pool
+            está vazio sem nada em trânsito.
+    */
+    buffer = packetPool.acquire();
+    if(buffer == nullptr){
+        if(inFlight.empty()){
+            SLOW_LOG_ERROR("Pool de pacotes esgotado: não há buffer para ler o arquivo");
+            return false;
         }
-
+        return true;
     }
 
-    if(!ackReceived){
-        cout << "Falha ao enviar os dados\n";
+    size_t done = 0;
+    while(done < size){
+        ssize_t bytesRead = pread(operation.sourceFd, buffer->packet.data + done, size - done,
+                                  operation.sourceOffset + (off_t)(operation.nextOffset + done));
+        if(bytesRead < 0 && errno == EINTR){
+            continue;
+        }
+        if(bytesRead <= 0){
+            SLOW_LOG_ERROR("Falha na leitura do arquivo (offset ", operation.sourceOffset + operation.nextOffset + done, "): ",
+                           bytesRead < 0 ? strerror(errno) : "fim do arquivo");
+            packetPool.release(buffer);
+            buffer = nullptr;
+            return false;
+        }
+        done += bytesRead;
     }
-
-    return ackReceived;
-
+    buffer->payloadSize = size;
+    return true;
 }
 
-bool Peripheral::sendData(const string & data){
+bool Peripheral::sendData(string_view data){
     /*
     Envia uma mensagem à central, dividindo-a em fragmentos caso seu tamanho total
-    ultrapasse o tamanho máximo de um fragmento. Se for o caso, usa a função sendFragmentedData().
+    ultrapasse o tamanho máximo de um fragmento. Os pacotes são mantidos em trânsito
+    simultaneamente, limitados pela janela da central, e a função retorna quando todos
+    forem confirmados. Os fragmentos são fatias de data (sem alocação nem cópia por fragmento).
+    Versão síncrona de sendDataAsync().
 
     param   data  Dados a serem enviados.
 
@@ -259,119 +992,199 @@ bool Peripheral::sendData(const string & data){
             false, caso contrário.
     */
 
-    if (sockFileDescriptor < 0 || !sessionON) {
-        cout << "ERRO: Socket não inicializado ou sessão não ativa. Não é possível enviar dados de aplicação.\n";
-        return false;
-    }
+    bool done = false, success = false;
+    this->sendDataAsync(data, [&](OperationId, bool ok){ done = true; success = ok; });
+    return this->runUntil(done) && success;
+}
 
-    // Verifica se a fragmentação é necessária.
-    if (data.size() > MAX_DATA_SIZE) {
-        int size = data.size();
-        int numPackages = (size + MAX_DATA_SIZE - 1) / MAX_DATA_SIZE;
+bool Peripheral::queuePacket(InFlightPacket & packet){
+    /*
+    Transmite o pacote recém-colocado no fim da janela de envio (inFlight.back()) e
+    o contabiliza como em trânsito. Em caso de falha, o pacote é retirado da janela.
 
-        int fid = generateFID();
-        for(int i = 0; i < numPackages; i++){
-            int fo = i;
-            bool MB = true;
-            if(i == numPackages - 1){ // Último fragmento, não há nada mais a ser enviado.
-                MB = false;
-            }
+    return  true se o pacote foi transmitido;
+            false, caso contrário.
+    */
 
-            const string &substring = data.substr(i*MAX_DATA_SIZE, MAX_DATA_SIZE);
-            
-            sendFragmentedData(substring, fid, fo, MB);
+    if(!transmitPacket(packet)){
+        if(packet.buffer != nullptr){
+            packetPool.release(packet.buffer);
         }
-
-        return true;
+        inFlight.pop_back();
+        return false;
     }
 
-    // Não precisou de fragmentação; vai enviar apenas um pacote.
-    SlowHeader dataHeader;
+    this->nextSeqNumToSend++;
+    this->bytesInFlight += packet.payloadSize;
+
+    return true;
+}
+
+bool Peripheral::transmitPacket(InFlightPacket & packet){
+    /*
+    Enfileira (ou reenfileira) um pacote já serializado da janela de envio no lote de
+    envio e arma o seu prazo de retransmissão com o RTO atual. O lote inteiro é submetido
+    com um único sendmmsg() no fim de pumpOperations(), antes da próxima espera de runOnce(), de modo que um
+    trem de fragmentos custa uma chamada de sistema.
 
-    dataHeader.sid = this->currentSessionId;
-    dataHeader.setSttl(this->centralSttl);
+    return  true se o pacote foi enfileirado;
+            false se o lote encheu e o envio automático falhou.
+    */
 
-    Flags dataFlags;
-    dataFlags.ACK = false;
-    dataFlags.MB = false;
-    dataHeader.setFlags(dataFlags);
+    const uint8_t * header = packet.buffer != nullptr ? packet.buffer->bytes() : packet.header;
+    if(!io.queueSend(header, SLOW_HEADER_SIZE, packet.payload, packet.payloadSize)){
+        return false;
+    }
 
-    dataHeader.seqNum = this->nextSeqNumToSend;
-    dataHeader.ackNum = this->lastCentralSeqNum; // Último seqnum conhecido do central
+    packet.sentAt = SlowClock::now();
+    packet.deadline = packet.sentAt + rtt.rto();
 
-    dataHeader.window = 5 * MAX_DATA_SIZE; // Janela de recebimento do peripheral.
-    dataHeader.fid = 0;
-    dataHeader.fo = 0;
+    return true;
+}
 
-    // Preparar o buffer de envio completo (cabeçalho + dados)
-    uint8_t sendBuffer[MAX_DATA_SIZE+SLOW_HEADER_SIZE];
-    
-    // 1. Serializar o cabeçalho no início do buffer
-    serializationOfSlowHeader(dataHeader, sendBuffer); // Coloca 32 bytes no buffer
+bool Peripheral::windowHasRoom(size_t payloadSize) const{
+    /*
+    Verifica se um pacote com payloadSize bytes de dados cabe na janela de envio: a menor
+    entre a anunciada pela central e a de congestionamento. Com a janela vazia, sempre
+    permite um pacote, para que uma janela anunciada menor que um fragmento (ou zerada)
+    não trave o envio.
+    */
 
-    // 2. Copiar os dados da aplicação para o buffer, logo após o cabeçalho
-    size_t dataSize = data.size();
-    memcpy(&sendBuffer[SLOW_HEADER_SIZE], data.c_str(), dataSize);
+    if(inFlight.empty()){
+        return true;
+    }
+    if(inFlight.full()){
+        return false;
+    }
 
-    size_t totalSize = SLOW_HEADER_SIZE + dataSize;
+    return bytesInFlight + payloadSize <= congestion.limit(this->centralWindowSize);
+}
 
-    int tentativas = 3; // tenta no maximo mais 3 vezes depois de dar errado
-    bool ackReceived = 0;
+bool Peripheral::retransmitExpired(){
+    /*
+    Retransmite os pacotes da janela de envio cujo prazo venceu sem ACK, aplicando o
+    backoff exponencial no RTO.
 
-    //antes do loop
-    this->nextSeqNumToSend++;
+    return  true se não havia pacote vencido ou todos foram retransmitidos;
+            false se o número máximo de retransmissões foi excedido ou ocorreu um erro.
+    */
 
-    for(int i = 0;i<=tentativas;i++){
-        if(i){
-            cout << "tentando retransmissão\n";
-        }
-        if(!i){
-            cout << "Tentando transmissão de dados\n";
+    SlowClock::time_point now = SlowClock::now();
+    bool expired = false;
+    for(const InFlightPacket & packet : inFlight){
+        if(!packet.acked && packet.deadline <= now){
+            expired = true;
+            break;
         }
-    
-        // Enviar pela Rede
-        ssize_t bytesSent = sendto(sockFileDescriptor, sendBuffer, totalSize, 0,
-                                    (const struct sockaddr *)&centralAddress, sizeof(centralAddress));
+    }
+    if(!expired){
+        return true;
+    }
 
-        if (bytesSent < 0) {
-            cout << "Não foi possivel nem sequer enviar os dados\n";
-            this->nextSeqNumToSend--;
+    // so não recebeu ack entao tenta enviar denovo.
+    SLOW_LOG_DEBUG("TIMED OUT");
+    rtt.backoff();
+    congestion.onTimeout(now, bytesInFlight);
+
+    for(InFlightPacket & packet : inFlight){
+        if(packet.acked || packet.deadline > now){
+            continue;
+        }
+        if(packet.retries >= rtt.getPolicy().maxRetries){
+            SLOW_LOG_WARN("Número máximo de retransmissões excedido (SeqNum: ", packet.seqNum, ")");
             return false;
-        } else if (bytesSent != totalSize) {
-            cout << "AVISO: Nem todos os bytes do pacote de dados foram enviados ("
-                    << bytesSent << "/" << totalSize << ").\n";
-            this->nextSeqNumToSend--;
+        }
+        SLOW_LOG_DEBUG("tentando retransmissão (SeqNum: ", packet.seqNum, ")");
+        packet.retries++;
+        if(!transmitPacket(packet)){
             return false;
-        } 
+        }
+    }
+    return true;
+}
 
-        AckStatus status = this->waitAck();
+bool Peripheral::slideWindow(){
+    /*
+    Marca como confirmado o pacote cujo seqNum foi reconhecido pelo último ACK e
+    remove do início da janela todos os pacotes já confirmados.
 
-        if(status == AckStatus::ACK_OK){
-            ackReceived = true;
-            break;
-        }else if(status == AckStatus::TIMEOUT){
-            // so não recebeu ack entao tenta enviar denovo.
-            cout << "TIMED OUT\n";
-        }else{
-            cout << "Falha em receber o ACK\n";
-            break;
-        }
+    A central confirma cada pacote, então o ACK de um pacote posterior é o equivalente
+    do ACK duplicado do TCP para os anteriores ainda sem confirmação: se ele foi enviado
+    depois da última transmissão de um deles, conta contra esse. Com duplicateAckThreshold
+    ACKs assim, o pacote é dado como perdido e retransmitido na hora (sem backoff), sem
+    esperar o RTO. ACKs e perdas alimentam o controle de congestionamento.
+
+    return  false se a retransmissão rápida falhou no envio.
+    */
+
+    if(inFlight.empty()){
+        return true;
+    }
+    uint32_t offset = this->lastReceivedAckHeader.ackNum - inFlight.front().seqNum;
+    if(offset >= inFlight.size() || inFlight[offset].acked){
+        return true; // ACK repetido: o pacote já foi confirmado
+    }
+    InFlightPacket & acked = inFlight[offset];
 
+    SlowClock::time_point now = SlowClock::now();
+    chrono::microseconds sample{0};
+    if(acked.retries == 0){ // regra de Karn: ignora amostras de pacotes retransmitidos
+        sample = chrono::duration_cast<chrono::microseconds>(now - acked.sentAt);
+        rtt.addSample(sample);
+    }
+    congestion.onAck(acked.payloadSize, sample, bytesInFlight, acked.sentAt, now);
+    acked.acked = true;
+    bytesInFlight -= acked.payloadSize;
+
+    const RetransmissionPolicy & policy = rtt.getPolicy();
+    if(policy.duplicateAckThreshold > 0){
+        for(uint32_t i = 0; i < offset; i++){
+            InFlightPacket & packet = inFlight[i];
+            if(packet.acked || acked.sentAt < packet.sentAt){
+                continue;
+            }
+            if(++packet.laterAcks < policy.duplicateAckThreshold || packet.retries >= policy.maxRetries){
+                continue; // sem retransmissões sobrando, o RTO decide
+            }
+            SLOW_LOG_DEBUG("retransmissão rápida (SeqNum: ", packet.seqNum, ")");
+            congestion.onLoss(packet.sentAt, now, bytesInFlight);
+            packet.retries++;
+            packet.laterAcks = 0;
+            if(!transmitPacket(packet)){
+                return false;
+            }
+        }
     }
 
-    if(!ackReceived){
-        cout << "Falha ao enviar os dados\n";
+    while(!inFlight.empty() && inFlight.front().acked){
+        if(inFlight.front().buffer != nullptr){
+            packetPool.release(inFlight.front().buffer);
+        }
+        inFlight.pop_front();
     }
+    return true;
+}
 
-    return ackReceived;
+void Peripheral::clearWindow(){
+    /*
+    Descarta todos os pacotes em trânsito (usado quando o envio é abortado).
+    */
 
+    io.discardSends(); // os buffers enfileirados pertencem aos pacotes descartados
+    for(InFlightPacket & packet : inFlight){
+        if(packet.buffer != nullptr){
+            packetPool.release(packet.buffer);
+        }
+    }
+    inFlight.clear();
+    bytesInFlight = 0;
 }
 
 bool Peripheral::sendConnectMessage(){
     /*
     Envia a mensagem de conexão (CONNECT) ao servidor central. 
-    Constrói o cabeçalho SLOW com a flag C (Connect) ativada e a janela
-    de recepção do peripheral, serializa-o em um buffer e envia via UDP à central.
+    Envia o cabeçalho SLOW com a flag C (Connect) ativada e a janela de recepção
+    do peripheral, pré-montado em CONNECT_HEADER_IMAGE, via UDP à central.
     
     return true se o pacote CONNECT foi enviado com sucesso;
              false em caso de falha na criação do socket, resolução do host
@@ -379,48 +1192,28 @@ bool Peripheral::sendConnectMessage(){
     */
 
     if(sockFileDescriptor < 0){
-        cout << "Sem socket\n";
+        SLOW_LOG_ERROR("Sem socket");
         return 0;
     }
 
-    SlowHeader connectHeader;
-
-    Flags connectFlags;
-    connectFlags.C = true;
-    connectHeader.setFlags(connectFlags);
-
-    connectHeader.window = 5 * 1440;
-
-    uint8_t sendBuffer[SLOW_HEADER_SIZE];
-
-    serializationOfSlowHeader(connectHeader, sendBuffer);
-
-    //envia pela rede usando sendto().
-    ssize_t bytesSent = sendto(sockFileDescriptor, sendBuffer, SLOW_HEADER_SIZE, 0,
-        (const struct sockaddr *)&centralAddress, sizeof(centralAddress));
-    
+    // o Connect não depende de sessão: o cabeçalho inteiro é montado em tempo de compilação (messages.h)
+    //envia pela rede pela camada de lote; o lote é submetido na hora.
     // Verifica se a totalidade dos bytes foi enviada.
-    if(bytesSent < 0){
-        perror("sendto");
-        cout << "Erro no envio de Connect\n";
-        return 0;
-    }else if(bytesSent != SLOW_HEADER_SIZE){
-        cout << "WARNING: NEM TODOS OS BYTES FORAM ENVIADOS\n";
-        cout << bytesSent << "/" << SLOW_HEADER_SIZE << "\n";
+    if(!io.queueSend(CONNECT_HEADER_IMAGE.data(), SLOW_HEADER_SIZE) || !io.flushSends()){
+        SLOW_LOG_ERROR("Erro no envio de Connect");
         return 0;
     }else{
-        cout << "Mensagem enviada sem problemas\n";
-        this->nextSeqNumToSend = connectHeader.seqNum + 1;
+        SLOW_LOG_DEBUG("Mensagem enviada sem problemas");
+        this->nextSeqNumToSend = 1; // o Connect leva seqNum 0
         return 1;
     }
 }
 
-bool Peripheral::waitSetupMessage(){
+bool Peripheral::handleSetupMessage(const Datagram & datagram){
 /*
-  Aguarda e processa a mensagem de setup (resposta ao CONNECT) da central.
+  Processa a mensagem de setup (resposta ao CONNECT) da central, entregue pelo laço de eventos.
  
   Recebe um pacote UDP contendo o cabeçalho SLOW de setup. Valida:
-    - sucesso no recvfrom()
     - tamanho mínimo do cabeçalho
   Se vier payload extra (bytes além de SLOW_HEADER_SIZE), imprime como texto.
      Em seguida:
@@ -436,40 +1229,22 @@ bool Peripheral::waitSetupMessage(){
         * sessionON = true
  
    return true  se a central aceitou o CONNECT;
-          false em caso de erro de recvfrom, pacote inválido
+          false em caso de erro de recepção, pacote inválido
                 (tamanho insuficiente ou ackNum != 0),
                 ou rejeição pelo servidor (AR == 0).
  */
 
-    if(sockFileDescriptor < 0){
-        cout << "Sem socket\n";
-        return false;
-    }
-
-    uint8_t receiveBuffer[SLOW_HEADER_SIZE+MAX_DATA_SIZE];
-    struct sockaddr_in senderAddress;
-    socklen_t senderAddressLenght = sizeof(senderAddress);
-
-    // recvfrom espera receber dados ou dar erro
-    ssize_t bytesReceived = recvfrom(sockFileDescriptor, receiveBuffer, SLOW_HEADER_SIZE+MAX_DATA_SIZE, 0,
-        (struct sockaddr *)&senderAddress, &senderAddressLenght);
-
-    if(bytesReceived < 0){
-        perror("recvfrom");
-        cout << "Erro ao receber os dados da central\n";
-        return false;
-    }
+    uint8_t * receiveBuffer = datagram.data;
+    size_t bytesReceived = datagram.size;
 
     if(bytesReceived < SLOW_HEADER_SIZE){
-        cout << "Pacote recebido tem menos bytes que o esperado para um header SLOW (32)\n";
-        cout << "Foram recebidos: " << bytesReceived << '\n';
+        SLOW_LOG_WARN("Pacote recebido tem menos bytes que o esperado para um header SLOW (32)");
+        SLOW_LOG_WARN("Foram recebidos: ", bytesReceived);
         return false;
     }
 
-    if(bytesReceived > SLOW_HEADER_SIZE){
+    if(bytesReceived > SLOW_HEADER_SIZE && slowLogger().enabled(LogLevel::INFO)){
         size_t payload_length = bytesReceived - SLOW_HEADER_SIZE;
-        std::cout << "-----------------------------------------------------------\n";
-        std::cout << ">>> MENSAGEM DE ERRO/DADOS DO CENTRAL (Payload): <<<\n";
         // Imprime como string. Adiciona um terminador nulo para segurança se não for uma string bem formada.
         // Ou imprime byte a byte se não tiver certeza que é uma string.
         std::string error_message_from_central;
@@ -482,8 +1257,10 @@ bool Peripheral::waitSetupMessage(){
                 error_message_from_central += '.'; // Substitui não imprimíveis
             }
         }
-        std::cout << error_message_from_central << std::endl;
-        std::cout << "-----------------------------------------------------------\n";
+        SLOW_LOG_INFO("-----------------------------------------------------------\n",
+                      ">>> MENSAGEM DE ERRO/DADOS DO CENTRAL (Payload): <<<\n",
+                      error_message_from_central, "\n",
+                      "-----------------------------------------------------------");
     }
 
     // lendo o header recebido
@@ -492,11 +1269,11 @@ bool Peripheral::waitSetupMessage(){
 
     Flags receivedFlags = setupHeader.getFlags();
 
-    cout << receivedFlags.toByte() << '\n';
+    SLOW_LOG_TRACE("Flags do Setup: ", (int)receivedFlags.toByte());
 
     if(setupHeader.ackNum == 0){
         if(receivedFlags.AR){
-            cout << "Conexão aceita pela central\n";
+            SLOW_LOG_INFO("Conexão aceita pela central");
 
             this->currentSessionId = setupHeader.sid;
             this->centralSttl = setupHeader.getSttl();
@@ -504,18 +1281,20 @@ bool Peripheral::waitSetupMessage(){
             this->centralWindowSize = setupHeader.window;
             //this->nextSeqNumToSend = setupHeader.seqNum+1;
 
+            this->receiveBuffer.reset(this->centralIniSeqNum + 1); // o primeiro dado da central vem depois do Setup
             this->sessionON = true;
+            this->buildSessionImages();
 
             return true;
 
         }else{ // conexao nao aceita por A/R estar 'false'.
-            cout << "Conexão rejeitada pela central\n";
+            SLOW_LOG_WARN("Conexão rejeitada pela central");
             this->sessionON = false;
             this->currentSessionId = SID::Nil();
             return false;
         }
         }else{
-            cout << "AckNum inválido recebido da Setup Message\n";
+            SLOW_LOG_WARN("AckNum inválido recebido da Setup Message");
             return false;
         }
 }
@@ -530,110 +1309,72 @@ bool Peripheral::sendDataMessage(){
         - seqNum igual ao próximo byte a ser enviado
         - ackNum apontando para o início da janela do central
         - janela de recepção local (exemplo: 5 * 1440 bytes)
-    Serializa o cabeçalho em um buffer e envia via UDP ao endereço armazenado em centralAddress.
-    Em caso de sucesso, incrementa nextSeqNumToSend em 1.
+    O cabeçalho sai da imagem de Data da sessão (dataImage), com seqNum/ackNum carimbados
+    no slot da janela de envio, e é enviado via UDP ao endereço armazenado em centralAddress.
+    Em caso de sucesso, incrementa nextSeqNumToSend em 1; o ACK chega pelo laço de eventos
+    (runOnce()), e o prazo de retransmissão fica no timerfd.
     
     return true  se o pacote DATA foi enviado completamente;
-            false em caso de descritor inválido, sessão inativa, erro no sendto
+            false em caso de descritor inválido, sessão inativa, erro no envio
                     ou envio parcial de bytes.
     */
 
     if(sockFileDescriptor < 0 || !sessionON){
-        cout << "Foi tentado enviar Data, porém o socket não está inicializado ou sessão não está ativa\n";
+        SLOW_LOG_ERROR("Foi tentado enviar Data, porém o socket não está inicializado ou sessão não está ativa");
         return false;
     }
 
-    SlowHeader dataHeader;
-
-    dataHeader.sid = this->currentSessionId;
-    dataHeader.setSttl(this->centralSttl);
-
-    Flags dataFlags;
-    //dataFlags.ACK = 1; //No PDF do trabalho fala pra deixar a flag ativa, mas aí não funciona.
-    dataHeader.setFlags(dataFlags);
-
-    dataHeader.seqNum = this->nextSeqNumToSend;
-    dataHeader.ackNum = centralIniSeqNum;
-
-    dataHeader.window = 5 * 1440;
-
-    dataHeader.fid = 0;
-    dataHeader.fo = 0;
+    //No PDF do trabalho fala pra deixar a flag ACK ativa, mas aí não funciona: vai a imagem de Data, sem flags.
+    // vai para a janela de envio, para ser retransmitida caso o ACK não chegue
+    InFlightPacket & packet = inFlight.emplace_back();
+    packet.seqNum = this->nextSeqNumToSend;
+    dataImage.stamp(packet.header, packet.seqNum, centralIniSeqNum);
 
-    uint8_t sendBuffer[SLOW_HEADER_SIZE];
-    serializationOfSlowHeader(dataHeader, sendBuffer);
-
-    ssize_t bytesSent = sendto(sockFileDescriptor, sendBuffer, SLOW_HEADER_SIZE, 0,
-         (const sockaddr *) &centralAddress, sizeof(centralAddress));
-
-    if (bytesSent < 0) {
-        perror("sendData");
-        cout << "ERRO ao enviar a mensagem Data.\n";
+    if (!queuePacket(packet)) { // como deu certo ai sim aumentamos o proximo numero de sequencia
+        SLOW_LOG_ERROR("ERRO ao enviar a mensagem Data.");
         return false;
-    } else if (bytesSent < SLOW_HEADER_SIZE) {
-        cout << "WARNING: Nem todos os bytes da mensagem Data foram enviados\n"
-                  << bytesSent << "/" << SLOW_HEADER_SIZE << "\n";
-        return false; 
-    } else {
-        cout << "Mensagem Data enviada com sucesso (" << bytesSent << " bytes).\n";
-        
-        this->nextSeqNumToSend++; // como deu certo ai sim aumentamos o proximo numero de sequencia
-        return true;
     }
+
+    SLOW_LOG_DEBUG("Mensagem Data enviada com sucesso (", SLOW_HEADER_SIZE, " bytes).");
+    return true;
 }
 
-AckStatus Peripheral::waitAck(){
+AckStatus Peripheral::handleAck(const Datagram & datagram){
     /*
-    Aguarda e processa um ACK do servidor central.
+    Processa um ACK do servidor central, entregue pelo laço de eventos.
     
-    Tenta ler um pacote UDP no socket configurado (com timeout).  
     Se o socket não estiver aberto ou a sessão inativa, retorna RECV_ERROR.  
-    Se ocorrer timeout no recvfrom(), retorna TIMEOUT.  
-    Se ocorrer outro erro de recvfrom(), retorna RECV_ERROR.  
     Se o pacote for menor que o cabeçalho SLOW (32 bytes), retorna INVALID_PACKET.  
     Desserializa o header e valida:
         - SID confere com o da sessão atual
         - Flags: somente ACK=true
-        - ackNum == nextSeqNumToSend – 1 (o último byte enviado)
-        Caso falhe, retorna INVALID_PACKET.
+        - ackNum é de um dos pacotes da janela de envio (a central confirma cada pacote,
+          em qualquer ordem)
+        Um ACK de um pacote que já saiu da janela (duplicado, de uma retransmissão) retorna
+        STALE e é só ignorado; os demais problemas retornam INVALID_PACKET.
     - Se tudo estiver correto, atualiza:
         - centralSttl        = header.getSttl()
         - lastCentralSeqNum  = header.seqNum
         - centralWindowSize  = header.window
     
     return AckStatus::ACK_OK       se o ACK for válido;
-            AckStatus::TIMEOUT      se recvfrom() retornar EAGAIN/EWOULDBLOCK;
+            AckStatus::STALE        se o ACK é de um pacote já confirmado;
+            AckStatus::DATA_ONLY    se o pacote só trazia dados da central (sem ACK);
             AckStatus::INVALID_PACKET em caso de header inválido;
-            AckStatus::RECV_ERROR   em outros erros de recvfrom() ou socket.
+            AckStatus::RECV_ERROR   em outros erros de recepção ou socket.
     */
 
     if(sockFileDescriptor < 0 || !sessionON){
-        cout << "Foi tentado receber o ACK, porém o socket não está inicializado ou sessão não está ativa\n";
+        SLOW_LOG_ERROR("Foi tentado receber o ACK, porém o socket não está inicializado ou sessão não está ativa");
         return AckStatus::RECV_ERROR;
     }
 
-    uint8_t receiveBuffer[MAX_DATA_SIZE+SLOW_HEADER_SIZE];
-    struct sockaddr_in senderAddress;
-    socklen_t senderAddressLength = sizeof(senderAddress);
-
-    // recvfrom espera receber dados ou dar erro
-    ssize_t bytesReceived = recvfrom(sockFileDescriptor, receiveBuffer, SLOW_HEADER_SIZE+MAX_DATA_SIZE, 0,
-        (struct sockaddr *)&senderAddress, &senderAddressLength);
-
-    if(bytesReceived < 0){
-        if(errno == EAGAIN || errno == EWOULDBLOCK){
-            cout << "DEU PAU AQUI\n";
-            return AckStatus::TIMEOUT;
-        } else {
-            perror("recvfrom - waitAck");
-            cout << "ERRO SISTEMA ao receber ACK.\n";
-            return AckStatus::RECV_ERROR;
-        }
-    }
+    uint8_t * receiveBuffer = datagram.data;
+    size_t bytesReceived = datagram.size;
 
     if(bytesReceived < SLOW_HEADER_SIZE){
-        cout << "Pacote recebido tem menos bytes que o esperado para um header SLOW (32)\n";
-        cout << "Foram recebidos: " << bytesReceived << '\n';
+        SLOW_LOG_WARN("Pacote recebido tem menos bytes que o esperado para um header SLOW (32)");
+        SLOW_LOG_WARN("Foram recebidos: ", bytesReceived);
         return AckStatus::INVALID_PACKET;
     }
 
@@ -641,99 +1382,316 @@ AckStatus Peripheral::waitAck(){
     SlowHeader ackHeader;
     deserializationForSlowHeader(ackHeader, receiveBuffer);
 
-    Flags receivedFlags = ackHeader.getFlags();
-
-    // vamos checar se chegou tudo certo
+    // vamos checar se chegou tudo certo: SID da sessão (imagem pré-serializada) e tipo ACK
 
     //sid
-    for(int i=0;i<16;i++){
-        if(ackHeader.sid.byte[i]!=this->currentSessionId.byte[i]){
-            cout << "SID recebido não corresponde ao SID da sessão\n";
-            return AckStatus::INVALID_PACKET;
-        }
+    if(!dataImage.sameSession(receiveBuffer)){
+        SLOW_LOG_WARN("SID recebido não corresponde ao SID da sessão");
+        return AckStatus::INVALID_PACKET;
     }
 
-    //sttl
-    //recebemos um sttl atualizado :D
-    // mas antes devemos checar as flags !
-    // flags
-    if(!receivedFlags.ACK || receivedFlags.AR || receivedFlags.C || receivedFlags.MB || receivedFlags.R){
-        cout << "Flags do ACK inválidas\n";
+    // dados vindos da central (mensagem inteira ou fragmento) vão para o buffer de recepção
+    if(bytesReceived > SLOW_HEADER_SIZE){
+        this->acceptCentralPayload(ackHeader, receiveBuffer + SLOW_HEADER_SIZE, bytesReceived - SLOW_HEADER_SIZE);
+    }
+
+    // flags: somente ACK, numa única comparação mascarada (com dados, o MB é do fragmento)
+    uint8_t flagByte = receiveBuffer[WIRE_STTL_FLAGS_OFFSET];
+    if(!AckMessage::matches(bytesReceived > SLOW_HEADER_SIZE ? (uint8_t)(flagByte & ~FLAG_MB) : flagByte)){
+        if(bytesReceived > SLOW_HEADER_SIZE && DataMessage::matches(flagByte)){
+            return AckStatus::DATA_ONLY;
+        }
+        SLOW_LOG_WARN("Flags do ACK inválidas");
         return AckStatus::INVALID_PACKET;
     }
-    if(ackHeader.ackNum != this->nextSeqNumToSend-1){
-        cout << "AckNum não corresponde ao SeqNum esperado\n";
+    // com vários pacotes em trânsito, o ACK pode ser de qualquer um deles
+    uint32_t windowStart = inFlight.empty() ? this->nextSeqNumToSend : inFlight.front().seqNum;
+    if(ackHeader.ackNum - windowStart >= inFlight.size()){
+        if((int32_t)(ackHeader.ackNum - windowStart) < 0){
+            SLOW_LOG_DEBUG("ACK repetido ignorado (ackNum ", ackHeader.ackNum, ")");
+            return AckStatus::STALE;
+        }
+        SLOW_LOG_WARN("AckNum fora da janela de envio");
         return AckStatus::INVALID_PACKET;
     }
-    //agora podemos settar o sttl;
+    //agora podemos settar o sttl; as imagens da sessão só são tocadas se ele mudou
 
-    this->centralSttl = ackHeader.getSttl();
+    if(ackHeader.getSttl() != this->centralSttl){
+        this->centralSttl = ackHeader.getSttl();
+        dataImage.setSttl(this->centralSttl);
+        disconnectImage.setSttl(this->centralSttl);
+        ackImage.setSttl(this->centralSttl);
+    }
 
     this->lastCentralSeqNum = ackHeader.seqNum;
     this->centralWindowSize = ackHeader.window;
+    this->lastReceivedAckHeader = ackHeader;
+    sessionCache.touch(currentSessionId, lastCentralSeqNum, nextSeqNumToSend, centralWindowSize);
 
     return AckStatus::ACK_OK;
 }
 
+void Peripheral::buildSessionImages(){
+    /*
+    Monta os cabeçalhos pré-serializados da sessão atual (SID, STTL, flags e janela).
+    Chamado quando a sessão começa: Setup aceito ou revive aceito.
+    */
+    dataImage.build<DataMessage>(this->currentSessionId, this->centralSttl, dataWindow(receiveBuffer.window()));
+    disconnectImage.build<DisconnectMessage>(this->currentSessionId, this->centralSttl, 0);
+    ackImage.build<AckMessage>(this->currentSessionId, this->centralSttl, receiveBuffer.window());
+    advertisedWindow = receiveBuffer.window();
+}
+
+void Peripheral::acceptCentralPayload(const SlowHeader & header, const uint8_t * payload, size_t payloadSize){
+    /*
+    Coloca os dados que vieram da central no buffer de recepção, na posição do seqNum
+    (fora de ordem também), e confirma o pacote com um ACK puro, como a central faz com
+    os nossos. Duplicatas são confirmadas de novo; pacotes recusados (fora da janela ou
+    sem espaço) não, para a central retransmitir.
+
+    param   header       Cabeçalho já desserializado (SID validado).
+    param   payload      Dados após o cabeçalho, no anel de recepção.
+    param   payloadSize  Quantidade de bytes de dados.
+    */
+    Flags flags = header.getFlags();
+    uint64_t dropped = receiveBuffer.droppedMessages();
+    ReceiveResult result = receiveBuffer.add(header.seqNum, header.fid, header.fo, flags.MB, payload, payloadSize);
+    if(receiveBuffer.droppedMessages() != dropped){
+        SLOW_LOG_ERROR("Mensagem da central (fid ", (int)header.fid, ") maior que o buffer de recepção (",
+                       RECEIVE_BUFFER_SLOTS, " fragmentos): descartada");
+    }
+    if(result == ReceiveResult::REJECTED){
+        SLOW_LOG_DEBUG("Dados da central descartados (SeqNum: ", header.seqNum, ", fid ", (int)header.fid,
+                       ", fo ", (int)header.fo, ")");
+        return;
+    }
+    if(result == ReceiveResult::ACCEPTED){
+        SLOW_LOG_DEBUG("Dados da central recebidos (SeqNum: ", header.seqNum, ", ", payloadSize, " bytes)");
+        this->updateReceiveWindow();
+    }
+    if(!this->sendReceiveAck(header.seqNum)){
+        SLOW_LOG_ERROR("Erro no envio do ACK para a central");
+    }
+}
+
+bool Peripheral::sendReceiveAck(uint32_t ackNum){
+    /*
+    Enfileira um ACK puro (flag ACK, sem dados) para a central, com a janela de recepção
+    atual. Leva o nosso próximo seqNum sem consumi-lo: um ACK não é confirmado de volta.
+    Os cabeçalhos ficam em ackHeaders até o lote ser submetido.
+    */
+    if(ackCount == ackHeaders.size()){
+        if(!io.flushSends()){
+            return false;
+        }
+        ackCount = 0;
+    }
+    uint8_t * buffer = ackHeaders[ackCount++].data();
+    ackImage.stamp(buffer, this->nextSeqNumToSend, ackNum);
+    advertisedWindow = receiveBuffer.window();
+    return io.queueSend(buffer, SLOW_HEADER_SIZE);
+}
+
+void Peripheral::updateReceiveWindow(){
+    /*
+    Passa o espaço livre do buffer de recepção para as imagens dos pacotes que o anunciam.
+    */
+    uint16_t window = receiveBuffer.window();
+    dataImage.setWindow(dataWindow(window));
+    ackImage.setWindow(window);
+}
+
+bool Peripheral::receive(ReceivedMessage & message, chrono::milliseconds timeout){
+    /*
+    Próxima mensagem completa vinda da central, em ordem de seqNum. Os dados não são
+    copiados: message.segments são fatias do buffer de recepção (uma por fragmento) e
+    seguram o espaço até release(), então a janela anunciada à central diminui enquanto
+    a aplicação não as devolve.
+
+    param   message  recebe a mensagem; devolver com release().
+    param   timeout  quanto rodar o laço de eventos esperando uma mensagem (0: só olha).
+
+    return  true se havia (ou chegou) uma mensagem.
+    */
+    SlowClock::time_point deadline = SlowClock::now() + timeout;
+    while(!receiveBuffer.pop(message)){
+        SlowClock::time_point now = SlowClock::now();
+        if(now >= deadline || epollFileDescriptor < 0){
+            return false;
+        }
+        if(this->runOnce(chrono::ceil<chrono::milliseconds>(deadline - now)) < 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+void Peripheral::release(ReceivedMessage & message){
+    /*
+    Devolve o espaço de uma mensagem tirada com receive(). Se a última janela anunciada
+    estava fechada (menos de um fragmento) e agora cabe um, ou se ela cresceu um quarto do
+    buffer, avisa a central com um ACK do último seqNum recebido: sem isso ela ficaria
+    parada esperando uma janela que nunca viria. Devoluções menores esperam o próximo
+    pacote, para não mandar um ACK por mensagem lida.
+    */
+    receiveBuffer.release(message);
+    this->updateReceiveWindow();
+
+    uint16_t window = receiveBuffer.window();
+    bool reopened = advertisedWindow < MAX_DATA_SIZE && window >= MAX_DATA_SIZE;
+    if(sessionON && (reopened || window >= advertisedWindow + PERIPHERAL_WINDOW_SIZE / 4)){
+        if(!this->sendReceiveAck(receiveBuffer.nextExpected() - 1) || !io.flushSends()){
+            SLOW_LOG_ERROR("Erro no envio da atualização de janela");
+        }
+    }
+}
+
 bool Peripheral::sendDisconnectMessage(){
     /**
     Envia a mensagem de DISCONNECT ao servidor central.
-    Constrói um cabeçalho com todas as flags 'false', ajusta o SID atual, seqNum e ackNum.
-    Serializa o cabeçalho em um buffer e envia via UDP ao centralAddress.
+    Usa a imagem de Disconnect da sessão (todas as flags 'false', janela 0) e carimba seqNum e ackNum
+    no slot da janela de envio, que é enviado via UDP ao centralAddress.
     
     return true  se o pacote DISCONNECT foi enviado completamente;
-           false se o socket não estiver aberto, a sessão inativa, ocorrer erro no sendto() ou envio parcial de bytes.
+           false se o socket não estiver aberto, a sessão inativa, ocorrer erro no envio ou envio parcial de bytes.
     */
     if(sockFileDescriptor < 0 || !sessionON){
-        cout << "Foi tentado enviar disconnect, porém o socket não está inicializado ou sessão não está ativa\n";
+        SLOW_LOG_ERROR("Foi tentado enviar disconnect, porém o socket não está inicializado ou sessão não está ativa");
+        return false;
+    }
+
+    // todas as flags em 0 e janela 0 (imagem de Disconnect); o PDF diz que C e R ligados significa disconnect, mas dá erro.
+    // tamanho do slowheader que é 32 bytes; fica na janela de envio até o ACK
+    InFlightPacket & packet = inFlight.emplace_back();
+    packet.seqNum = this->nextSeqNumToSend;
+    disconnectImage.stamp(packet.header, packet.seqNum, this->lastCentralSeqNum);
+
+    if(!queuePacket(packet)){
+        SLOW_LOG_ERROR("Erro no envio de Disconnect");
+        return 0;
+    }
+
+    SLOW_LOG_DEBUG("Mensagem de disconnect enviada sem problemas");
+    return 1;
+}
+
+bool Peripheral::enableZeroCopy(){
+    /*
+    Habilita o envio com MSG_ZEROCOPY para trens de fragmentos grandes.
+    Deve ser chamado depois de initNetwork().
+    */
+    if(sockFileDescriptor < 0){
         return false;
     }
+    return io.enableZeroCopy();
+}
 
-    SlowHeader disconnectHeader;
+bool Peripheral::enableOffload(){
+    /*
+    Habilita o offload de segmentação (UDP_SEGMENT) para os trens de fragmentos e o de
+    recepção (UDP_GRO). Cada um é independente e, se o kernel recusar, a camada de E/S
+    continua enviando/recebendo um datagrama por vez. Deve ser chamado depois de initNetwork().
 
-    disconnectHeader.sid = this->currentSessionId;
+    return  true se ao menos um dos dois foi habilitado.
+    */
+    if(sockFileDescriptor < 0){
+        return false;
+    }
+    bool segmentation = io.enableSegmentationOffload();
+    bool receive = io.enableReceiveOffload();
+    this->watchTransport(); // com io_uring, o GRO recria o anel
+    return segmentation || receive;
+}
 
-    disconnectHeader.setSttl(this->centralSttl);
+bool Peripheral::enableUring(){
+    /*
+    Passa a E/S do socket para o backend io_uring (recvmsg multishot com buffers fornecidos
+    e trens de SENDMSG encadeados), se o kernel suportar; senão segue com sendmmsg/recvmmsg.
+    Deve ser chamado depois de initNetwork().
 
-    Flags disconnectFlags;
+    return  true se o io_uring foi habilitado.
+    */
+    if(sockFileDescriptor < 0){
+        return false;
+    }
+    bool enabled = io.enableUring();
+    this->watchTransport();
+    return enabled;
+}
 
-    disconnectFlags.ACK = 0;
-    disconnectFlags.C = 0;
-    disconnectFlags.R = 0; // PDF diz que ambos c e r ligados signica disconnect, mas dá erro.
-    disconnectFlags.AR = 0;
-    disconnectFlags.MB = 0;
+void Peripheral::watchTransport(){
+    /*
+    Ajusta o epoll ao backend de E/S atual. Com io_uring, quem fica legível quando chegam
+    pacotes é o descritor do anel; o socket continua registrado sem eventos, só para o
+    EPOLLERR das conclusões do MSG_ZEROCOPY. O registro do anel é sempre refeito: um anel
+    recriado pode ter reaproveitado o mesmo número de descritor.
+    */
+    if(epollFileDescriptor < 0){
+        return;
+    }
 
-    disconnectHeader.setFlags(disconnectFlags);
+    if(transportFileDescriptor >= 0 && transportFileDescriptor != sockFileDescriptor){
+        epoll_ctl(epollFileDescriptor, EPOLL_CTL_DEL, transportFileDescriptor, NULL); // pode já ter saído ao ser fechado
+    }
 
-    disconnectHeader.seqNum = this->nextSeqNumToSend;
-    disconnectHeader.ackNum = this->lastCentralSeqNum;
+    int fd = io.eventFileDescriptor();
+    struct epoll_event event;
+    event.events = fd == sockFileDescriptor ? (uint32_t)EPOLLIN : 0;
+    event.data.fd = sockFileDescriptor;
+    epoll_ctl(epollFileDescriptor, EPOLL_CTL_MOD, sockFileDescriptor, &event);
+
+    if(fd != sockFileDescriptor){
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if(epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, fd, &event) < 0){
+            perror("epoll_ctl (io_uring)");
+        }
+    }
+    transportFileDescriptor = fd;
+}
 
-    disconnectHeader.window = 0;
-    disconnectHeader.fid = 0;
-    disconnectHeader.fo = 0;
+void Peripheral::setRetransmissionPolicy(const RetransmissionPolicy & policy){
+    /*
+    Configura o número máximo de retransmissões e os limites do RTO usados
+    no handshake e na janela de envio.
+    */
+    rtt.setPolicy(policy);
+}
 
-    // tamanho do slowheader que é 32 bytes
-    uint8_t sendBuffer[SLOW_HEADER_SIZE];
+void Peripheral::setCongestionAlgorithm(CongestionAlgorithm algorithm){
+    /*
+    Escolhe o controle de congestionamento (NewReno por padrão; NONE deixa só a janela
+    da central). Vale a partir de agora, e cada sessão nova recomeça da janela inicial.
+    */
+    congestion.reset(algorithm);
+}
 
-    serializationOfSlowHeader(disconnectHeader, sendBuffer);
+bool Peripheral::enableSessionCache(const string & path){
+    /*
+    Liga o cache de sessões em disco (depois de initNetwork(), que define a central).
+    A sessão passa a ser gravada quando é estabelecida, a cada ACK e em storeSession();
+    se o cache já tem uma sessão com esta central dentro do STTL, ela vira a sessão
+    anterior, e canRevive() permite tentar o revive (uma ida e volta) antes do connect()
+    (três).
+
+    param   path  arquivo do cache (padrão: ~/.slow_sessions).
+    return  true se o cache foi aberto.
+    */
+    if(!sessionCache.open(path)){
+        return false;
+    }
 
-    //enviar pela rede usando sendto()
-    ssize_t bytesSent = sendto(sockFileDescriptor, sendBuffer, SLOW_HEADER_SIZE, 0,
-        (const struct sockaddr *)&centralAddress, sizeof(centralAddress));
-    
-    if(bytesSent < 0){
-        perror("sendto");
-        cout << "Erro no envio de Disconnect\n";
-        return 0;
-    }else if(bytesSent != SLOW_HEADER_SIZE){
-        cout << "WARNING: NEM TODOS OS BYTES FORAM ENVIADOS\n";
-        cout << bytesSent << "/" << SLOW_HEADER_SIZE << "\n";
-        return 0;
-    }else{
-        cout << "Mensagem de disconnect enviada sem problemas\n";
-        this->nextSeqNumToSend++;
-        return 1;
+    SessionCacheEntry entry;
+    if(!sessionON && sessionCache.load(centralAddress, entry)){
+        prevSessionInfo.sid = entry.sid;
+        prevSessionInfo.sttl = entry.sttl;
+        prevSessionInfo.lastCentralSeqNum = entry.lastCentralSeqNum;
+        prevSessionInfo.window = entry.window;
+        prevSessionInfo.valid = true;
+        this->nextSeqNumToSend = entry.nextSeqNum;
+        SLOW_LOG_INFO("Sessão anterior com esta central encontrada no cache (", path, ")");
     }
+    return true;
 }
 
 void Peripheral::storeSession() {
@@ -743,6 +1701,7 @@ void Peripheral::storeSession() {
        sid               : identificador de sessão atual
        sttl              : tempo de vida remanescente do servidor (centralSttl)
        lastCentralSeqNum : último número de sequência recebido do central
+       window            : última janela anunciada, que limita o revive
        valid             : marca as informações como válidas para revive
      Emite mensagem de confirmação. Se não houver sessão ativa, exibe uma mensagem de aviso.
     */
@@ -751,10 +1710,12 @@ void Peripheral::storeSession() {
         prevSessionInfo.sid = this->currentSessionId;
         prevSessionInfo.sttl = this->centralSttl;
         prevSessionInfo.lastCentralSeqNum = this->lastCentralSeqNum; // O último seqNum que o central usou
+        prevSessionInfo.window = this->centralWindowSize;
         prevSessionInfo.valid = true;
-        cout << "Informações da sessão atual armazenadas para possível revive.\n";
+        sessionCache.store(centralAddress, currentSessionId, centralSttl, lastCentralSeqNum, nextSeqNumToSend, centralWindowSize);
+        SLOW_LOG_INFO("Informações da sessão atual armazenadas para possível revive.");
     } else {
-        cout << "Nenhuma sessão ativa para armazenar para revive.\n";
+        SLOW_LOG_INFO("Nenhuma sessão ativa para armazenar para revive.");
     }
 }
 
@@ -772,151 +1733,131 @@ bool Peripheral::canRevive(){
 bool Peripheral::zeroWayConnect(const string& data) {
     /**
     Tenta reestabelecer conexão “0-way” (revive) usando sessão anterior.
-    
-    Verifica pré-condições (socket aberto, sessão não ativa, existência de
-    informações de sessão anterior). Se o payload couber em um único pacote,
-    monta um cabeçalho SLOW com a flag R (revive) e o último ACK do central,
-    anexa os dados (se houver), envia via UDP e incrementa nextSeqNumToSend.
-    Em seguida, aguarda resposta com timeout:
-        Se receber um pacote “Failed”, considera o revive rejeitado, invalida sessão e retorna false.
-        Se receber um ACK aceitando com o mesmo SID anteriore ackNum igual ao seqNum do revive, atualiza parâmetros de sessão,
-        marca sessionON=true, e retorna true.
-        Caso contrário, retorna false.
-    
+    Versão síncrona de zeroWayConnectAsync(): os fragmentos do revive vão pela janela de
+    envio (startRevive()) e as respostas são tratadas por handleReviveResponse(), dentro do
+    laço de eventos, com retransmissão pelo RTO como qualquer outro pacote.
+        Se receber um “Failed” para um dos pacotes do revive, considera o revive rejeitado,
+        invalida a sessão anterior e retorna false.
+        O primeiro ACK com AR do SID anterior reativa a sessão; o revive termina quando
+        todos os fragmentos forem confirmados.
+        Respostas que não são para o revive (ex.: ACK atrasado da sessão anterior) são ignoradas.
+
     param  data  Dados a enviar junto com o revive.
 
-    return true  se o central aceitou o revive e reestabeleceu sessão;
-            false em caso de pré-condição não atendida, erro de envio/recepção,
-                    resposta “Failed” ou ACK inválido.
+    return true  se o central aceitou o revive e confirmou todos os dados;
+            false em caso de pré-condição não atendida, erro de envio, “Failed”
+                    ou retransmissões esgotadas.
+    */
+
+    bool done = false, success = false;
+    this->zeroWayConnectAsync(data, [&](OperationId, bool ok){ done = true; success = ok; });
+    return this->runUntil(done) && success;
+}
+
+bool Peripheral::startRevive(PeripheralOperation & operation) {
+    /*
+    Verifica pré-condições (socket aberto, sessão não ativa, existência de
+    informações de sessão anterior), monta a imagem do revive (flag R, SID e STTL
+    anteriores) e coloca os primeiros fragmentos na janela de envio. Até a central
+    responder, a janela é a última que ela anunciou na sessão anterior.
+
+    return  true se o revive começou.
     */
 
     if (sockFileDescriptor < 0) {
-        cout << "ERRO (0-way): Socket não inicializado.\n";
+        SLOW_LOG_ERROR("ERRO (0-way): Socket não inicializado.");
         return false;
     }
     if (sessionON) {
-        cout << "Erro: Uma sessão já está ativa. Desconecte primeiro.\n";
+        SLOW_LOG_ERROR("Erro: Uma sessão já está ativa. Desconecte primeiro.");
         return false;
     }
     if (!prevSessionInfo.valid) {
-        cout << "Warning: Nenhuma informação de sessão anterior válida para tentar reestabelecer conexão.\n";
+        SLOW_LOG_WARN("Warning: Nenhuma informação de sessão anterior válida para tentar reestabelecer conexão.");
         return false;
     }
 
-    cout << "Tentando 0-Way Connect (Revive) para SID anterior...\n";
-
-    // 2. Montagem e envio da mensagem de revive
-    SlowHeader reviveHeaderBase;
-    reviveHeaderBase.sid = prevSessionInfo.sid;
-    reviveHeaderBase.setSttl(prevSessionInfo.sttl);
-    reviveHeaderBase.ackNum = prevSessionInfo.lastCentralSeqNum;
-    reviveHeaderBase.window = 5 * 1440;
-    
-    Flags revive_flags;
-    revive_flags.R = true;
-    
-    if (data.size() > MAX_DATA_SIZE) { // Precisa fragmentar
-        int fid = generateFID();
-        size_t totalLen = data.size();
-        int numFrags = (totalLen + MAX_DATA_SIZE - 1) / MAX_DATA_SIZE;
-
-        for (int i = 0; i < numFrags; ++i) {
-            SlowHeader h = reviveHeaderBase;
-            size_t offset = i * MAX_DATA_SIZE;
-            size_t segSz = std::min(totalLen - offset, (size_t)MAX_DATA_SIZE);
-            
-            h.fid = fid;
-            h.fo = i;
-            Flags f = revive_flags;
-            f.MB = (i < numFrags - 1);
-            h.setFlags(f);
-            h.seqNum = nextSeqNumToSend;
-
-            uint8_t buf[SLOW_HEADER_SIZE + MAX_DATA_SIZE];
-            serializationOfSlowHeader(h, buf);
-            memcpy(buf + SLOW_HEADER_SIZE, data.data() + offset, segSz);
-            size_t totalPacketSize = SLOW_HEADER_SIZE + segSz;
-
-            ssize_t sent = sendto(sockFileDescriptor, buf, totalPacketSize, 0, (const struct sockaddr *)&centralAddress, sizeof(centralAddress));
-            if (sent < 0 || (size_t)sent != totalPacketSize) {
-                perror("sendto - 0-way fragment");
-                return false;
-            }
-            nextSeqNumToSend++;
-        }
-    } else { // Não precisa fragmentar
-        SlowHeader h = reviveHeaderBase;
-        h.seqNum = nextSeqNumToSend;
-        Flags f = revive_flags;
-        f.MB = false;
-        h.setFlags(f);
+    SLOW_LOG_INFO("Tentando 0-Way Connect (Revive) para SID anterior...");
 
-        uint8_t buf[SLOW_HEADER_SIZE + MAX_DATA_SIZE];
-        serializationOfSlowHeader(h, buf);
-        if (!data.empty()) {
-            memcpy(buf + SLOW_HEADER_SIZE, data.data(), data.size());
-        }
-        size_t totalPacketSize = SLOW_HEADER_SIZE + data.size();
+    reviveImage.build<ReviveMessage>(prevSessionInfo.sid, prevSessionInfo.sttl, PERIPHERAL_WINDOW_SIZE);
+    this->lastCentralSeqNum = prevSessionInfo.lastCentralSeqNum;
+    this->centralWindowSize = prevSessionInfo.window;
+    reviveFirstSeqNum = nextSeqNumToSend;
+    revivePending = true;
+    congestion.reset(congestion.getAlgorithm());
 
-        ssize_t sent = sendto(sockFileDescriptor, buf, totalPacketSize, 0, (const struct sockaddr *)&centralAddress, sizeof(centralAddress));
-        if (sent < 0 || (size_t)sent != totalPacketSize) {
-            perror("sendto - 0-way single packet");
-            return false;
-        }
-        nextSeqNumToSend++;
+    if (!this->fillWindow(operation)) {
+        SLOW_LOG_ERROR("Erro no envio do revive");
+        clearWindow();
+        return false;
     }
+    return true;
+}
 
-    uint8_t responseBuffer[MAX_DATA_SIZE + SLOW_HEADER_SIZE];
-    struct sockaddr_in senderAddress;
-    socklen_t senderAddress_len = sizeof(senderAddress);
-
-    ssize_t bytesReceived = recvfrom(sockFileDescriptor, responseBuffer, sizeof(responseBuffer), 0,
-                                     (struct sockaddr *)&senderAddress, &senderAddress_len);
+ReviveResponse Peripheral::handleReviveResponse(const Datagram & datagram) {
+    /*
+    Classifica uma resposta recebida durante o revive. Só conta o que responde a um dos
+    pacotes do revive (ackNum entre o primeiro e o último seqNum dele):
+        “Failed” (SID Nil, AR = 0): o revive foi rejeitado e a sessão anterior é esquecida;
+        ACK com AR do SID anterior: a sessão volta (no primeiro) e o pacote é confirmado.
+    O resto, como o ACK atrasado de um pacote da sessão anterior, é ignorado, em vez de
+    derrubar o revive.
+
+    return  ACCEPTED, FAILED ou IGNORED.
+    */
 
-    if (bytesReceived < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            cout << "TIMED OUT: Sem resposta do central para a tentativa de revive.\n";
-        } else {
-            perror("recvfrom - 0-way response");
-        }
-        return false;
-    }
+    uint8_t * responseBuffer = datagram.data;
+    size_t bytesReceived = datagram.size;
 
     if (bytesReceived < SLOW_HEADER_SIZE) {
-        cout << "Erro: Pacote de resposta do revive muito pequeno (" << bytesReceived << " bytes).\n";
-        return false;
+        SLOW_LOG_WARN("Pacote de resposta do revive muito pequeno (", bytesReceived, " bytes), ignorado.");
+        return ReviveResponse::IGNORED;
     }
 
-    // Declarando e preenchendo as variáveis que faltavam
     SlowHeader responseHeader;
     deserializationForSlowHeader(responseHeader, responseBuffer);
-    Flags responseFlags = responseHeader.getFlags();
 
-    // Checa se a resposta é uma mensagem de falha
-    if (responseFlags.AR == false && responseHeader.sid.isEqual(SID::Nil())) {
-        cout << "0-Way Connect REJEITADO (mensagem Failed recebida do central).\n";
+    // o ackNum precisa ser de um pacote do revive, não de um pacote antigo
+    bool forRevive = responseHeader.ackNum - reviveFirstSeqNum < nextSeqNumToSend - reviveFirstSeqNum;
+
+    if (FailedMessage::matches(responseBuffer) && responseHeader.sid.isEqual(SID::Nil())) {
+        if (!forRevive) {
+            SLOW_LOG_DEBUG("Failed para um pacote anterior ao revive ignorado (ackNum ", responseHeader.ackNum, ")");
+            return ReviveResponse::IGNORED;
+        }
+        SLOW_LOG_WARN("0-Way Connect REJEITADO (mensagem Failed recebida do central).");
         prevSessionInfo.valid = false;
-        return false;
+        sessionCache.invalidate(centralAddress);
+        return ReviveResponse::FAILED;
     }
 
-    // Checa se é um ACK de sucesso para o revive
-    uint32_t expectedAckNum = this->nextSeqNumToSend - 1;
+    if (!forRevive || !reviveImage.accepts<ReviveAckMessage>(responseBuffer)) {
+        SLOW_LOG_DEBUG("Resposta fora do revive ignorada (ackNum ", responseHeader.ackNum, ")");
+        return ReviveResponse::IGNORED;
+    }
 
-    if (responseFlags.ACK && responseFlags.AR &&
-        responseHeader.sid.isEqual(prevSessionInfo.sid) &&
-        responseHeader.ackNum == expectedAckNum) {
+    this->centralSttl = responseHeader.getSttl();
+    this->lastCentralSeqNum = responseHeader.seqNum;
+    this->centralWindowSize = responseHeader.window;
+    this->lastReceivedAckHeader = responseHeader;
 
-        cout << "0-Way Connect ACEITO! Sessão reviveu.\n";
+    if (!sessionON) {
+        SLOW_LOG_INFO("0-Way Connect ACEITO! Sessão reviveu.");
         this->currentSessionId = responseHeader.sid;
-        this->centralSttl = responseHeader.getSttl();
-        this->lastCentralSeqNum = responseHeader.seqNum;
-        this->centralWindowSize = responseHeader.window;
+        // a resposta com dados já é o próximo seqNum da central; a sem dados repete o último
+        this->receiveBuffer.reset(responseHeader.seqNum + (bytesReceived > SLOW_HEADER_SIZE ? 0 : 1));
         this->sessionON = true; // SESSÃO FINALMENTE ATIVA!
-        
-        return true;
+        this->buildSessionImages();
+        sessionCache.store(centralAddress, currentSessionId, centralSttl, lastCentralSeqNum, nextSeqNumToSend, centralWindowSize);
+    } else {
+        dataImage.setSttl(this->centralSttl);
+        disconnectImage.setSttl(this->centralSttl);
+        ackImage.setSttl(this->centralSttl);
+        sessionCache.touch(currentSessionId, lastCentralSeqNum, nextSeqNumToSend, centralWindowSize);
     }
 
-    // Se chegou aqui, a resposta não foi nem "Failed" nem o "ACK" esperado.
-    cout << "Erro: Resposta do central para o revive não reconhecida ou inválida.\n";
-    return false;
-}
\ No newline at end of file
+    if (bytesReceived > SLOW_HEADER_SIZE) {
+        this->acceptCentralPayload(responseHeader, responseBuffer + SLOW_HEADER_SIZE, bytesReceived - SLOW_HEADER_SIZE);
+    }
+    return ReviveResponse::ACCEPTED;
+}
@@ -2,6 +2,14 @@
 #define PERIPHERAL_H
 
 #include "slow.h"
+#include "rtt.h"
+#include "congestion.h"
+#include "batchio.h"
+#include "ringqueue.h"
+#include "receivebuffer.h"
+#include "packetpool.h"
+#include "messages.h"
+#include "sessioncache.h"
 
 #include <sys/types.h>   // Tipos de dados para sockets
 #include <sys/socket.h>  // Definições principais de sockets (socket, sendto, recvfrom)
@@ -9,18 +17,81 @@
 #include <arpa/inet.h>   // Funções para manipulação de endereços IP (inet_pton)
 #include <netdb.h>       // Para resolução de nomes de host (gethostbyname, getaddrinfo)
 #include <unistd.h>      // Para close() do socket
+#include <sys/epoll.h>   // Laço de eventos do modo assíncrono
+#include <sys/timerfd.h> // Prazos de retransmissão como eventos do laço
+#include <sys/stat.h>    // fstat() do arquivo de sendFile()
+#include <fcntl.h>       // open() e posix_fadvise() do arquivo de sendFile()
 
 enum class AckStatus {
     ACK_OK,         // ACK correto recebido
     TIMEOUT,        // recvfrom timedout
+    STALE,          // ACK de um pacote que já saiu da janela (ex.: de uma retransmissão): ignorado
+    DATA_ONLY,      // dados da central sem ACK: só passaram pelo buffer de recepção
     INVALID_PACKET, // Pacote recebido, mas não é o ACK esperado ou é inválido
     RECV_ERROR      // Outros
 };
 
+struct InFlightPacket {
+    uint32_t seqNum = 0;
+    uint8_t header[SLOW_HEADER_SIZE];  // cabeçalho serializado, pronto para retransmissão
+    const uint8_t * payload = nullptr; // fatia do buffer do chamador: os dados não são copiados
+    PacketBuffer * buffer = nullptr;   // mensagem copiada: o datagrama inteiro, devolvido ao pool no ACK
+    size_t payloadSize = 0; // bytes de dados, contabilizados contra a janela da central
+    int retries = 0;        // quantas vezes o pacote já foi retransmitido
+    int laterAcks = 0;      // ACKs de pacotes enviados depois dele: no limite, retransmissão rápida
+    bool acked = false;     // ACK recebido, aguardando os anteriores para deslizar a janela
+    SlowClock::time_point sentAt;   // última (re)transmissão, para a amostra de RTT
+    SlowClock::time_point deadline; // quando o pacote deve ser retransmitido se não houver ACK
+};
+
+const size_t MAX_IN_FLIGHT_PACKETS = 256; // capacidade fixa da janela de envio, alocada uma única vez
+const size_t SEGMENT_MAX_FRAGMENTS = 256;       // fo tem 8 bits: mensagens maiores vão em vários segmentos (fids)
+const size_t INITIAL_OPERATION_SLOTS = 16;   // fila de operações: cresce (dobrando) só quando enche
+const size_t PACKET_POOL_SIZE = 2 * MAX_IN_FLIGHT_PACKETS; // buffers para mensagens copiadas, alocados no primeiro uso
+
+using OperationId = uint64_t;
+using CompletionCallback = function<void(OperationId id, bool success)>;
+
+enum class OperationKind {
+    CONNECT,    // Connect + Setup + Data inicial
+    SEND,       // mensagem (fragmentada se preciso)
+    DISCONNECT,
+    REVIVE      // 0-way connect
+};
+
+struct PeripheralOperation {
+    OperationId id = 0;
+    OperationKind kind = OperationKind::SEND;
+    string_view data;          // SEND/REVIVE: buffer do chamador, precisa continuar válido até a conclusão
+    size_t nextOffset = 0;     // SEND: próximo byte a virar fragmento
+    int fid = 0;
+    int nextFo = 0;
+    bool segmentPending = false; // mensagem em segmentos: o anterior precisa ser confirmado antes do próximo fechar
+    uint32_t segmentEnd = 0;     // seqNum do último pacote do segmento anterior
+    bool started = false;      // já colocou pacotes na janela (ou iniciou o handshake)
+    bool allQueued = false;    // o último pacote da operação já está na janela
+    uint32_t lastSeqNum = 0;   // a operação termina quando este seqNum sai da janela
+    PacketBuffer * buffers = nullptr;    // SEND copiado: fragmentos de que a operação ainda é dona
+    PacketBuffer * nextBuffer = nullptr; // próximo fragmento copiado a entrar na janela
+    vector<char> ownedData;    // SEND copiado sem buffers livres no pool: data aponta para cá (mover não muda o endereço)
+    int sourceFd = -1;         // SEND de arquivo: os fragmentos são lidos daqui conforme a janela abre
+    off_t sourceOffset = 0;
+    uint64_t sourceSize = 0;
+    bool closeSource = false;  // o descritor foi aberto por sendFile(): fecha na conclusão
+    CompletionCallback onComplete;
+};
+
+enum class ReviveResponse {
+    ACCEPTED, // ACK + AR de um dos pacotes do revive
+    FAILED,   // Failed (SID Nil) em resposta a um dos pacotes do revive
+    IGNORED   // ACK atrasado da sessão anterior, Failed de outro pacote, lixo
+};
+
 struct PreviousSessionInfo {
     SID sid = SID::Nil();
     uint32_t sttl = 0;
     uint32_t lastCentralSeqNum = 0; // O último seqNum que recebemos do central na sessão anterior
+    uint16_t window = 0; // última janela anunciada pela central: limita os fragmentos do revive em trânsito
     bool valid = false; // Indica se há informação válida de sessão anterior
 };
 
@@ -30,15 +101,53 @@ class Peripheral{
         ~Peripheral();
 
         bool initNetwork(const char * hostName, int port);
+
+        // API síncrona: cada chamada roda o laço de eventos até a operação terminar
         bool connect();
         bool disconnect();
-        bool sendData(const string & data);
-        bool sendFragmentedData(const string & data, int fid, int fo, bool MB);
+        bool sendData(string_view data);
+        bool sendFile(const string & path);
+        bool sendFd(int fd, off_t offset, size_t length);
+        bool sendFragmentedData(string_view data, int fid, int fo, bool MB);
         bool zeroWayConnect(const string & data);
         void storeSession();
         bool canRevive();
+
+        // API assíncrona: retorna na hora; o callback é chamado de dentro de runOnce()
+        OperationId connectAsync(CompletionCallback onComplete = nullptr);
+        OperationId sendDataAsync(string_view data, CompletionCallback onComplete = nullptr);
+        OperationId sendDataCopyAsync(string_view data, CompletionCallback onComplete = nullptr);
+        OperationId sendFileAsync(const string & path, CompletionCallback onComplete = nullptr);
+        OperationId sendFdAsync(int fd, off_t offset, size_t length, CompletionCallback onComplete = nullptr);
+        OperationId disconnectAsync(CompletionCallback onComplete = nullptr);
+        OperationId zeroWayConnectAsync(string_view data, CompletionCallback onComplete = nullptr);
+        int runOnce(chrono::milliseconds timeout);
+
+        // dados vindos da central: fatias do buffer de recepção, até release()
+        bool receive(ReceivedMessage & message, chrono::milliseconds timeout = chrono::milliseconds(0));
+        void release(ReceivedMessage & message);
+        size_t pendingMessages() const { return receiveBuffer.readyMessages(); }
+        uint64_t droppedMessages() const { return receiveBuffer.droppedMessages(); } // maiores que o buffer de recepção
+
+        int getEventFileDescriptor() const { return epollFileDescriptor; }
+        size_t pendingOperations() const { return operations.size(); }
+        bool isConnected() const { return sessionON; }
+
+        void setRetransmissionPolicy(const RetransmissionPolicy & policy);
+        void setCongestionAlgorithm(CongestionAlgorithm algorithm);
+        bool enableZeroCopy();
+        bool enableOffload();
+        bool enableUring();
+        bool enableSessionCache(const string & path = defaultSessionCachePath());
+        const RttEstimator & getRttEstimator() const { return rtt; }
+        const CongestionController & getCongestionController() const { return congestion; }
+        const BatchIO & getTransport() const { return io; }
+        const PacketPool & getPacketPool() const { return packetPool; }
     private:
     int sockFileDescriptor;
+    int epollFileDescriptor;
+    int timerFileDescriptor;
+    int transportFileDescriptor; // o que o epoll espera para leitura: o socket ou o anel do io_uring
     struct sockaddr_in centralAddress;
 
     int lastAckNumFromCentral;
@@ -49,6 +158,7 @@ class Peripheral{
     SID currentSessionId;
     bool sessionON;
     uint32_t nextSeqNumToSend = 0;
+    uint8_t nextFid = 0; // fids da sessão, com volta em 255 (ver generateFID())
 
     uint32_t centralSttl; 
     uint32_t centralIniSeqNum;
@@ -57,12 +167,85 @@ class Peripheral{
 
 
     PreviousSessionInfo prevSessionInfo;
+    SessionCache sessionCache; // prevSessionInfo em disco, para o revive sobreviver a um reinício
+
+    // janela de envio: pacotes enviados que ainda aguardam ACK, em ordem de seqNum
+    RingQueue<InFlightPacket> inFlight;
+    size_t bytesInFlight = 0;
+    PacketPool packetPool; // dados das mensagens copiadas (sendDataCopyAsync)
+
+    RttEstimator rtt;
+    CongestionController congestion; // limita bytesInFlight a min(cwnd, centralWindowSize)
+    BatchIO io; // todo envio e recepção do socket passa por aqui (sendmmsg/recvmmsg)
+
+    // cabeçalhos pré-serializados da sessão: cada pacote só recebe seqNum/ackNum/fid/fo
+    HeaderImage dataImage;
+    HeaderImage disconnectImage;
+
+    // operações em andamento, em ordem; CONNECT, DISCONNECT e REVIVE só começam com a janela vazia
+    RingQueue<PeripheralOperation> operations;
+    OperationId nextOperationId = 1;
+    bool pumping = false;
+
+    // handshake (Connect) aguardando resposta da central
+    bool handshakePending = false;
+    int handshakeAttempts = 0;
+    SlowClock::time_point handshakeSentAt;
+    SlowClock::time_point handshakeDeadline;
+
+    // revive em andamento: os fragmentos ficam na janela de envio, como os de uma mensagem
+    bool revivePending = false;
+    uint32_t reviveFirstSeqNum = 0;
+    HeaderImage reviveImage;
+
+    // dados que chegam da central; a janela anunciada em cada pacote é o espaço livre dele
+    ReceiveBuffer receiveBuffer;
+    HeaderImage ackImage; // ACK puro, para confirmar os dados da central
+    vector<array<uint8_t, SLOW_HEADER_SIZE>> ackHeaders; // ficam aqui até o lote ser enviado
+    size_t ackCount = 0;
+    uint16_t advertisedWindow = 0; // janela do último ACK enviado à central
 
     bool sendConnectMessage();
-    bool waitSetupMessage(); // espera a mensagem setup da central
+    bool handleSetupMessage(const Datagram & datagram); // processa a mensagem setup da central
     bool sendDataMessage();
-    AckStatus waitAck();
+    AckStatus handleAck(const Datagram & datagram);
+    void buildSessionImages();
+    void acceptCentralPayload(const SlowHeader & header, const uint8_t * payload, size_t payloadSize);
+    bool sendReceiveAck(uint32_t ackNum);
+    void updateReceiveWindow();
     bool sendDisconnectMessage();
+    bool startRevive(PeripheralOperation & operation);
+    ReviveResponse handleReviveResponse(const Datagram & datagram);
+
+    OperationId enqueueOperation(OperationKind kind, string_view data, CompletionCallback onComplete);
+    PeripheralOperation & prepareOperation(OperationKind kind, string_view data, CompletionCallback onComplete);
+    OperationId rejectOperation(CompletionCallback onComplete);
+    OperationId enqueueSource(int fd, off_t offset, size_t length, bool closeSource, CompletionCallback onComplete);
+    bool readFragment(PeripheralOperation & operation, size_t size, PacketBuffer *& buffer);
+    bool runUntil(const bool & done);
+    void pumpOperations();
+    bool startOperation(PeripheralOperation & operation);
+    bool fillWindow(PeripheralOperation & operation);
+    uint8_t generateFID();
+    bool segmentConfirmed(uint32_t lastSeqNum) const;
+    bool queueFragment(const HeaderImage & image, string_view data, int fid, int fo, bool MB, PacketBuffer * buffer = nullptr);
+    bool operationFinished(const PeripheralOperation & operation);
+    void finishOperation(bool success);
+    void completeOperation(PeripheralOperation & operation, bool success);
+    void failQueuedOperations();
+    void handleDatagram(const Datagram & datagram);
+    void handleSocketError();
+    void handleTimer();
+    void armTimer();
+    void watchTransport();
+    void closeNetwork();
+
+    bool transmitPacket(InFlightPacket & packet);
+    bool queuePacket(InFlightPacket & packet);
+    bool windowHasRoom(size_t payloadSize) const;
+    bool retransmitExpired();
+    bool slideWindow();
+    void clearWindow();
 };
 
 
@@ -0,0 +1,254 @@
+#include "reassembly.h"
+
+Reassembler::Reassembler(size_t slotCount, int maxFragments) : slots(slotCount), slabMemory(nullptr),
+    slabSize((size_t)maxFragments * MAX_DATA_SIZE), maxFragments(maxFragments), freeHead(-1), inUse(0){
+    /*
+    Aloca os slots e os slabs de uma vez. O tamanho de cada slab é arredondado para
+    múltiplo da linha de cache, então todos começam alinhados.
+    */
+    slabSize = (slabSize + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    if(slotCount > 0){
+        slabMemory = static_cast<uint8_t *>(aligned_alloc(CACHE_LINE_SIZE, slabSize * slotCount));
+    }
+
+    for(size_t i = 0; i < slotCount; i++){
+        slots[i].slab = slabMemory + i * slabSize;
+        slots[i].nextFree = freeHead;
+        freeHead = (int)i;
+    }
+}
+
+Reassembler::~Reassembler(){
+    free(slabMemory);
+}
+
+ReassemblyResult Reassembler::addFragment(ReassemblyState & state, const SID & sid, uint8_t fid, uint8_t fo, bool moreBits,
+                                          uint32_t seqNum, const uint8_t * data, size_t size, ReassembledMessage & out){
+    /*
+    Coloca um fragmento no slab da mensagem (sid, fid), criando o slot se for o primeiro.
+    Todos os fragmentos, menos o último (MB = false), precisam ter exatamente MAX_DATA_SIZE
+    bytes, como o Peripheral::sendData gera; é isso que permite posicioná-los por fo.
+
+    param   state     Slots da sessão (ReassemblyState guardado na sessão).
+    param   sid       SID da sessão, conferido contra o slot.
+    param   fid, fo   Identificação e posição do fragmento.
+    param   moreBits  Flag MB do fragmento.
+    param   seqNum    seqNum do pacote: separa a mensagem de uma antiga com o mesmo fid.
+    param   out       Preenchido quando o resultado é COMPLETE; liberar com release().
+
+    return  ver ReassemblyResult.
+    */
+    if(fo >= maxFragments || size > (size_t)MAX_DATA_SIZE || (moreBits && size != (size_t)MAX_DATA_SIZE)){
+        return ReassemblyResult::REJECTED;
+    }
+
+    int index = findSlot(state, sid, fid);
+    if(index < 0){
+        index = allocateSlot(state, sid, fid, seqNum);
+        if(index < 0){
+            return ReassemblyResult::REJECTED;
+        }
+    }
+    ReassemblySlot & slot = slots[index];
+
+    uint64_t bit = 1ULL << (fo % 64);
+    if((slot.received[fo / 64] & bit) && slot.seqNum[fo] == seqNum){
+        return ReassemblyResult::DUPLICATE;
+    }
+    // caminho comum (fragmentos em ordem): nada no slot é de outra mensagem
+    bool inOrder = !(slot.received[fo / 64] & bit) && fo > slot.highestFo &&
+                   (slot.highestFo < 0 || (int32_t)(seqNum - slot.newestSeq) > 0);
+    if(!inOrder && !this->dropOlderMessage(slot, fo, seqNum)){
+        return ReassemblyResult::REJECTED;
+    }
+
+    if(!moreBits){
+        // o último fragmento define o tamanho: não pode haver fragmentos depois dele
+        if(slot.lastFo >= 0 && slot.lastFo != fo){
+            return ReassemblyResult::REJECTED;
+        }
+        for(int later = fo + 1; later < maxFragments; later++){
+            if(slot.received[later / 64] & (1ULL << (later % 64))){
+                return ReassemblyResult::REJECTED;
+            }
+        }
+        slot.lastFo = fo;
+        slot.lastSize = size;
+    }else if(slot.lastFo >= 0 && fo > slot.lastFo){
+        return ReassemblyResult::REJECTED;
+    }
+
+    memcpy(slot.slab + (size_t)fo * MAX_DATA_SIZE, data, size);
+    slot.received[fo / 64] |= bit;
+    slot.seqNum[fo] = seqNum;
+    slot.receivedCount++;
+    if(fo > slot.highestFo){
+        slot.highestFo = fo;
+    }
+    if(slot.receivedCount == 1 || (int32_t)(seqNum - slot.newestSeq) > 0){
+        slot.newestSeq = seqNum;
+    }
+
+    if(slot.lastFo < 0 || slot.receivedCount != slot.lastFo + 1){
+        return ReassemblyResult::INCOMPLETE;
+    }
+
+    out.data = slot.slab;
+    out.size = (size_t)slot.lastFo * MAX_DATA_SIZE + slot.lastSize;
+    out.slot = index;
+    out.fid = fid;
+    return ReassemblyResult::COMPLETE;
+}
+
+void Reassembler::release(ReassemblyState & state, const ReassembledMessage & message){
+    /*
+    Devolve o slot de uma mensagem completa à lista de livres (O(1)).
+    */
+    if(message.slot >= 0 && slots[message.slot].inUse){
+        freeSlot(state, message.slot);
+    }
+}
+
+void Reassembler::dropSession(ReassemblyState & state){
+    /*
+    Libera todas as mensagens em montagem da sessão (sessão encerrada ou expirada).
+    */
+    for(int i = 0; i < MAX_REASSEMBLY_SLOTS_PER_SESSION; i++){
+        if(state.slot[i] >= 0){
+            freeSlot(state, state.slot[i]);
+        }
+    }
+}
+
+int Reassembler::findSlot(const ReassemblyState & state, const SID & sid, uint8_t fid) const{
+    for(int i = 0; i < MAX_REASSEMBLY_SLOTS_PER_SESSION; i++){
+        int index = state.slot[i];
+        if(index >= 0 && slots[index].fid == fid && slots[index].sid.isEqual(sid)){
+            return index;
+        }
+    }
+    return -1;
+}
+
+bool Reassembler::dropOlderMessage(ReassemblySlot & slot, uint8_t fo, uint32_t seqNum){
+    /*
+    Confere o fragmento (fo, seqNum) contra os fragmentos do slot quando ele chega fora
+    de ordem. Numa mesma mensagem o seqNum cresce com o fo, e uma mensagem posterior tem
+    todos os seqNums maiores que os da anterior. Então:
+        - um fragmento do slot com fo >= fo e seqNum menor é de uma mensagem anterior; todos
+          os fragmentos com seqNum até o maior deles também são, e saem do slot;
+        - um fragmento do slot com fo <= fo e seqNum maior mostra que o novo é de uma
+          mensagem anterior à do slot.
+
+    return  false se o fragmento é de uma mensagem anterior (deve ser recusado).
+    */
+    bool older = false;
+    uint32_t oldest = 0;
+    for(int word = 0; word < MAX_FRAGMENTS_PER_MESSAGE / 64; word++){
+        for(uint64_t bits = slot.received[word]; bits != 0; bits &= bits - 1){
+            int other = word * 64 + __builtin_ctzll(bits);
+            int32_t diff = (int32_t)(seqNum - slot.seqNum[other]);
+            if(other <= fo && diff < 0){
+                return false;
+            }
+            if(other >= fo && diff > 0 && (!older || (int32_t)(slot.seqNum[other] - oldest) > 0)){
+                older = true;
+                oldest = slot.seqNum[other];
+            }
+        }
+    }
+    if(!older){
+        return true;
+    }
+
+    slot.highestFo = -1;
+    for(int word = 0; word < MAX_FRAGMENTS_PER_MESSAGE / 64; word++){
+        for(uint64_t bits = slot.received[word]; bits != 0; bits &= bits - 1){
+            int other = word * 64 + __builtin_ctzll(bits);
+            if((int32_t)(slot.seqNum[other] - oldest) <= 0){
+                slot.received[word] &= ~(1ULL << (other % 64));
+                slot.receivedCount--;
+                if(slot.lastFo == other){
+                    slot.lastFo = -1;
+                    slot.lastSize = 0;
+                }
+            }else{
+                slot.highestFo = other;
+            }
+        }
+    }
+    return true;
+}
+
+int Reassembler::allocateSlot(ReassemblyState & state, const SID & sid, uint8_t fid, uint32_t seqNum){
+    /*
+    Tira um slot da lista de livres e registra na sessão.
+
+    Sem slot para a sessão, o dela que está parado há mais tempo é reaproveitado se o seu
+    último fragmento ficou mais de REASSEMBLY_STALE_SPAN seqNums para trás: uma mensagem
+    ainda viva tem um fragmento sem ACK na janela do peripheral, junto com seqNum, e os
+    fragmentos que a central já tem estão a menos de um segmento dele. Se o peripheral
+    abandonou a mensagem (envio abortado), nenhum fragmento dela volta e o slot ficaria
+    preso até o fim da sessão.
+
+    return  índice do slot, ou -1 se a sessão já usa todos os seus slots ou não há slot livre.
+    */
+    int position = -1;
+    int stalest = -1;
+    for(int i = 0; i < MAX_REASSEMBLY_SLOTS_PER_SESSION; i++){
+        int index = state.slot[i];
+        if(index < 0){
+            if(position < 0){
+                position = i;
+            }
+        }else if(stalest < 0 || (int32_t)(slots[index].newestSeq - slots[stalest].newestSeq) < 0){
+            stalest = index;
+        }
+    }
+    if((position < 0 || freeHead < 0) && stalest >= 0 &&
+       (int32_t)(seqNum - slots[stalest].newestSeq) > (int32_t)REASSEMBLY_STALE_SPAN){
+        freeSlot(state, stalest);
+        for(int i = 0; i < MAX_REASSEMBLY_SLOTS_PER_SESSION; i++){
+            if(state.slot[i] < 0){
+                position = i;
+                break;
+            }
+        }
+    }
+    if(position < 0 || freeHead < 0){
+        return -1;
+    }
+
+    int index = freeHead;
+    ReassemblySlot & slot = slots[index];
+    freeHead = slot.nextFree;
+
+    slot.sid = sid;
+    slot.fid = fid;
+    memset(slot.received, 0, sizeof(slot.received));
+    slot.receivedCount = 0;
+    slot.lastFo = -1;
+    slot.lastSize = 0;
+    slot.highestFo = -1;
+    slot.newestSeq = seqNum;
+    slot.nextFree = -1;
+    slot.inUse = true;
+
+    state.slot[position] = (int16_t)index;
+    inUse++;
+    return index;
+}
+
+void Reassembler::freeSlot(ReassemblyState & state, int index){
+    for(int i = 0; i < MAX_REASSEMBLY_SLOTS_PER_SESSION; i++){
+        if(state.slot[i] == index){
+            state.slot[i] = -1;
+        }
+    }
+
+    ReassemblySlot & slot = slots[index];
+    slot.inUse = false;
+    slot.nextFree = freeHead;
+    freeHead = index;
+    inUse--;
+}
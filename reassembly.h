@@ -0,0 +1,99 @@
+#ifndef REASSEMBLY_H
+#define REASSEMBLY_H
+
+#include "slow.h"
+
+const size_t CACHE_LINE_SIZE = 64;
+const int MAX_FRAGMENTS_PER_MESSAGE = 256;    // fo tem 8 bits
+const int MAX_REASSEMBLY_SLOTS_PER_SESSION = 4; // mensagens fragmentadas simultâneas por sessão
+// Distância em seqNums a partir da qual um slot parado é de uma mensagem abandonada pelo
+// peripheral (ver Reassembler::allocateSlot()).
+const uint32_t REASSEMBLY_STALE_SPAN = 512;
+
+enum class ReassemblyResult {
+    INCOMPLETE, // fragmento guardado, ainda faltam outros
+    COMPLETE,   // mensagem completa em out
+    DUPLICATE,  // fragmento já recebido antes (pode ser confirmado de novo)
+    REJECTED    // sem slot livre, fora dos limites ou inconsistente: não deve ser confirmado
+};
+
+struct ReassemblyState {
+    // slots em uso pela sessão; é tudo o que a sessão guarda, então a memória por sessão é fixa
+    int16_t slot[MAX_REASSEMBLY_SLOTS_PER_SESSION];
+
+    ReassemblyState() { for(int i = 0; i < MAX_REASSEMBLY_SLOTS_PER_SESSION; i++) slot[i] = -1; }
+};
+
+struct ReassembledMessage {
+    const uint8_t * data = nullptr; // aponta para o slab do slot: válido até release()
+    size_t size = 0;
+    int slot = -1;
+    uint8_t fid = 0;
+};
+
+struct alignas(CACHE_LINE_SIZE) ReassemblySlot {
+    SID sid;
+    uint64_t received[MAX_FRAGMENTS_PER_MESSAGE / 64]; // bitmap dos fo já recebidos
+    uint32_t seqNum[MAX_FRAGMENTS_PER_MESSAGE];        // seqNum de cada fo recebido
+    uint8_t * slab = nullptr;   // maxFragments * MAX_DATA_SIZE bytes, alinhado à linha de cache
+    int receivedCount = 0;
+    int lastFo = -1;            // fo do fragmento com MB = false, quando já recebido
+    int highestFo = -1;         // maior fo recebido
+    uint32_t newestSeq = 0;     // maior seqNum recebido
+    size_t lastSize = 0;        // tamanho do último fragmento
+    int nextFree = -1;          // encadeamento da lista de slots livres
+    uint8_t fid = 0;
+    bool inUse = false;
+};
+
+class Reassembler{
+    /*
+    Remontagem de mensagens fragmentadas, chaveada por (SID, fid).
+
+    Toda a memória é alocada na construção: um slab contíguo por slot, com espaço para
+    maxFragments fragmentos de MAX_DATA_SIZE bytes. Cada fragmento é copiado direto para
+    a posição fo * MAX_DATA_SIZE do slab, então a mensagem completa já sai contígua, sem
+    nenhuma cópia extra. A conclusão é controlada por um bitmap de 256 bits, o que torna
+    fragmentos fora de ordem e duplicados triviais de tratar. Slots livres ficam numa
+    lista encadeada: alocar e liberar são O(1).
+
+    O fid tem 8 bits e volta a ser usado; se o peripheral abandonou uma mensagem (envio
+    abortado), o slot dela continua com o mesmo (SID, fid). Os seqNums separam as duas: o
+    peripheral numera os fragmentos de uma mensagem em ordem de fo, e os de uma mensagem
+    posterior sempre depois. Um fragmento mais novo que outro de fo maior ou igual no slot
+    é de uma mensagem nova, e os fragmentos da antiga são descartados; um mais velho que
+    outro de fo menor ou igual é resto da antiga, e é recusado.
+
+    A sessão guarda só um ReassemblyState (índices dos seus slots), o que limita a
+    MAX_REASSEMBLY_SLOTS_PER_SESSION as mensagens em montagem ao mesmo tempo por sessão.
+    Serve tanto ao Peripheral (dados vindos da central) quanto à Central.
+    */
+    public:
+        Reassembler(size_t slotCount, int maxFragments = MAX_FRAGMENTS_PER_MESSAGE);
+        ~Reassembler();
+
+        Reassembler(const Reassembler &) = delete;
+        Reassembler & operator=(const Reassembler &) = delete;
+
+        ReassemblyResult addFragment(ReassemblyState & state, const SID & sid, uint8_t fid, uint8_t fo, bool moreBits,
+                                     uint32_t seqNum, const uint8_t * data, size_t size, ReassembledMessage & out);
+        void release(ReassemblyState & state, const ReassembledMessage & message);
+        void dropSession(ReassemblyState & state);
+
+        size_t slotsInUse() const { return inUse; }
+        size_t capacity() const { return slots.size(); }
+    private:
+        vector<ReassemblySlot> slots;
+        uint8_t * slabMemory;
+        size_t slabSize;
+        int maxFragments;
+        int freeHead;
+        size_t inUse;
+
+        int findSlot(const ReassemblyState & state, const SID & sid, uint8_t fid) const;
+        int allocateSlot(ReassemblyState & state, const SID & sid, uint8_t fid, uint32_t seqNum);
+        bool dropOlderMessage(ReassemblySlot & slot, uint8_t fo, uint32_t seqNum);
+        void freeSlot(ReassemblyState & state, int index);
+};
+
+#endif
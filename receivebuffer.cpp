@@ -0,0 +1,207 @@
+#include "receivebuffer.h"
+
+ReceiveBuffer::ReceiveBuffer(size_t slotCount) : slots(slotCount), partial(256), ready(slotCount), slab(nullptr), expected(0), head(0), dropped(0){
+    /*
+    Aloca o slab de uma vez, arredondado para múltiplo da linha de cache.
+    */
+    size_t slabSize = (slotCount * MAX_DATA_SIZE + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    if(slabSize > 0){
+        slab = static_cast<uint8_t *>(aligned_alloc(CACHE_LINE_SIZE, slabSize));
+    }
+}
+
+ReceiveBuffer::~ReceiveBuffer(){
+    free(slab);
+}
+
+void ReceiveBuffer::reset(uint32_t nextSeqNum){
+    /*
+    Nova sessão: descarta tudo (inclusive mensagens não liberadas) e espera nextSeqNum.
+    */
+    for(Slot & slot : slots){
+        slot = Slot();
+    }
+    for(Partial & message : partial){
+        message = Partial();
+    }
+    ready.clear();
+    dropped = 0;
+    expected = nextSeqNum;
+    head = 0;
+}
+
+ReceiveResult ReceiveBuffer::add(uint32_t seqNum, uint8_t fid, uint8_t fo, bool moreBits, const uint8_t * data, size_t size){
+    /*
+    Guarda um pacote de dados da central no slot do seu seqNum e avança a fronteira.
+
+    param   seqNum        seqNum do pacote.
+    param   fid, fo, moreBits  fragmentação, como no cabeçalho.
+    param   data, size    dados após o cabeçalho (copiados para o slot).
+
+    return  ver ReceiveResult.
+    */
+    if(slots.empty()){
+        return ReceiveResult::REJECTED;
+    }
+    int32_t offset = (int32_t)(seqNum - expected);
+    if(offset < 0){
+        return ReceiveResult::DUPLICATE; // já entregue (ou descartado por estar malformado)
+    }
+    if((size_t)offset >= slots.size() || size == 0 || size > (size_t)MAX_DATA_SIZE){
+        return ReceiveResult::REJECTED;
+    }
+
+    int index = (head + offset) % slots.size();
+    Slot & slot = slots[index];
+    if(slot.present){
+        // o mesmo pacote de novo, ou o slot ainda guarda uma mensagem que a aplicação não liberou
+        return slot.seqNum == seqNum && !slot.passed ? ReceiveResult::DUPLICATE : ReceiveResult::REJECTED;
+    }
+
+    memcpy(slab + (size_t)index * MAX_DATA_SIZE, data, size);
+    slot.seqNum = seqNum;
+    slot.size = size;
+    slot.next = -1;
+    slot.fid = fid;
+    slot.fo = fo;
+    slot.moreBits = moreBits;
+    slot.present = true;
+    slot.passed = false;
+
+    this->advance();
+    return ReceiveResult::ACCEPTED;
+}
+
+void ReceiveBuffer::advance(){
+    /*
+    Move a fronteira sobre os pacotes que já estão em sequência, montando as mensagens.
+    */
+    while(true){
+        int index = head;
+        Slot & slot = slots[index];
+        if(!slot.present || slot.passed || slot.seqNum != expected){
+            return;
+        }
+        slot.passed = true;
+        expected++;
+        head = (head + 1) % slots.size();
+        this->assemble(index);
+    }
+}
+
+void ReceiveBuffer::assemble(int index){
+    /*
+    Junta o pacote que a fronteira acabou de passar à sua mensagem: sozinho, se não é
+    fragmento, ou à lista do fid. Um fragmento fora da sequência de fo descarta a
+    mensagem inteira (a central não manda isso; os slots não podem ficar presos).
+    */
+    Slot & slot = slots[index];
+    if(!slot.moreBits && slot.fo == 0){
+        ready.emplace_back() = Ready{(int16_t)index, slot.size};
+        return;
+    }
+
+    Partial & message = partial[slot.fid];
+    if(slot.fo == 0 && (message.first >= 0 || message.discarding)){
+        if(message.first >= 0){
+            this->freeChain(message.first); // o fid recomeçou: a mensagem anterior ficou incompleta
+        }
+        message = Partial();
+    }
+    if(message.discarding){
+        // resto de uma mensagem maior que o buffer: confirmado e descartado
+        this->freeChain(index);
+        message.discarding = slot.moreBits;
+        return;
+    }
+    if(slot.fo != message.count){
+        if(message.first >= 0){
+            this->freeChain(message.first);
+        }
+        message = Partial();
+        this->freeChain(index);
+        return;
+    }
+
+    if(message.first < 0){
+        message.first = index;
+    }else{
+        slots[message.last].next = index;
+    }
+    message.last = index;
+    message.count++;
+    message.size += slot.size;
+
+    if(!slot.moreBits){
+        ready.emplace_back() = Ready{message.first, message.size};
+        message = Partial();
+    }else if(message.count == slots.size()){
+        // ocupa o buffer inteiro e ainda não acabou: nunca caberia, e a janela ficaria
+        // fechada para sempre. Descarta a mensagem; os fragmentos restantes são só confirmados.
+        this->freeChain(message.first);
+        message = Partial();
+        message.discarding = true;
+        dropped++;
+    }
+}
+
+bool ReceiveBuffer::pop(ReceivedMessage & out){
+    /*
+    Tira a próxima mensagem completa da fila.
+
+    param   out  recebe as fatias da mensagem; devolver com release().
+    return  false se não há mensagem pronta.
+    */
+    if(ready.empty()){
+        return false;
+    }
+    Ready message = ready.front();
+    ready.pop_front();
+
+    out.segments.clear();
+    for(int index = message.first; index >= 0; index = slots[index].next){
+        out.segments.emplace_back((const char *)slab + (size_t)index * MAX_DATA_SIZE, slots[index].size);
+    }
+    out.size = message.size;
+    out.first = message.first;
+    return true;
+}
+
+void ReceiveBuffer::release(ReceivedMessage & message){
+    /*
+    Devolve os slots de uma mensagem tirada com pop(); as fatias deixam de valer.
+    */
+    if(message.first >= 0){
+        this->freeChain(message.first);
+    }
+    message.segments.clear();
+    message.size = 0;
+    message.first = -1;
+}
+
+void ReceiveBuffer::freeChain(int index){
+    while(index >= 0){
+        Slot & slot = slots[index];
+        index = slot.next;
+        slot = Slot();
+    }
+}
+
+uint16_t ReceiveBuffer::window() const{
+    /*
+    Bytes que a central ainda pode mandar: slots livres a partir da fronteira, até o
+    primeiro que guarda dados já passados (mensagem não liberada ou em montagem).
+    Pacotes fora de ordem já guardados não contam.
+    */
+    size_t free = 0;
+    for(size_t i = 0; i < slots.size(); i++){
+        const Slot & slot = slots[(head + i) % slots.size()];
+        if(slot.passed){
+            break;
+        }
+        if(!slot.present){
+            free++;
+        }
+    }
+    return (uint16_t)min<size_t>(free * MAX_DATA_SIZE, UINT16_MAX);
+}
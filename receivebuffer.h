@@ -0,0 +1,95 @@
+#ifndef RECEIVEBUFFER_H
+#define RECEIVEBUFFER_H
+
+#include "slow.h"
+#include "reassembly.h" // CACHE_LINE_SIZE
+#include "ringqueue.h"
+
+const size_t RECEIVE_BUFFER_SLOTS = 45; // 45 fragmentos cheios: a maior janela que cabe nos 16 bits
+
+enum class ReceiveResult {
+    ACCEPTED,  // pacote guardado (em ordem ou não): deve ser confirmado
+    DUPLICATE, // já recebido antes: deve ser confirmado de novo, sem entregar outra vez
+    REJECTED   // fora da janela, sem slot livre ou inválido: não deve ser confirmado
+};
+
+struct ReceivedMessage {
+    /*
+    Mensagem da central pronta para a aplicação. Os dados não são copiados: cada segmento
+    é a fatia de um slot do buffer (um por fragmento, em ordem de fo), válida até
+    release() ou até a próxima sessão.
+    */
+    vector<string_view> segments; // reaproveitado entre chamadas: não aloca depois da primeira mensagem grande
+    size_t size = 0;
+    int first = -1;               // primeiro slot, para release()
+};
+
+class ReceiveBuffer{
+    /*
+    Buffer de recepção dos dados vindos da central, com tamanho fixo alocado uma única
+    vez: slotCount slots de MAX_DATA_SIZE bytes num slab alinhado à linha de cache,
+    usados em anel. O pacote nextExpected + k fica no k-ésimo slot depois do da
+    fronteira, então pacotes fora de ordem são guardados direto no lugar, e a fronteira
+    avança sobre os que já estão em sequência. Fragmentos (MB ou fo > 0) de uma mensagem
+    são encadeados por fid à medida que a fronteira passa por eles.
+
+    A janela anunciada à central (window()) é o espaço livre a partir da fronteira: slots
+    ainda presos a mensagens não liberadas pela aplicação não contam. Uma mensagem
+    precisa caber inteira no buffer, então as mensagens recebidas têm no máximo
+    slotCount fragmentos: uma maior é descartada quando enche o buffer (contada em
+    droppedMessages()), e os fragmentos restantes dela são confirmados sem guardar nada,
+    para a central não retransmiti-los para sempre.
+    */
+    public:
+        explicit ReceiveBuffer(size_t slotCount = RECEIVE_BUFFER_SLOTS);
+        ~ReceiveBuffer();
+
+        ReceiveBuffer(const ReceiveBuffer &) = delete;
+        ReceiveBuffer & operator=(const ReceiveBuffer &) = delete;
+
+        void reset(uint32_t nextSeqNum);
+        ReceiveResult add(uint32_t seqNum, uint8_t fid, uint8_t fo, bool moreBits, const uint8_t * data, size_t size);
+        bool pop(ReceivedMessage & out);
+        void release(ReceivedMessage & message);
+
+        uint16_t window() const;
+        uint32_t nextExpected() const { return expected; }
+        size_t readyMessages() const { return ready.size(); }
+        uint64_t droppedMessages() const { return dropped; }
+    private:
+        struct Slot {
+            uint32_t seqNum = 0;
+            uint16_t size = 0;
+            int16_t next = -1;     // próximo fragmento da mesma mensagem
+            uint8_t fid = 0;
+            uint8_t fo = 0;
+            bool moreBits = false;
+            bool present = false;  // guarda dados (recebido e ainda não liberado)
+            bool passed = false;   // a fronteira já passou: pertence a uma mensagem (pronta ou em montagem)
+        };
+        struct Partial {
+            int16_t first = -1;    // fragmentos da mensagem em montagem com este fid, em ordem
+            int16_t last = -1;
+            uint16_t count = 0;
+            uint32_t size = 0;
+            bool discarding = false; // mensagem maior que o buffer: fragmentos descartados até o último
+        };
+        struct Ready {
+            int16_t first = -1;
+            uint32_t size = 0;
+        };
+
+        vector<Slot> slots;
+        vector<Partial> partial; // por fid
+        RingQueue<Ready> ready;  // mensagens completas, na ordem em que a fronteira as completou
+        uint8_t * slab;
+        uint32_t expected;       // seqNum da fronteira
+        size_t head;             // slot do seqNum expected
+        uint64_t dropped;        // mensagens descartadas por não caberem no buffer
+
+        void advance();
+        void assemble(int index);
+        void freeChain(int index);
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include <bits/stdc++.h>
+
+using namespace std;
+
+template <typename T>
+class RingQueue{
+    /*
+    Fila circular de capacidade fixa. Toda a memória é alocada uma única vez em reserve();
+    push_back/pop_front/pop_back apenas movem índices, então o caminho quente não aloca.
+    As referências aos elementos continuam válidas enquanto eles estiverem na fila.
+    */
+    public:
+        RingQueue() : head(0), count(0) {}
+        explicit RingQueue(size_t capacity) : head(0), count(0) { reserve(capacity); }
+
+        void reserve(size_t capacity){
+            slots.assign(capacity, T());
+            head = 0;
+            count = 0;
+        }
+
+        size_t capacity() const { return slots.size(); }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        bool full() const { return count == slots.size(); }
+
+        T & operator[](size_t i) { return slots[(head + i) % slots.size()]; }
+        const T & operator[](size_t i) const { return slots[(head + i) % slots.size()]; }
+
+        T & front() { return (*this)[0]; }
+        const T & front() const { return (*this)[0]; }
+        T & back() { return (*this)[count - 1]; }
+        const T & back() const { return (*this)[count - 1]; }
+
+        // devolve o próximo slot, reinicializado; a fila não pode estar cheia
+        T & emplace_back(){
+            T & slot = slots[(head + count) % slots.size()];
+            slot = T();
+            count++;
+            return slot;
+        }
+
+        void pop_front(){
+            head = (head + 1) % slots.size();
+            count--;
+        }
+
+        void pop_back(){
+            count--;
+        }
+
+        // dobra a capacidade mantendo a ordem (para filas sem limite fixo); invalida as referências
+        void grow(){
+            vector<T> larger(max<size_t>(2 * slots.size(), 1));
+            for(size_t i = 0; i < count; i++){
+                larger[i] = move((*this)[i]);
+            }
+            slots.swap(larger);
+            head = 0;
+        }
+
+        void clear(){
+            head = 0;
+            count = 0;
+        }
+
+        template <typename Q, typename R>
+        struct Iterator{
+            Q * queue;
+            size_t index;
+            R & operator*() const { return (*queue)[index]; }
+            Iterator & operator++() { index++; return *this; }
+            bool operator!=(const Iterator & other) const { return index != other.index; }
+        };
+
+        Iterator<RingQueue, T> begin() { return {this, 0}; }
+        Iterator<RingQueue, T> end() { return {this, count}; }
+        Iterator<const RingQueue, const T> begin() const { return {this, 0}; }
+        Iterator<const RingQueue, const T> end() const { return {this, count}; }
+    private:
+        vector<T> slots;
+        size_t head;
+        size_t count;
+};
+
+#endif
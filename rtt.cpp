@@ -0,0 +1,56 @@
+#include "rtt.h"
+
+RttEstimator::RttEstimator(const RetransmissionPolicy & policy) : policy(policy), currentRto(policy.initialRto){
+
+}
+
+void RttEstimator::setPolicy(const RetransmissionPolicy & newPolicy){
+    /*
+    Troca os parâmetros de retransmissão. Se ainda não houver amostra de RTT,
+    o RTO volta ao valor inicial da nova política.
+    */
+    policy = newPolicy;
+    if(!sampled){
+        currentRto = clampRto(policy.initialRto);
+    }else{
+        currentRto = clampRto(smoothedRtt + 4 * rttVariation);
+    }
+}
+
+void RttEstimator::addSample(chrono::microseconds rtt){
+    /*
+    Incorpora uma amostra de RTT (RFC 6298, seção 2):
+        primeira amostra: SRTT = R, RTTVAR = R/2
+        demais:           RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|
+                          SRTT   = 7/8 SRTT   + 1/8 R
+        RTO = SRTT + 4 * RTTVAR, limitado por [minRto, maxRto]
+    */
+    if(rtt.count() < 0){
+        return;
+    }
+
+    if(!sampled){
+        smoothedRtt = rtt;
+        rttVariation = rtt / 2;
+        sampled = true;
+    }else{
+        chrono::microseconds delta = smoothedRtt > rtt ? smoothedRtt - rtt : rtt - smoothedRtt;
+        rttVariation = (3 * rttVariation + delta) / 4;
+        smoothedRtt = (7 * smoothedRtt + rtt) / 8;
+    }
+
+    currentRto = clampRto(smoothedRtt + 4 * rttVariation);
+}
+
+void RttEstimator::backoff(){
+    /*
+    Dobra o RTO após um timeout (RFC 6298, seção 5.5).
+    */
+    currentRto = clampRto(2 * chrono::duration_cast<chrono::microseconds>(currentRto));
+}
+
+chrono::milliseconds RttEstimator::clampRto(chrono::microseconds value) const{
+    // arredonda para cima, para que um RTO de 1.2ms não vire 1ms
+    chrono::milliseconds ms = chrono::ceil<chrono::milliseconds>(value);
+    return max(policy.minRto, min(policy.maxRto, ms));
+}
@@ -0,0 +1,49 @@
+#ifndef RTT_H
+#define RTT_H
+
+#include <bits/stdc++.h>
+
+using namespace std;
+
+using SlowClock = chrono::steady_clock;
+
+struct RetransmissionPolicy {
+    int maxRetries = 3;                             // retransmissões de um mesmo pacote antes de desistir
+    chrono::milliseconds initialRto{1000};          // RTO antes da primeira amostra de RTT (RFC 6298)
+    chrono::milliseconds minRto{200};
+    chrono::milliseconds maxRto{60000};
+    int duplicateAckThreshold = 3;                  // ACKs de pacotes posteriores que denunciam a perda (0 desliga a retransmissão rápida)
+};
+
+class RttEstimator{
+    /*
+    Estimativa do RTT e cálculo do RTO conforme RFC 6298.
+
+    SRTT e RTTVAR são atualizados a cada amostra; amostras de pacotes retransmitidos
+    não devem ser entregues (regra de Karn), pois não há como saber a qual transmissão
+    o ACK corresponde. Cada timeout dobra o RTO (backoff exponencial) até a próxima amostra válida.
+    */
+    public:
+        explicit RttEstimator(const RetransmissionPolicy & policy = RetransmissionPolicy());
+
+        void setPolicy(const RetransmissionPolicy & policy);
+        const RetransmissionPolicy & getPolicy() const { return policy; }
+
+        void addSample(chrono::microseconds rtt);
+        void backoff();
+
+        chrono::milliseconds rto() const { return currentRto; }
+        chrono::microseconds srtt() const { return smoothedRtt; }
+        chrono::microseconds rttvar() const { return rttVariation; }
+        bool hasSample() const { return sampled; }
+    private:
+        RetransmissionPolicy policy;
+        chrono::microseconds smoothedRtt{0};
+        chrono::microseconds rttVariation{0};
+        chrono::milliseconds currentRto;
+        bool sampled = false;
+
+        chrono::milliseconds clampRto(chrono::microseconds value) const;
+};
+
+#endif
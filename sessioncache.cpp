@@ -0,0 +1,183 @@
+#include "sessioncache.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+string defaultSessionCachePath(){
+    const char * home = getenv("HOME");
+    return home != nullptr && *home != 0 ? string(home) + "/.slow_sessions" : string(".slow_sessions");
+}
+
+int64_t wallClockMs(){
+    return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+SessionCache::SessionCache() : fileDescriptor(-1), file(nullptr), current(nullptr){
+}
+
+SessionCache::~SessionCache(){
+    if(file != nullptr){
+        munmap(file, sizeof(SessionCacheFile));
+    }
+    if(fileDescriptor >= 0){
+        close(fileDescriptor);
+    }
+}
+
+bool SessionCache::open(const string & path){
+    /*
+    Abre (ou cria) o arquivo do cache e o mapeia em memória. Um arquivo de outra
+    versão, ou corrompido, é zerado.
+
+    param   path  caminho do arquivo.
+    return  true se o cache está pronto para uso.
+    */
+    fileDescriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if(fileDescriptor < 0){
+        perror("open (cache de sessões)");
+        return false;
+    }
+
+    this->lock();
+    bool ok = ftruncate(fileDescriptor, sizeof(SessionCacheFile)) == 0;
+    if(ok){
+        void * mapped = mmap(nullptr, sizeof(SessionCacheFile), PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+        ok = mapped != MAP_FAILED;
+        if(ok){
+            file = (SessionCacheFile *)mapped;
+        }
+    }
+    if(ok && (file->magic != SESSION_CACHE_MAGIC || file->version != SESSION_CACHE_VERSION ||
+              file->entryCount != SESSION_CACHE_ENTRIES)){
+        memset((void *)file, 0, sizeof(SessionCacheFile));
+        file->version = SESSION_CACHE_VERSION;
+        file->entryCount = SESSION_CACHE_ENTRIES;
+        file->magic = SESSION_CACHE_MAGIC;
+    }
+    this->unlock();
+
+    if(!ok){
+        perror("mmap (cache de sessões)");
+        close(fileDescriptor);
+        fileDescriptor = -1;
+        return false;
+    }
+    return true;
+}
+
+void SessionCache::lock(){
+    while(flock(fileDescriptor, LOCK_EX) < 0 && errno == EINTR){
+    }
+}
+
+void SessionCache::unlock(){
+    flock(fileDescriptor, LOCK_UN);
+}
+
+SessionCacheEntry * SessionCache::find(const struct sockaddr_in & central){
+    for(SessionCacheEntry & entry : file->entries){
+        if(entry.address == central.sin_addr.s_addr && entry.port == central.sin_port){
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+SessionCacheEntry * SessionCache::slotFor(const struct sockaddr_in & central){
+    /*
+    Entrada para a central: a dela, senão uma livre, senão a atualizada há mais tempo.
+    */
+    SessionCacheEntry * entry = this->find(central);
+    if(entry != nullptr){
+        return entry;
+    }
+    SessionCacheEntry * oldest = &file->entries[0];
+    for(SessionCacheEntry & candidate : file->entries){
+        if(candidate.address == 0 && candidate.port == 0){
+            return &candidate;
+        }
+        if(candidate.updatedAtMs < oldest->updatedAtMs){
+            oldest = &candidate;
+        }
+    }
+    return oldest;
+}
+
+bool SessionCache::load(const struct sockaddr_in & central, SessionCacheEntry & entry){
+    /*
+    Procura a última sessão com a central que ainda esteja dentro do STTL.
+
+    param   central  endereço da central.
+    param   entry    recebe a sessão encontrada.
+    return  true se há sessão que ainda pode ser revivida.
+    */
+    if(file == nullptr){
+        return false;
+    }
+    this->lock();
+    SessionCacheEntry * found = this->find(central);
+    bool alive = found != nullptr && found->valid &&
+                 wallClockMs() - found->updatedAtMs < (int64_t)(found->sttl >> 5);
+    if(alive){
+        entry = *found;
+        current = found;
+    }
+    this->unlock();
+    return alive;
+}
+
+void SessionCache::store(const struct sockaddr_in & central, const SID & sid, uint32_t sttl,
+                         uint32_t lastCentralSeqNum, uint32_t nextSeqNum, uint16_t window){
+    /*
+    Grava a sessão como a última com a central (sessão estabelecida, revive aceito ou
+    storeSession()) e passa a atualizá-la em touch().
+    */
+    if(file == nullptr){
+        return;
+    }
+    this->lock();
+    SessionCacheEntry * entry = this->slotFor(central);
+    entry->valid = 0;
+    entry->address = central.sin_addr.s_addr;
+    entry->port = central.sin_port;
+    entry->sid = sid;
+    entry->sttl = sttl;
+    entry->lastCentralSeqNum = lastCentralSeqNum;
+    entry->nextSeqNum = nextSeqNum;
+    entry->window = window;
+    entry->updatedAtMs = wallClockMs();
+    entry->valid = 1;
+    current = entry;
+    this->unlock();
+}
+
+void SessionCache::touch(const SID & sid, uint32_t lastCentralSeqNum, uint32_t nextSeqNum, uint16_t window){
+    /*
+    Atualiza a sessão atual depois de um ACK: só escritas na memória mapeada, sem lock
+    (se outro processo tomou a entrada para outra sessão, nada é feito).
+    */
+    if(current == nullptr || !current->sid.isEqual(sid)){
+        return;
+    }
+    current->lastCentralSeqNum = lastCentralSeqNum;
+    current->nextSeqNum = nextSeqNum;
+    current->window = window;
+    current->updatedAtMs = wallClockMs();
+}
+
+void SessionCache::invalidate(const struct sockaddr_in & central){
+    /*
+    Esquece a sessão com a central (a central respondeu Failed ao revive).
+    */
+    if(file == nullptr){
+        return;
+    }
+    this->lock();
+    SessionCacheEntry * entry = this->find(central);
+    if(entry != nullptr){
+        entry->valid = 0;
+    }
+    this->unlock();
+}
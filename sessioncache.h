@@ -0,0 +1,75 @@
+#ifndef SESSIONCACHE_H
+#define SESSIONCACHE_H
+
+#include "slow.h"
+
+#include <netinet/in.h>
+
+const uint32_t SESSION_CACHE_MAGIC = 0x534c4f57; // "SLOW"
+const uint32_t SESSION_CACHE_VERSION = 2;
+const size_t SESSION_CACHE_ENTRIES = 64;          // centrais diferentes lembradas ao mesmo tempo
+
+struct SessionCacheEntry {
+    /*
+    Última sessão com uma central, no formato do arquivo (sem ponteiros, tamanho fixo).
+    */
+    uint32_t address = 0;        // IPv4 da central, ordem de rede; 0 = entrada livre
+    uint16_t port = 0;           // ordem de rede
+    uint16_t valid = 0;
+    SID sid = SID::Nil();
+    uint32_t sttl = 0;           // como vem no cabeçalho: milissegundos << 5
+    uint32_t lastCentralSeqNum = 0;
+    uint32_t nextSeqNum = 0;     // o nosso próximo seqNum, para a central não o tomar por duplicata
+    uint16_t window = 0;         // última janela anunciada pela central
+    uint16_t reserved = 0;
+    int64_t updatedAtMs = 0;     // relógio de parede: o monotônico recomeça a cada boot
+};
+
+static_assert(sizeof(SessionCacheEntry) == 48, "o layout da entrada faz parte do formato do arquivo");
+
+struct SessionCacheFile {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+    SessionCacheEntry entries[SESSION_CACHE_ENTRIES];
+};
+
+class SessionCache{
+    /*
+    Cache de sessões em disco, para reviver depois de reiniciar o processo: um arquivo
+    pequeno mapeado em memória (mmap compartilhado), com uma entrada por central
+    (endereço e porta). Gravado no estabelecimento da sessão, em storeSession() e a
+    cada ACK; as atualizações por ACK são só escritas na memória mapeada, sem syscall,
+    e o kernel as leva ao disco mesmo se o processo cair.
+
+    open/store/invalidate seguram um flock no arquivo, para vários processos poderem
+    usar o mesmo cache.
+    */
+    public:
+        SessionCache();
+        ~SessionCache();
+
+        bool open(const string & path);
+        bool isOpen() const { return file != nullptr; }
+
+        bool load(const struct sockaddr_in & central, SessionCacheEntry & entry);
+        void store(const struct sockaddr_in & central, const SID & sid, uint32_t sttl,
+                   uint32_t lastCentralSeqNum, uint32_t nextSeqNum, uint16_t window);
+        void touch(const SID & sid, uint32_t lastCentralSeqNum, uint32_t nextSeqNum, uint16_t window);
+        void invalidate(const struct sockaddr_in & central);
+    private:
+        int fileDescriptor;
+        SessionCacheFile * file;
+        SessionCacheEntry * current; // entrada da sessão atual, atualizada por touch()
+
+        SessionCacheEntry * find(const struct sockaddr_in & central);
+        SessionCacheEntry * slotFor(const struct sockaddr_in & central);
+        void lock();
+        void unlock();
+};
+
+string defaultSessionCachePath();
+int64_t wallClockMs();
+
+#endif
@@ -1,5 +1,12 @@
 #include "slow.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SLOW_HEADER_X86 1
+#else
+#define SLOW_HEADER_X86 0
+#endif
+
 void serializationOf32bits(uint32_t val, uint8_t * buffer){
     for(int i=0;i<4;i++){
         buffer[i] = val & 0xFF;
@@ -7,7 +14,7 @@ void serializationOf32bits(uint32_t val, uint8_t * buffer){
     } // elimina os 2 LSBytes e depois pega os novos 2 LSBytes
 }
 
-uint32_t deserializationOf4bytes(uint8_t * buffer){
+uint32_t deserializationOf4bytes(const uint8_t * buffer){
     uint32_t ret = 0;
 
     for(int i=0;i<4;i++){
@@ -25,7 +32,7 @@ void serializationOf16bits(uint16_t val, uint8_t * buffer){
     } // elimina os 2 LSBytes e depois pega os novos 2 LSBytes
 }
 
-uint16_t deserializationOf2bytes(uint8_t * buffer){
+uint16_t deserializationOf2bytes(const uint8_t * buffer){
     uint16_t ret = 0;
 
     for(int i=0;i<2;i++){
@@ -36,7 +43,7 @@ uint16_t deserializationOf2bytes(uint8_t * buffer){
     return ret;
 }
 
-void serializationOfSlowHeader(SlowHeader & header, uint8_t * buffer){
+void serializationOfSlowHeaderScalar(const SlowHeader & header, uint8_t * buffer){
     // serializa SID
     for(int i=0;i<16;i++) buffer[i] = header.sid.byte[i];
 
@@ -51,7 +58,7 @@ void serializationOfSlowHeader(SlowHeader & header, uint8_t * buffer){
     buffer[31] = header.fo;
 }
 
-void deserializationForSlowHeader(SlowHeader & header, uint8_t * buffer){
+void deserializationForSlowHeaderScalar(SlowHeader & header, const uint8_t * buffer){
     for(int i=0;i<16;i++) header.sid.byte[i] = buffer[i];
 
     header.sttlAndFlags = deserializationOf4bytes(&buffer[16]);
@@ -62,4 +69,140 @@ void deserializationForSlowHeader(SlowHeader & header, uint8_t * buffer){
 
     header.fid = buffer[30];
     header.fo = buffer[31];
-}
\ No newline at end of file
+}
+
+#if SLOW_HEADER_NATIVE_LAYOUT
+
+static inline void copyHeader32(void * dst, const void * src){
+    // duas cargas/escritas de 16 bytes: o cabeçalho inteiro sem tocar campo a campo
+#if SLOW_HEADER_X86
+    __m128i low = _mm_loadu_si128(static_cast<const __m128i *>(src));
+    __m128i high = _mm_loadu_si128(static_cast<const __m128i *>(src) + 1);
+    _mm_storeu_si128(static_cast<__m128i *>(dst), low);
+    _mm_storeu_si128(static_cast<__m128i *>(dst) + 1, high);
+#else
+    memcpy(dst, src, SLOW_HEADER_SIZE);
+#endif
+}
+
+void serializationOfSlowHeader(const SlowHeader & header, uint8_t * buffer){
+    copyHeader32(buffer, &header);
+}
+
+void deserializationForSlowHeader(SlowHeader & header, const uint8_t * buffer){
+    copyHeader32(&header, buffer);
+}
+
+#else
+
+void serializationOfSlowHeader(const SlowHeader & header, uint8_t * buffer){
+    serializationOfSlowHeaderScalar(header, buffer);
+}
+
+void deserializationForSlowHeader(SlowHeader & header, const uint8_t * buffer){
+    deserializationForSlowHeaderScalar(header, buffer);
+}
+
+#endif
+
+// kernels de lote: recebem origem/destino e os passos de cada lado
+using HeaderBatchKernel = void (*)(uint8_t * dst, size_t dstStride, const uint8_t * src, size_t srcStride, size_t count);
+
+#if SLOW_HEADER_NATIVE_LAYOUT && SLOW_HEADER_X86
+
+__attribute__((target("avx2")))
+static void copyHeadersAvx2(uint8_t * dst, size_t dstStride, const uint8_t * src, size_t srcStride, size_t count){
+    // um registrador de 32 bytes por cabeçalho, quatro por iteração
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4){
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + (i + 0) * srcStride));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + (i + 1) * srcStride));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + (i + 2) * srcStride));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + (i + 3) * srcStride));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + (i + 0) * dstStride), a);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + (i + 1) * dstStride), b);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + (i + 2) * dstStride), c);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + (i + 3) * dstStride), d);
+    }
+    for(; i < count; i++){
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * srcStride));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * dstStride), a);
+    }
+}
+
+static void copyHeadersSse2(uint8_t * dst, size_t dstStride, const uint8_t * src, size_t srcStride, size_t count){
+    for(size_t i = 0; i < count; i++){
+        copyHeader32(dst + i * dstStride, src + i * srcStride);
+    }
+}
+
+static HeaderBatchKernel resolveHeaderKernel(const char * & name){
+    if(__builtin_cpu_supports("avx2")){
+        name = "avx2";
+        return copyHeadersAvx2;
+    }
+    name = "sse2";
+    return copyHeadersSse2;
+}
+
+#elif SLOW_HEADER_NATIVE_LAYOUT
+
+static void copyHeadersNative(uint8_t * dst, size_t dstStride, const uint8_t * src, size_t srcStride, size_t count){
+    for(size_t i = 0; i < count; i++){
+        copyHeader32(dst + i * dstStride, src + i * srcStride);
+    }
+}
+
+static HeaderBatchKernel resolveHeaderKernel(const char * & name){
+    name = "native";
+    return copyHeadersNative;
+}
+
+#endif
+
+#if SLOW_HEADER_NATIVE_LAYOUT
+
+struct HeaderKernelChoice {
+    const char * name = "scalar";
+    HeaderBatchKernel kernel;
+
+    HeaderKernelChoice() : kernel(resolveHeaderKernel(name)) {}
+};
+
+static const HeaderKernelChoice & headerKernel(){
+    // resolvido na primeira chamada, inclusive se ela vier de um inicializador estático
+    static const HeaderKernelChoice choice;
+    return choice;
+}
+
+void serializationOfSlowHeaders(const SlowHeader * headers, uint8_t * buffers, size_t stride, size_t count){
+    headerKernel().kernel(buffers, stride, reinterpret_cast<const uint8_t *>(headers), sizeof(SlowHeader), count);
+}
+
+void deserializationForSlowHeaders(SlowHeader * headers, const uint8_t * buffers, size_t stride, size_t count){
+    headerKernel().kernel(reinterpret_cast<uint8_t *>(headers), sizeof(SlowHeader), buffers, stride, count);
+}
+
+const char * slowHeaderCodecName(){
+    return headerKernel().name;
+}
+
+#else
+
+void serializationOfSlowHeaders(const SlowHeader * headers, uint8_t * buffers, size_t stride, size_t count){
+    for(size_t i = 0; i < count; i++){
+        serializationOfSlowHeaderScalar(headers[i], buffers + i * stride);
+    }
+}
+
+void deserializationForSlowHeaders(SlowHeader * headers, const uint8_t * buffers, size_t stride, size_t count){
+    for(size_t i = 0; i < count; i++){
+        deserializationForSlowHeaderScalar(headers[i], buffers + i * stride);
+    }
+}
+
+const char * slowHeaderCodecName(){
+    return "scalar";
+}
+
+#endif
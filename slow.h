@@ -20,10 +20,7 @@ struct SID{
     }
 
     bool isEqual(const SID& other) const {
-        for(int i=0; i<16; ++i) {
-            if (byte[i] != other.byte[i]) return false;
-        }
-        return true;
+        return memcmp(byte, other.byte, sizeof(byte)) == 0; // vira duas comparações de 8 bytes
     }
 
     // uuidv8 primeiros 6 octetos sao custom_a
@@ -32,6 +29,19 @@ struct SID{
 
 };
 
+struct SIDHash{
+    // o SID é aleatório (UUIDv8), então 8 dos seus bytes já servem de hash
+    size_t operator()(const SID & sid) const {
+        uint64_t h;
+        memcpy(&h, &sid.byte[8], sizeof(h));
+        return (size_t)(h ^ (h >> 29));
+    }
+};
+
+struct SIDEqual{
+    bool operator()(const SID & a, const SID & b) const { return a.isEqual(b); }
+};
+
 struct Flags{
     bool C = false;
     bool R = false;
@@ -39,7 +49,7 @@ struct Flags{
     bool AR = false;
     bool MB = false;
 
-    uint8_t toByte() {
+    uint8_t toByte() const {
         uint8_t res = 0;
         res |= C ? (1<<4) : 0;
         res |= R ? (1<<3) : 0;
@@ -73,13 +83,13 @@ struct SlowHeader{
 
     // as funçoes operam em sttl e flags por conta de que o resto é so atribuir
 
-    uint32_t getSttl(){
+    uint32_t getSttl() const {
         return sttlAndFlags & 0xffffffe0;
         // 07FFFFFF é 0000-0111-1111-1111-1111-1111-1111-1111
         //              0    E   F    F    F    F   F    F
     }
 
-    Flags getFlags(){
+    Flags getFlags() const {
         return Flags::fromByte((sttlAndFlags&0x1f));
         // queremos 1111-1000-0000-0000-0000-0000-0000-0000
         //           f     1   0    0     0    0    0    0
@@ -101,6 +111,24 @@ struct SlowHeader{
 
 };
 
+// Em hosts little-endian o layout natural do SlowHeader é exatamente o do fio:
+// o codec rápido copia os 32 bytes de uma vez. Qualquer mudança no struct quebra a compilação aqui.
+static_assert(sizeof(SID) == 16, "SID deve ter 16 bytes");
+static_assert(offsetof(SlowHeader, sid) == 0, "layout do SlowHeader difere do cabeçalho SLOW");
+static_assert(offsetof(SlowHeader, sttlAndFlags) == 16, "layout do SlowHeader difere do cabeçalho SLOW");
+static_assert(offsetof(SlowHeader, seqNum) == 20, "layout do SlowHeader difere do cabeçalho SLOW");
+static_assert(offsetof(SlowHeader, ackNum) == 24, "layout do SlowHeader difere do cabeçalho SLOW");
+static_assert(offsetof(SlowHeader, window) == 28, "layout do SlowHeader difere do cabeçalho SLOW");
+static_assert(offsetof(SlowHeader, fid) == 30, "layout do SlowHeader difere do cabeçalho SLOW");
+static_assert(offsetof(SlowHeader, fo) == 31, "layout do SlowHeader difere do cabeçalho SLOW");
+static_assert(sizeof(SlowHeader) == SLOW_HEADER_SIZE, "SlowHeader deve ter exatamente 32 bytes");
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SLOW_HEADER_NATIVE_LAYOUT 1
+#else
+#define SLOW_HEADER_NATIVE_LAYOUT 0
+#endif
+
 struct SlowPacket{
     SlowHeader header;
     uint8_t data[1440];
@@ -108,11 +136,20 @@ struct SlowPacket{
 
 void serializationOf32bits(uint32_t val, uint8_t * buffer);
 void serializationOf16bits(uint16_t val, uint8_t * buffer);
-void serializationOfSlowHeader(SlowHeader & header, uint8_t * buffer);
+void serializationOfSlowHeader(const SlowHeader & header, uint8_t * buffer);
+
+uint32_t deserializationOf4bytes(const uint8_t * buffer);
+uint16_t deserializationOf2bytes(const uint8_t * buffer);
+void deserializationForSlowHeader(SlowHeader & header, const uint8_t * buffer);
+
+// versões byte a byte, portáveis para qualquer ordem de bytes (fallback e referência)
+void serializationOfSlowHeaderScalar(const SlowHeader & header, uint8_t * buffer);
+void deserializationForSlowHeaderScalar(SlowHeader & header, const uint8_t * buffer);
 
-uint32_t deserializationOf4bytes(uint8_t * buffer);
-uint16_t deserializationOf2bytes(uint8_t * buffer);
-void deserializationForSlowHeader(SlowHeader & header, uint8_t * buffer);
+// lote: count cabeçalhos, o i-ésimo em buffers + i * stride (stride >= SLOW_HEADER_SIZE)
+void serializationOfSlowHeaders(const SlowHeader * headers, uint8_t * buffers, size_t stride, size_t count);
+void deserializationForSlowHeaders(SlowHeader * headers, const uint8_t * buffers, size_t stride, size_t count);
+const char * slowHeaderCodecName(); // kernel escolhido em tempo de execução ("avx2", "sse2", "scalar")
 
 
 
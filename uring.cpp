@@ -0,0 +1,457 @@
+#include "uring.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/udp.h> // UDP_GRO
+
+// user_data de cada tipo de requisição; nos envios os 32 bits baixos são a posição no lote
+const uint64_t URING_RECV_TAG = 1;
+const uint64_t URING_CANCEL_TAG = 2;
+const uint64_t URING_SEND_TAG = 1ull << 32;
+
+UringIO::UringIO() : ringFileDescriptor(-1), submitRing(MAP_FAILED), submitRingSize(0), submitHead(nullptr),
+    submitTail(nullptr), submitMask(0), submitEntries((struct io_uring_sqe *)MAP_FAILED), submitEntriesSize(0),
+    pendingSubmits(0), completionRing(MAP_FAILED), completionRingSize(0), completionHead(nullptr),
+    completionTail(nullptr), completionMask(0), completions(nullptr),
+    bufferRing((struct io_uring_buf_ring *)MAP_FAILED), bufferRingSize(0), bufferMask(0), bufferTail(0),
+    bufferSize(0), recvArmed(false), recvError(0), sendsPending(0), sendRound(0), enterCalls(0){
+    memset(&recvTemplate, 0, sizeof(recvTemplate));
+}
+
+UringIO::~UringIO(){
+    teardown();
+}
+
+bool UringIO::setup(int socketFileDescriptor, unsigned bufferCount, size_t payloadSize, size_t controlSize){
+    /*
+    Cria o anel, registra o socket como arquivo fixo, registra o anel de bufferCount buffers
+    fornecidos (cada um com espaço para o cabeçalho do recvmsg multishot, o endereço de origem,
+    controlSize bytes de cmsg e payloadSize bytes de dados) e arma a recepção.
+    bufferCount precisa ser potência de 2.
+
+    return  true se o kernel suporta tudo isso (io_uring habilitado, anel de buffers
+            fornecidos e recvmsg multishot); false deixa o objeto inativo.
+    */
+    teardown();
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = URING_COMPLETION_ENTRIES;
+
+    int fd = syscall(__NR_io_uring_setup, URING_SUBMIT_ENTRIES, &params);
+    if(fd < 0){
+        return false;
+    }
+    ringFileDescriptor = fd;
+
+    submitRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(singleMap){
+        submitRingSize = completionRingSize = max(submitRingSize, completionRingSize);
+    }
+
+    submitRing = mmap(NULL, submitRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(submitRing == MAP_FAILED){
+        teardown();
+        return false;
+    }
+    if(singleMap){
+        completionRing = submitRing;
+    }else{
+        completionRing = mmap(NULL, completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if(completionRing == MAP_FAILED){
+            teardown();
+            return false;
+        }
+    }
+    submitEntriesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    submitEntries = (struct io_uring_sqe *)mmap(NULL, submitEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(submitEntries == MAP_FAILED){
+        teardown();
+        return false;
+    }
+
+    uint8_t * sq = static_cast<uint8_t *>(submitRing);
+    submitHead = (unsigned *)(sq + params.sq_off.head);
+    submitTail = (unsigned *)(sq + params.sq_off.tail);
+    submitMask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    unsigned * submitArray = (unsigned *)(sq + params.sq_off.array);
+    for(unsigned i = 0; i < params.sq_entries; i++){
+        submitArray[i] = i; // a posição do SQE no anel é sempre a mesma do índice
+    }
+
+    uint8_t * cq = static_cast<uint8_t *>(completionRing);
+    completionHead = (unsigned *)(cq + params.cq_off.head);
+    completionTail = (unsigned *)(cq + params.cq_off.tail);
+    completionMask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    completions = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // o socket vira o arquivo fixo 0: o kernel não precisa resolver o fd a cada requisição
+    if(syscall(__NR_io_uring_register, fd, IORING_REGISTER_FILES, &socketFileDescriptor, 1) < 0){
+        teardown();
+        return false;
+    }
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    bufferRingSize = (bufferCount * sizeof(struct io_uring_buf) + pageSize - 1) / pageSize * pageSize;
+    bufferRing = (struct io_uring_buf_ring *)mmap(NULL, bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(bufferRing == MAP_FAILED){
+        teardown();
+        return false;
+    }
+
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t)(uintptr_t)bufferRing;
+    registration.ring_entries = bufferCount;
+    registration.bgid = URING_BUFFER_GROUP;
+    if(syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0){
+        teardown();
+        return false;
+    }
+
+    // cada buffer começa numa linha de cache
+    bufferSize = (sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + controlSize + payloadSize + 63) & ~(size_t)63;
+    bufferMemory.assign(bufferCount * bufferSize, 0);
+    bufferMask = bufferCount - 1;
+    bufferTail = 0;
+    for(unsigned i = 0; i < bufferCount; i++){
+        releaseBuffer(i);
+    }
+
+    received.reserve(bufferCount);
+    memset(&recvTemplate, 0, sizeof(recvTemplate));
+    recvTemplate.msg_namelen = sizeof(struct sockaddr_in);
+    recvTemplate.msg_controllen = controlSize;
+
+    // kernels sem recvmsg multishot recusam o SQE na hora, e a conclusão já vem no enter
+    armReceive();
+    if(enter(0, 0) < 0){
+        teardown();
+        return false;
+    }
+    reapCompletions();
+    if(!recvArmed){
+        teardown();
+        errno = EOPNOTSUPP;
+        return false;
+    }
+
+    return true;
+}
+
+void UringIO::teardown(){
+    /*
+    Cancela a recepção armada (esperando a conclusão final, para o kernel não escrever mais
+    nos buffers) e desfaz os mapeamentos. Fechar o anel libera os registros.
+    */
+    if(ringFileDescriptor >= 0 && recvArmed){
+        struct io_uring_sqe * sqe = nextSubmitEntry();
+        if(sqe != nullptr){
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = URING_RECV_TAG;
+            sqe->user_data = URING_CANCEL_TAG;
+            for(int attempt = 0; attempt < 100 && recvArmed; attempt++){
+                if(enter(1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR){
+                    break;
+                }
+                reapCompletions();
+            }
+        }
+    }
+
+    if(submitEntries != MAP_FAILED){
+        munmap(submitEntries, submitEntriesSize);
+        submitEntries = (struct io_uring_sqe *)MAP_FAILED;
+    }
+    if(completionRing != MAP_FAILED && completionRing != submitRing){
+        munmap(completionRing, completionRingSize);
+    }
+    completionRing = MAP_FAILED;
+    if(submitRing != MAP_FAILED){
+        munmap(submitRing, submitRingSize);
+        submitRing = MAP_FAILED;
+    }
+    if(ringFileDescriptor >= 0){
+        close(ringFileDescriptor);
+        ringFileDescriptor = -1;
+    }
+    if(bufferRing != MAP_FAILED){
+        munmap(bufferRing, bufferRingSize);
+        bufferRing = (struct io_uring_buf_ring *)MAP_FAILED;
+    }
+
+    pendingSubmits = 0;
+    recvArmed = false;
+    recvError = 0;
+    sendsPending = 0;
+    received.clear();
+}
+
+struct io_uring_sqe * UringIO::nextSubmitEntry(){
+    /*
+    Próximo SQE livre, zerado. Só fica visível ao kernel no próximo enter().
+
+    return  nullptr se o anel de submissão estiver cheio.
+    */
+    unsigned tail = *submitTail + pendingSubmits;
+    if(tail - __atomic_load_n(submitHead, __ATOMIC_ACQUIRE) >= submitMask + 1){
+        return nullptr;
+    }
+    struct io_uring_sqe * sqe = &submitEntries[tail & submitMask];
+    memset(sqe, 0, sizeof(*sqe));
+    pendingSubmits++;
+    return sqe;
+}
+
+int UringIO::enter(unsigned minComplete, unsigned flags){
+    /*
+    Publica os SQEs preenchidos e chama io_uring_enter, esperando por minComplete conclusões
+    se flags tiver IORING_ENTER_GETEVENTS.
+
+    return  o retorno da syscall (SQEs consumidos) ou -1 com errno.
+    */
+    if(pendingSubmits > 0){
+        __atomic_store_n(submitTail, *submitTail + pendingSubmits, __ATOMIC_RELEASE);
+        pendingSubmits = 0;
+    }
+    unsigned toSubmit = *submitTail - __atomic_load_n(submitHead, __ATOMIC_ACQUIRE);
+
+    enterCalls++;
+    return syscall(__NR_io_uring_enter, ringFileDescriptor, toSubmit, minComplete, flags, NULL, 0);
+}
+
+void UringIO::armReceive(){
+    /*
+    Enfileira o recvmsg multishot: a cada datagrama o kernel pega um buffer do grupo
+    URING_BUFFER_GROUP e posta uma conclusão, sem que a requisição precise ser refeita.
+    */
+    struct io_uring_sqe * sqe = nextSubmitEntry();
+    if(sqe == nullptr){
+        return;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = 0; // índice do socket nos arquivos fixos
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->addr = (uint64_t)(uintptr_t)&recvTemplate;
+    sqe->len = 0;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = URING_RECV_TAG;
+    recvArmed = true;
+}
+
+void UringIO::reapCompletions(){
+    /*
+    Consome tudo o que está no anel de conclusões, sem syscall: recepções vão para a fila
+    received e resultados de envio para sendResults.
+    */
+    unsigned head = *completionHead;
+    unsigned tail = __atomic_load_n(completionTail, __ATOMIC_ACQUIRE);
+
+    for(; head != tail; head++){
+        const struct io_uring_cqe & cqe = completions[head & completionMask];
+        if(cqe.user_data == URING_RECV_TAG){
+            handleReceiveCompletion(cqe);
+        }else if(cqe.user_data >= URING_SEND_TAG && (uint16_t)(cqe.user_data >> 16) == sendRound){
+            sendResults[cqe.user_data & 0xffff] = cqe.res;
+            sendsPending--;
+        }
+    }
+
+    __atomic_store_n(completionHead, head, __ATOMIC_RELEASE);
+}
+
+void UringIO::handleReceiveCompletion(const struct io_uring_cqe & cqe){
+    if(!(cqe.flags & IORING_CQE_F_MORE)){
+        recvArmed = false; // o kernel encerrou o multishot; receive() rearma
+    }
+    if(cqe.res < 0){
+        // sem buffers livres (ENOBUFS) ou cancelamento não são erros do socket
+        if(cqe.res != -ENOBUFS && cqe.res != -ECANCELED){
+            recvError = -cqe.res;
+        }
+        return;
+    }
+    if(!(cqe.flags & IORING_CQE_F_BUFFER)){
+        return;
+    }
+
+    uint16_t bufferId = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+    uint8_t * buffer = &bufferMemory[(size_t)bufferId * bufferSize];
+
+    struct io_uring_recvmsg_out out;
+    memcpy(&out, buffer, sizeof(out));
+    if(out.flags & MSG_TRUNC){
+        releaseBuffer(bufferId);
+        return;
+    }
+
+    uint8_t * name = buffer + sizeof(out);
+    uint8_t * control = name + recvTemplate.msg_namelen;
+
+    UringReceive & entry = received.emplace_back();
+    entry.payload = control + recvTemplate.msg_controllen;
+    entry.size = out.payloadlen;
+    entry.segmentSize = out.payloadlen;
+    entry.bufferId = bufferId;
+    memset(&entry.from, 0, sizeof(entry.from));
+    memcpy(&entry.from, name, min<size_t>(out.namelen, sizeof(entry.from)));
+
+    if(out.controllen > 0){
+        // cmsg do GRO: tamanho dos segmentos de um datagrama coalescido
+        struct msghdr hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_control = control;
+        hdr.msg_controllen = out.controllen;
+        for(struct cmsghdr * cm = CMSG_FIRSTHDR(&hdr); cm != NULL; cm = CMSG_NXTHDR(&hdr, cm)){
+            if(cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO){
+                int segmentSize;
+                memcpy(&segmentSize, CMSG_DATA(cm), sizeof(segmentSize));
+                if(segmentSize > 0){
+                    entry.segmentSize = segmentSize;
+                }
+            }
+        }
+    }
+}
+
+void UringIO::releaseBuffer(uint16_t bufferId){
+    /*
+    Devolve um buffer ao anel de buffers fornecidos. Só os campos addr/len/bid são escritos:
+    o resv da primeira entrada é o próprio tail do anel.
+
+    O anel é acessado como um vetor de io_uring_buf, e não por io_uring_buf_ring::bufs: em C++
+    o __DECLARE_FLEX_ARRAY do cabeçalho do kernel desloca bufs em 8 bytes.
+    */
+    struct io_uring_buf * entries = reinterpret_cast<struct io_uring_buf *>(bufferRing);
+    struct io_uring_buf & entry = entries[bufferTail & bufferMask];
+    entry.addr = (uint64_t)(uintptr_t)&bufferMemory[(size_t)bufferId * bufferSize];
+    entry.len = bufferSize;
+    entry.bid = bufferId;
+    bufferTail++;
+    __atomic_store_n(&entries[0].resv, bufferTail, __ATOMIC_RELEASE);
+}
+
+bool UringIO::completionsReady() const {
+    /*
+    true se receive() tem algo a entregar sem esperar: recepções já lidas, conclusões no
+    anel, ou a recepção precisa ser rearmada.
+    */
+    return !received.empty() || !recvArmed ||
+           __atomic_load_n(completionTail, __ATOMIC_ACQUIRE) != *completionHead;
+}
+
+int UringIO::receive(UringReceive * out, int max){
+    /*
+    Entrega até max datagramas recebidos. Os buffers continuam com o chamador até
+    releaseBuffer(). Rearma o recvmsg multishot quando o kernel o encerrou e não há
+    mais nada para entregar (os buffers já voltaram ao anel).
+
+    return  quantidade entregue; -1 com errno se o socket reportou um erro.
+    */
+    reapCompletions();
+
+    int count = 0;
+    while(count < max && !received.empty()){
+        out[count++] = received.front();
+        received.pop_front();
+    }
+
+    if(!recvArmed && received.empty()){
+        armReceive();
+        enter(0, 0);
+    }
+
+    if(count == 0 && recvError != 0){
+        errno = recvError;
+        recvError = 0;
+        return -1;
+    }
+    return count;
+}
+
+int UringIO::sendMessages(struct mmsghdr * messages, unsigned count, int flags){
+    /*
+    Equivalente ao sendmmsg(): cada mensagem vira um SENDMSG, todos encadeados em ordem,
+    submetidos e esperados em um único io_uring_enter. msg_len de cada mensagem recebe os
+    bytes enviados.
+
+    Se io_uring_enter falhar de novo sem que nenhuma conclusão tenha chegado desde a falha
+    anterior, desiste: os SQEs que o kernel ainda não pegou saem do anel, e conclusões que
+    chegarem depois (de outro lote, pelo sendRound) são ignoradas.
+
+    return  quantidade de mensagens enviadas a partir da primeira (as seguintes a uma falha
+            são canceladas pelo encadeamento); -1 com errno se a primeira falhou.
+    */
+    count = min(count, URING_SUBMIT_ENTRIES / 2);
+    sendRound++;
+
+    unsigned queued = 0;
+    for(; queued < count; queued++){
+        struct io_uring_sqe * sqe = nextSubmitEntry();
+        if(sqe == nullptr){
+            break;
+        }
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = 0;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->addr = (uint64_t)(uintptr_t)&messages[queued].msg_hdr;
+        sqe->len = 1;
+        sqe->msg_flags = flags;
+        sqe->user_data = URING_SEND_TAG | ((uint64_t)sendRound << 16) | queued;
+        sendResults[queued] = -ECANCELED;
+    }
+    if(queued == 0){
+        errno = EBUSY;
+        return -1;
+    }
+    // todos menos o último levam o link: o trem sai em ordem e para no primeiro erro
+    for(unsigned i = 0; i + 1 < queued; i++){
+        submitEntries[(*submitTail + pendingSubmits - queued + i) & submitMask].flags |= IOSQE_IO_LINK;
+    }
+    sendsPending = queued;
+
+    int ret = enter(queued, IORING_ENTER_GETEVENTS);
+    int error = 0;
+    unsigned pendingAtError = queued + 1; // nenhuma falha ainda
+    while(true){
+        if(ret < 0 && errno != EINTR){
+            error = errno;
+            reapCompletions();
+            if(sendsPending == queued && __atomic_load_n(submitHead, __ATOMIC_ACQUIRE) != *submitTail){
+                // nada foi consumido: retira os SQEs do anel
+                *submitTail = __atomic_load_n(submitHead, __ATOMIC_ACQUIRE);
+                sendsPending = 0;
+                errno = error;
+                return -1;
+            }
+            if(sendsPending == pendingAtError){
+                // falhou de novo sem progresso: fica com o que já foi concluído
+                *submitTail = __atomic_load_n(submitHead, __ATOMIC_ACQUIRE);
+                sendsPending = 0;
+                sendRound++;
+                break;
+            }
+            pendingAtError = sendsPending;
+        }
+        reapCompletions();
+        if(sendsPending == 0){
+            break;
+        }
+        ret = enter(1, IORING_ENTER_GETEVENTS);
+    }
+
+    unsigned sent = 0;
+    while(sent < queued && sendResults[sent] >= 0){
+        messages[sent].msg_len = sendResults[sent];
+        sent++;
+    }
+    if(sent == 0){
+        errno = sendResults[0] == -ECANCELED && error != 0 ? error : -sendResults[0];
+        return -1;
+    }
+    return sent;
+}
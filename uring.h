@@ -0,0 +1,105 @@
+#ifndef URING_H
+#define URING_H
+
+#include "slow.h"
+#include "ringqueue.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/io_uring.h>
+
+const unsigned URING_SUBMIT_ENTRIES = 256;     // SQEs: um lote de envios (IO_BATCH_SIZE) mais o rearme da recepção
+const unsigned URING_COMPLETION_ENTRIES = 1024; // CQEs: cada buffer fornecido gera no máximo uma conclusão pendente
+const unsigned URING_RECV_BUFFERS = 256;       // potência de 2 (exigência do anel de buffers fornecidos)
+const unsigned URING_GRO_RECV_BUFFERS = 32;    // com GRO cada buffer comporta um datagrama coalescido de até 64KB
+const uint16_t URING_BUFFER_GROUP = 0;
+
+struct UringReceive {
+    uint8_t * payload = nullptr; // dentro do buffer fornecido; válido até releaseBuffer(bufferId)
+    size_t size = 0;
+    size_t segmentSize = 0;      // tamanho do segmento GRO (igual a size se não foi coalescido)
+    struct sockaddr_in from;
+    uint16_t bufferId = 0;
+};
+
+class UringIO{
+    /*
+    Backend io_uring para o socket UDP, falando direto com o kernel pelas syscalls
+    (io_uring_setup/io_uring_enter/io_uring_register), sem liburing.
+
+    Recepção: um único recvmsg multishot fica armado no socket (registrado como arquivo fixo)
+    e o kernel escolhe um buffer do anel de buffers fornecidos para cada datagrama. As
+    conclusões aparecem no anel de conclusões (memória compartilhada) e são lidas sem
+    nenhuma syscall; os buffers voltam ao anel em releaseBuffer(), também sem syscall.
+    O recvmsg só precisa ser rearmado quando o kernel o encerra (ex.: faltaram buffers).
+
+    Envio: um lote de mensagens vira uma sequência de SENDMSG encadeados (IOSQE_IO_LINK),
+    submetidos e esperados em um único io_uring_enter. O encadeamento mantém a ordem dos
+    fragmentos e cancela o resto do trem se um envio falhar, como um sendmmsg() parcial.
+
+    O descritor do anel (fileDescriptor()) fica legível no epoll quando há conclusões.
+    */
+    public:
+        UringIO();
+        ~UringIO();
+
+        bool setup(int socketFileDescriptor, unsigned bufferCount, size_t payloadSize, size_t controlSize);
+        void teardown();
+        bool active() const { return ringFileDescriptor >= 0; }
+        int fileDescriptor() const { return ringFileDescriptor; }
+
+        int sendMessages(struct mmsghdr * messages, unsigned count, int flags);
+        bool completionsReady() const;
+        int receive(UringReceive * out, int max);
+        void releaseBuffer(uint16_t bufferId);
+
+        uint64_t systemCalls() const { return enterCalls; }
+    private:
+        int ringFileDescriptor;
+
+        // anel de submissão
+        void * submitRing;
+        size_t submitRingSize;
+        unsigned * submitHead;
+        unsigned * submitTail;
+        unsigned submitMask;
+        struct io_uring_sqe * submitEntries;
+        size_t submitEntriesSize;
+        unsigned pendingSubmits; // SQEs preenchidos e ainda não entregues ao kernel
+
+        // anel de conclusão (no mesmo mmap do de submissão quando o kernel permite)
+        void * completionRing;
+        size_t completionRingSize;
+        unsigned * completionHead;
+        unsigned * completionTail;
+        unsigned completionMask;
+        struct io_uring_cqe * completions;
+
+        // buffers fornecidos para o recvmsg multishot
+        struct io_uring_buf_ring * bufferRing;
+        size_t bufferRingSize;
+        unsigned bufferMask;
+        uint16_t bufferTail;
+        vector<uint8_t> bufferMemory;
+        size_t bufferSize;
+        struct msghdr recvTemplate; // só os tamanhos de nome/controle importam no multishot
+        bool recvArmed;
+        int recvError;              // erro do socket entregue pelo recvmsg, reportado uma vez
+
+        RingQueue<UringReceive> received; // recepções lidas do anel enquanto se esperava por envios
+
+        int sendResults[URING_SUBMIT_ENTRIES];
+        unsigned sendsPending;
+        uint16_t sendRound;         // vai no user_data dos envios: conclusões de um lote abandonado são ignoradas
+
+        uint64_t enterCalls;
+
+        struct io_uring_sqe * nextSubmitEntry();
+        int enter(unsigned minComplete, unsigned flags);
+        void armReceive();
+        void reapCompletions();
+        void handleReceiveCompletion(const struct io_uring_cqe & cqe);
+};
+
+#endif